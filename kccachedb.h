@@ -49,107 +49,100 @@ class CacheDB : public BasicDB {
   friend class PlantDB<CacheDB, BasicDB::TYPEGRASS>;
  public:
   class Cursor;
-  class CursorListSafe;
-  static const int32_t SLOTNUM = 257; //make it a prime.
  private:
 
   struct Record;
   struct TranLog;
+  struct Slab;
   struct Slot;
+  struct Counter;
+  struct TxCounter;
+  struct Group;
+  struct BulkValue;
   class Repeater;
   class Setter;
   class Remover;
   class ScopedVisitor;
-  /** An alias of list of cursors. */
-  //typedef std::list<Cursor*> CursorList;
-  typedef CursorListSafe CursorList;
-  /** An alias of list of transaction logs. */
-  typedef std::list<TranLog> TranLogList;
-  /** The number of slot tables. */
+  class ScopedTxStats;
+  /** The default number of slot tables. */
+  static const int32_t DEFSLOTNUM = 257;
   /** The default bucket number. */
   static const size_t DEFBNUM = 1048583LL;
   /** The mininum number of buckets to use mmap. */
   static const size_t ZMAPBNUM = 32768;
   /** The maximum size of each key. */
   static const uint32_t KSIZMAX = 0xfffff;
+  /** The flag of the key size field to mark a record accessed since it was last rotated. */
+  static const uint32_t KSIZREF = 0x100000;
+  /** The flag of the key size field to mark a record whose value is compressed. */
+  static const uint32_t KSIZCOMP = 0x200000;
+  /** The mask of the key size field to cache the folded hash value. */
+  static const uint32_t KSIZHASH = ~(KSIZMAX | KSIZREF | KSIZCOMP);
+  /** The maximum number of referenced records rotated per eviction in the CLOCK mode. */
+  static const uint32_t CLOCKSWEEP = 8;
+  /** The ratio of records to buckets of a slot to grow its bucket array in the adaptive mode. */
+  static const size_t ADAPTLOAD = 4;
+  /** The number of buckets or groups of a replaced index moved per update of the slot. */
+  static const size_t MIGRATESTEP = 4;
+  /** The size of a cache line. */
+  static const size_t CACHELINE = 64;
+  /** The number of records in a group of the tagged index. */
+  static const size_t GROUPWIDTH = 6;
+  /** The maximum number of groups probed for a record in the tagged index. */
+  static const size_t GROUPPROBE = 4;
+  /** The tag of an entry of the tagged index which has never been used. */
+  static const uint16_t TAGEMPTY = 0;
+  /** The tag of an entry of the tagged index whose record was removed. */
+  static const uint16_t TAGDELETED = 1;
+  /** The minimum tag of an entry of the tagged index referring to a record. */
+  static const uint16_t TAGMIN = 2;
+  /** The unit size of the size classes of records allocated from slabs. */
+  static const size_t SLABUNIT = 16;
+  /** The maximum size of records allocated from slabs. */
+  static const size_t SLABMAX = 512;
+  /** The number of the size classes of records allocated from slabs. */
+  static const size_t SLABCLASSNUM = SLABMAX / SLABUNIT;
+  /** The size of each slab. */
+  static const size_t SLABSIZ = 8192;
+  /** The size of the header of each slab. */
+  static const size_t SLABHEAD = 48;
+  /** The initial number of slabs in the directory of each slot. */
+  static const size_t SLABDIRNUM = 16;
+  /** The number of the shards of the record counters. */
+  static const size_t COUNTERNUM = 64;
   /** The size of the record buffer. */
   static const size_t RECBUFSIZ = 48;
   /** The size of the opaque buffer. */
   static const size_t OPAQUESIZ = 16;
-  /** The threshold of busy loop and sleep for locking. */
-  static const uint32_t LOCKBUSYLOOP = 8192;
-  /**  Max cursors allowed at any given time **/
-  static const uint32_t MAXCURS = 16; // ok
- public:
-
-  class CursorListSafe {
-
-  public:
-    CursorListSafe() {
-      for (size_t i = 0; i < MAXCURS; ++i){
-        curs_[i] = nullptr;
-      }
-    }
-
-    /* pre: never push back same thing more than once */
-    void push_back(Cursor *c) {
-      ++size_;
-      unsigned int i = 0;
-      for (; i < MAXCURS && curs_[i]; ++i) {}
-
-      if (i < MAXCURS) {
-        curs_[i] = c;
-      } else {
-        assert(false); // too many cursors at the same time.
-      }
-    }
-
-     /* pre: must exist exactly once */
-    void remove(Cursor *c) {
-      size_--;
-      unsigned int i =0;
-      for (; i < MAXCURS && curs_[i] != c; ++i){}
-
-      if (i < MAXCURS) {
-        curs_[i] = nullptr;
-      } else {
-        assert(false); // pre: cursor must exist.
-      }
-    }
-
-    typedef Cursor** iterator;
-    typedef Cursor * const * const_iterator;
-
-    iterator begin() {
-      return curs_;
-    }
-
-    iterator end() {
-      return curs_ + MAXCURS;
-    }
-
-    size_t empty() const {
-      return size_ == 0;
-    }
-
-    void checkRep() const {
-
-      std::unordered_set<Cursor *> checker;
-      for (size_t i = 0; i < sizeof(curs_); ++i) {
-        if (curs_[i] != 0) {
-          assert(checker.count(curs_[i]) == 0);
-          checker.emplace(curs_[i]);
-        }
-      }
-
-      assert(checker.size() == size_);
-    }
-
-  private:
-
-    Cursor * curs_[MAXCURS];
-    size_t size_ {0};
+  /** The number of optimistic attempts of a read before taking the slot lock. */
+  static const uint32_t SEQRETRY = 4;
+  /** The initial number of keys accessed in an atomic section of a batch. */
+  static const uint32_t BULKCHUNK = 16;
+  /** The maximum number of keys accessed in an atomic section of a batch. */
+  static const uint32_t BULKCHUNKMAX = 256;
+  /** The number of keys whose lookups are interleaved by CacheDB::get_multi. */
+  static const size_t MULTIBATCH = 16;
+  /** The initial size of the snapshot buffer of each worker of CacheDB::scan_parallel. */
+  static const size_t SNAPBUFSIZ = 65536;
+  /** The size of the key and value region of a hot-key entry, which fills four cache lines. */
+  static const size_t HOTBUFSIZ = 232;
+  /** The interval of the reads of each thread sampled to detect hot keys. */
+  static const uint32_t HOTSAMPLE = 16;
+  /** The number of sampled reads of a hot-key entry to replicate the record read last. */
+  static const uint32_t HOTTHRES = 4;
+  /**
+   * Kinds of operations in the statistics of atomic sections.
+   */
+  enum TxOp {
+    TXGET,                               ///< reading a record
+    TXSET,                               ///< storing a record
+    TXREMOVE,                            ///< removing a record
+    TXBULK,                              ///< accepting multiple records
+    TXCURSOR,                            ///< operating a cursor
+    TXHOT,                               ///< reading a replicated hot record
+    TXOPNUM                              ///< number of the kinds
   };
+ public:
 
   /**
    * Cursor to indicate a record.
@@ -161,14 +154,18 @@ class CacheDB : public BasicDB {
      * Constructor.
      * @param db the container database object.
      */
-    explicit Cursor(CacheDB* db) : db_(db), sidx_(-1), rec_(NULL) {
+    explicit Cursor(CacheDB* db) :
+        db_(db), sidx_(-1), rec_(NULL), prev_(NULL), next_(NULL), sprev_(NULL), snext_(NULL) {
       _assert_(db);
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_);
 #endif
       {
-      db_->curs_.push_back(this);
+      db_->link_cursor(this);
     }
       }
     /**
@@ -180,9 +177,13 @@ class CacheDB : public BasicDB {
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_);
 #endif
     {
-      db_->curs_.remove(this);
+      db_->place_cursor(this, -1, NULL);
+      db_->unlink_cursor(this);
     }
     }
     /**
@@ -193,12 +194,19 @@ class CacheDB : public BasicDB {
      * @return true on success, or false on failure.
      * @note The operation for each record is performed atomically and other threads accessing
      * the same record are blocked.  To avoid deadlock, any explicit database operation must not
-     * be performed in this function.
+     * be performed in this function.  If the values are compressed, the operation is performed
+     * in a section which excludes the others, see CacheDB::Cursor::accept_compressed.
      */
     bool accept(Visitor* visitor, bool writable = true, bool step = false) {
+    if (db_->comp_) return accept_compressed(visitor, writable, step);
+    ScopedTxStats txstats(db_, TXCURSOR);
+    ScopedArenaCommit acommit;
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_, txstats.stats());
 #endif
     {
       if (db_->omode_ == 0) {
@@ -209,7 +217,7 @@ class CacheDB : public BasicDB {
         db_->set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
         return false;
       }
-      if (sidx_ < 0 || !rec_) {
+      if (!settle()) {
         db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
         return false;
       }
@@ -217,31 +225,20 @@ class CacheDB : public BasicDB {
       char* dbuf = (char*)rec_ + sizeof(*rec_);
       const char* rvbuf = dbuf + rksiz;
       size_t rvsiz = rec_->vsiz;
-      char* zbuf = NULL;
-//      size_t zsiz = 0;
-      assert(!db_->comp_);
-//      if (db_->comp_) {
-//        zbuf = db_->comp_->decompress(rvbuf, rvsiz, &zsiz);
-//        if (zbuf) {
-//          rvbuf = zbuf;
-//          rvsiz = zsiz;
-//        }
-//      }
       size_t vsiz;
       const char* vbuf = visitor->visit_full(dbuf, rksiz, rvbuf, rvsiz, &vsiz);
-      delete[] zbuf;
       if (vbuf == Visitor::REMOVE) {
-        uint64_t hash = db_->hash_record(dbuf, rksiz) / SLOTNUM;
+        uint64_t hash = db_->hash_record(dbuf, rksiz) / db_->slotnum_;
         Slot* slot = db_->slots_ + sidx_;
         Repeater repeater(Visitor::REMOVE, 0);
-        db_->accept_impl(slot, hash, dbuf, rksiz, &repeater, db_->comp_, false);
+        db_->accept_impl(slot, hash, dbuf, rksiz, &repeater, false);
       } else if (vbuf == Visitor::NOP) {
         if (step) step_impl();
       } else {
-        uint64_t hash = db_->hash_record(dbuf, rksiz) / SLOTNUM;
+        uint64_t hash = db_->hash_record(dbuf, rksiz) / db_->slotnum_;
         Slot* slot = db_->slots_ + sidx_;
         Repeater repeater(vbuf, vsiz);
-        db_->accept_impl(slot, hash, dbuf, rksiz, &repeater, db_->comp_, false);
+        db_->accept_impl(slot, hash, dbuf, rksiz, &repeater, false);
         if (step) step_impl();
       }
       return true;
@@ -255,27 +252,20 @@ class CacheDB : public BasicDB {
      */
     bool jump() {
       _assert_(true);
+      ScopedTxStats txstats(db_, TXCURSOR);
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_, txstats.stats());
 #endif
     {
       if (db_->omode_ == 0) {
         db_->set_error(_KCCODELINE_, Error::INVALID, "not opened");
         return false;
       }
-      for (int32_t i = 0; i < SLOTNUM; i++) {
-        Slot* slot = db_->slots_ + i;
-        if (slot->first) {
-          sidx_ = i;
-          rec_ = slot->first;
-          return true;
-        }
-      }
-      db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
-      sidx_ = -1;
-      rec_ = NULL;
-      return false;
+      return seek(0);
     }
     assert(false);
     return false;
@@ -288,9 +278,13 @@ class CacheDB : public BasicDB {
      */
     bool jump(const char* kbuf, size_t ksiz) {
       _assert_(kbuf && ksiz <= MEMMAXSIZ);
+      ScopedTxStats txstats(db_, TXCURSOR);
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_, txstats.stats());
 #endif
     {
       if (db_->omode_ == 0) {
@@ -299,41 +293,16 @@ class CacheDB : public BasicDB {
       }
       if (ksiz > KSIZMAX) ksiz = KSIZMAX;
       uint64_t hash = db_->hash_record(kbuf, ksiz);
-      int32_t sidx = hash % SLOTNUM;
-      hash /= SLOTNUM;
+      int32_t sidx = hash % db_->slotnum_;
+      hash /= db_->slotnum_;
       Slot* slot = db_->slots_ + sidx;
-      size_t bidx = hash % slot->bnum;
-      Record* rec = slot->buckets[bidx];
-      Record** entp = slot->buckets + bidx;
-      uint32_t fhash = db_->fold_hash(hash) & ~KSIZMAX;
-      while (rec) {
-        uint32_t rhash = rec->ksiz & ~KSIZMAX;
-        uint32_t rksiz = rec->ksiz & KSIZMAX;
-        if (fhash > rhash) {
-          entp = &rec->left;
-          rec = rec->left;
-        } else if (fhash < rhash) {
-          entp = &rec->right;
-          rec = rec->right;
-        } else {
-          char* dbuf = (char*)rec + sizeof(*rec);
-          int32_t kcmp = db_->compare_keys(kbuf, ksiz, dbuf, rksiz);
-          if (kcmp < 0) {
-            entp = &rec->left;
-            rec = rec->left;
-          } else if (kcmp > 0) {
-            entp = &rec->right;
-            rec = rec->right;
-          } else {
-            sidx_ = sidx;
-            rec_ = rec;
-            return true;
-          }
-        }
+      Record* rec = *db_->search_record(slot, hash, kbuf, ksiz);
+      if (rec) {
+        db_->place_cursor(this, sidx, rec);
+        return true;
       }
       db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
-      sidx_ = -1;
-      rec_ = NULL;
+      db_->place_cursor(this, -1, NULL);
       return false;
     }
     assert(false);
@@ -356,6 +325,9 @@ class CacheDB : public BasicDB {
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_);
 #endif
     {
       if (db_->omode_ == 0) {
@@ -378,6 +350,9 @@ class CacheDB : public BasicDB {
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_);
 #endif
     {
       if (db_->omode_ == 0) {
@@ -400,6 +375,9 @@ class CacheDB : public BasicDB {
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_);
 #endif
     {
       if (db_->omode_ == 0) {
@@ -419,16 +397,20 @@ class CacheDB : public BasicDB {
      */
     bool step() {
       _assert_(true);
+      ScopedTxStats txstats(db_, TXCURSOR);
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_, txstats.stats());
 #endif
     {
       if (db_->omode_ == 0) {
         db_->set_error(_KCCODELINE_, Error::INVALID, "not opened");
         return false;
       }
-      if (sidx_ < 0 || !rec_) {
+      if (!settle()) {
         db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
         return false;
       }
@@ -449,6 +431,9 @@ class CacheDB : public BasicDB {
     __transaction_atomic
 #ifdef LOCKING
       ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_);
 #endif
     {
       if (db_->omode_ == 0) {
@@ -472,28 +457,142 @@ class CacheDB : public BasicDB {
     }
    private:
     /**
-     * Step the cursor to the next record.
+     * Accept a visitor to the current record in a database whose values are compressed.
+     * @param visitor a visitor object.
+     * @param writable true for writable operation, or false for read-only operation.
+     * @param step true to move the cursor to the next record, or false for no move.
      * @return true on success, or false on failure.
+     * @note The value is decompressed, given to the visitor and its new value is compressed
+     * and stored in one section which excludes the others, as in CacheDB::visit_locked.
      */
-    bool step_impl() {
-      _assert_(true);
-      rec_ = rec_->next;
-      if (!rec_) {
-        for (int32_t i = sidx_ + 1; i < SLOTNUM; i++) {
-          Slot* slot = db_->slots_ + i;
-          if (slot->first) {
-            sidx_ = i;
-            rec_ = slot->first;
-            return true;
+    bool accept_compressed(Visitor* visitor, bool writable, bool step) {
+      _assert_(visitor);
+      ScopedTxStats txstats(db_, TXCURSOR);
+      ScopedArenaCommit acommit;
+      bool err = false;
+      __transaction_relaxed
+#ifdef LOCKING
+      ScopedRWLock lock(&db_->mlock_, true);
+#endif
+#ifdef RTM
+      ScopedElision elision(&db_->elock_, txstats.stats(), false);
+#endif
+      {
+      if (!check(writable)) {
+        err = true;
+      } else {
+        const Record* rec = rec_;
+        size_t ksiz = rec->ksiz & KSIZMAX;
+        const char* dbuf = (const char*)rec + sizeof(*rec);
+        const char* rvbuf = dbuf + ksiz;
+        size_t vsiz = rec->vsiz;
+        char* zbuf = NULL;
+        size_t zsiz = 0;
+        if (rec->ksiz & KSIZCOMP) {
+          zbuf = db_->comp_->decompress(rvbuf, vsiz, &zsiz);
+          if (zbuf) {
+            rvbuf = zbuf;
+            vsiz = zsiz;
           }
         }
+        BulkValue bval = BulkValue();
+        bval.nbuf = visitor->visit_full(dbuf, ksiz, rvbuf, vsiz, &bval.nsiz);
+        db_->encode_value(&bval);
+        delete[] zbuf;
+        apply(bval.nbuf, bval.nsiz, bval.nzip, step);
+        delete[] bval.wbuf;
+      }
+      }
+      return !err;
+    }
+    /**
+     * Check whether the cursor can accept a visitor.
+     * @param writable true for writable operation, or false for read-only operation.
+     * @return true if it can, or false if not.
+     * @note This function must be called in an atomic section.  The cursor is settled on the
+     * current record.
+     */
+    bool check(bool writable) {
+      _assert_(true);
+      if (db_->omode_ == 0) {
+        db_->set_error(_KCCODELINE_, Error::INVALID, "not opened");
+        return false;
+      }
+      if (writable && !(db_->omode_ & OWRITER)) {
+        db_->set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+        return false;
+      }
+      if (!settle()) {
         db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
-        sidx_ = -1;
-        rec_ = NULL;
         return false;
       }
       return true;
     }
+    /**
+     * Store the new value of the current record given by a visitor.
+     * @param vbuf the pointer to the new value, or Visitor::NOP or Visitor::REMOVE.
+     * @param vsiz the size of the new value.
+     * @param zip true if the new value is compressed, or false if not.
+     * @param step true to move the cursor to the next record, or false for no move.
+     * @note This function must be called in an atomic section.
+     */
+    void apply(const char* vbuf, size_t vsiz, bool zip, bool step) {
+      _assert_(vbuf);
+      char* dbuf = (char*)rec_ + sizeof(*rec_);
+      size_t ksiz = rec_->ksiz & KSIZMAX;
+      uint64_t hash = db_->hash_record(dbuf, ksiz) / db_->slotnum_;
+      Slot* slot = db_->slots_ + sidx_;
+      if (vbuf == Visitor::REMOVE) {
+        Repeater repeater(Visitor::REMOVE, 0);
+        db_->accept_impl(slot, hash, dbuf, ksiz, &repeater, false);
+      } else if (vbuf == Visitor::NOP) {
+        if (step) step_impl();
+      } else {
+        Repeater repeater(vbuf, vsiz);
+        db_->accept_impl(slot, hash, dbuf, ksiz, &repeater, false, zip);
+        if (step) step_impl();
+      }
+    }
+    /**
+     * Step the cursor to the next record.
+     * @return true on success, or false on failure.
+     */
+    bool step_impl() {
+      _assert_(rec_);
+      rec_ = rec_->next;
+      if (!rec_) return seek(sidx_ + 1);
+      return true;
+    }
+    /**
+     * Move the cursor to the first record of the first slot which is not empty.
+     * @param sidx the index of the slot where the search starts.
+     * @return true on success, or false on failure.
+     */
+    bool seek(int32_t sidx) {
+      _assert_(sidx >= 0);
+      for (int32_t i = sidx; i < db_->slotnum_; i++) {
+        Slot* slot = db_->slots_ + i;
+        if (slot->first) {
+          db_->place_cursor(this, i, slot->first);
+          return true;
+        }
+      }
+      db_->set_error(_KCCODELINE_, Error::NOREC, "no record");
+      db_->place_cursor(this, -1, NULL);
+      return false;
+    }
+    /**
+     * Resolve the position of the cursor.
+     * @return true if the cursor is on a record, or false if not.
+     * @note A cursor escaped from the last record of its slot is left without a record, because
+     * the escaping thread only locks that slot, and it is moved to the next slot here.
+     */
+    bool settle() {
+      _assert_(true);
+      if (rec_) return true;
+      if (sidx_ < 0) return false;
+      return seek(sidx_ + 1);
+    }
     /** Dummy constructor to forbid the use. */
     Cursor(const Cursor&);
     /** Dummy Operator to forbid the use. */
@@ -504,6 +603,14 @@ class CacheDB : public BasicDB {
     int32_t sidx_;
     /** The current record. */
     Record* rec_;
+    /** The previous cursor of the database. */
+    Cursor* prev_;
+    /** The next cursor of the database. */
+    Cursor* next_;
+    /** The previous cursor in the current slot. */
+    Cursor* sprev_;
+    /** The next cursor in the current slot. */
+    Cursor* snext_;
   };
   /**
    * Tuning options.
@@ -511,7 +618,10 @@ class CacheDB : public BasicDB {
   enum Option {
     TSMALL = 1 << 0,                     ///< dummy for compatibility
     TLINEAR = 1 << 1,                    ///< dummy for compatibility
-    TCOMPRESS = 1 << 2                   ///< compress each record
+    TCOMPRESS = 1 << 2,                  ///< compress each record
+    TCLOCK = 1 << 3,                     ///< defer LRU rotation to eviction time
+    TADAPTIVE = 1 << 4,                  ///< grow the buckets of crowded slots online
+    TOPENADDR = 1 << 5                   ///< index records by open addressing with tags
   };
   /**
    * Status flags.
@@ -525,13 +635,15 @@ class CacheDB : public BasicDB {
    */
   explicit CacheDB() :
       mlock_(),
-#ifdef LOCKING
-      flock_(),
+#ifdef RTM
+      elock_(),
 #endif
       error_(), logger_(NULL), logkinds_(0), mtrigger_(NULL),
-      omode_(0), curs_(), path_(""), type_(TYPECACHE),
-      opts_(0), bnum_(DEFBNUM), capcnt_(-1), capsiz_(-1),
-      opaque_(), embcomp_(ZLIBRAWCOMP), comp_(NULL), slots_(), rttmode_(true), tran_(false) {
+      omode_(0), curs_(NULL), path_(""), type_(TYPECACHE),
+      opts_(0), slotnum_(DEFSLOTNUM), bnum_(DEFBNUM), capcnt_(-1), capsiz_(-1), hotnum_(0),
+      opaque_(), embcomp_(ZLIBRAWCOMP), comp_(NULL), slotbuf_(NULL), slots_(NULL),
+      counters_(NULL), txcounters_(NULL), hotbuf_(NULL), hots_(NULL), hotcnts_(NULL),
+      bchunk_(BULKCHUNK), slotstat_(false), rttmode_(true), tran_(false), trlock_(), scanpool_() {
     _assert_(true);
     assert(!this->error());
   }
@@ -542,17 +654,11 @@ class CacheDB : public BasicDB {
   virtual ~CacheDB() {
     _assert_(true);
     if (omode_ != 0) close();
-    if (!curs_.empty()) {
-      CursorList::const_iterator cit = curs_.begin();
-      CursorList::const_iterator citend = curs_.end();
-      while (cit != citend) {
-        Cursor* cur = *cit;
-        if (cur != nullptr) {
-          cur->db_ = NULL;
-        }
-
-        ++cit;
-      }
+    Cursor* cur = curs_;
+    while (cur) {
+      Cursor* next = cur->next_;
+      cur->db_ = NULL;
+      cur = next;
     }
   }
   /**
@@ -564,13 +670,43 @@ class CacheDB : public BasicDB {
    * @return true on success, or false on failure.
    * @note The operation for each record is performed atomically and other threads accessing the
    * same record are blocked.  To avoid deadlock, any explicit database operation must not be
-   * performed in this function.
+   * performed in this function.  In the seqlock build, a read-only operation is first tried
+   * without any lock by CacheDB::accept_optimistic, and the return value of the visitor is ignored
+   * then.  It is not tried if every hit rotates the LRU list, which is the case unless
+   * CacheDB::TCLOCK is set or rotation is disabled.  In the rtm build, the operation is run as a
+   * hardware transaction eliding the fallback lock, see CacheDB::tune_elision.  If the values are
+   * compressed, only a read-only operation is run as an atomic section, see
+   * CacheDB::accept_compressed.  A read-only operation on a hot record may only read its replica,
+   * see CacheDB::tune_hotkeys.
    */
   bool accept(const char* kbuf, size_t ksiz, Visitor* visitor, bool writable = true) {
     assert(kbuf && ksiz <= MEMMAXSIZ && visitor);
+    ScopedTxStats txstats(this, TXGET);
+    bool fill = false;
+    if (!writable && hots_ && !sample_hot(kbuf, ksiz, &fill) &&
+        accept_hot(kbuf, ksiz, visitor, txstats.stats())) {
+      txstats.set_op(TXHOT);
+      return true;
+    }
+#ifdef SEQLOCK
+    if (!writable && !fill && accept_optimistic(kbuf, ksiz, visitor, txstats.stats()))
+      return true;
+#endif
+    if (comp_) {
+      BulkKey bkey;
+      make_bulk_key(kbuf, ksiz, &bkey);
+      TxOp op = TXGET;
+      bool ok = accept_compressed(&bkey, 1, visitor, writable, txstats.stats(), &op);
+      txstats.set_op(op);
+      return ok;
+    }
+    ScopedArenaCommit acommit;
     __transaction_atomic
 #ifdef LOCKING
     ScopedRWLock lock(&mlock_, false);
+#endif
+#ifdef RTM
+    ScopedElision elision(&elock_, txstats.stats());
 #endif
     {
     if (omode_ == 0) {
@@ -587,15 +723,16 @@ class CacheDB : public BasicDB {
     }
 
     uint64_t hash = hash_record(kbuf, ksiz);
-    int32_t sidx = hash % SLOTNUM;
-    hash /= SLOTNUM;
+    int32_t sidx = hash % slotnum_;
+    hash /= slotnum_;
     Slot* slot = slots_ + sidx;
     //printf("thnum: %lu, sidx: %d\n", pthread_self(), sidx);
 
 #ifdef LOCKING
     slot->lock.lock();
 #endif
-    accept_impl(slot, hash, kbuf, ksiz, visitor, comp_, rttmode_);
+    txstats.set_op(accept_impl(slot, hash, kbuf, ksiz, visitor, rttmode_));
+    if (fill) fill_hot(slot, hash, kbuf, ksiz);
 #ifdef LOCKING
     slot->lock.unlock();
 #endif
@@ -610,78 +747,233 @@ class CacheDB : public BasicDB {
    * @return true on success, or false on failure.
    * @note The operations for specified records are performed atomically and other threads
    * accessing the same records are blocked.  To avoid deadlock, any explicit database operation
-   * must not be performed in this function.
+   * must not be performed in this function.  In the rtm build, a batch larger than the chunk
+   * size of CacheDB::accept_batch acquires the fallback lock without trying a transaction.  If
+   * the values are compressed, only a read-only operation is run as an atomic section, see
+   * CacheDB::accept_compressed.
    */
   bool accept_bulk(const std::vector<std::string>& keys, Visitor* visitor,
                    bool writable = true) {
     _assert_(visitor);
+    ScopedTxStats txstats(this, TXBULK);
+    ScopedArenaCommit acommit;
+    size_t knum = keys.size();
+    BulkKey* bkeys = knum > 0 ? make_bulk_keys(keys) : NULL;
+    if (comp_ && knum > 0) {
+      ScopedVisitor svis(visitor);
+      bool ok = accept_compressed(bkeys, knum, visitor, writable, txstats.stats(), NULL);
+      delete[] bkeys;
+      return ok;
+    }
+#ifdef LOCKING
+    int32_t* sidxs = NULL;
+    size_t snum = 0;
+    if (knum > 0) {
+      sidxs = new int32_t[knum];
+      for (size_t i = 0; i < knum; i++) {
+        sidxs[i] = bkeys[i].sidx;
+      }
+      std::sort(sidxs, sidxs + knum);
+      snum = std::unique(sidxs, sidxs + knum) - sidxs;
+    }
+#endif
+#ifdef RTM
+    bool elide = knum <= __atomic_load_n(&bchunk_, __ATOMIC_RELAXED);
+#endif
+    bool err = false;
     __transaction_atomic
 #ifdef LOCKING
     ScopedRWLock lock(&mlock_, false);
+#endif
+#ifdef RTM
+    ScopedElision elision(&elock_, txstats.stats(), elide);
 #endif
     {
     if (omode_ == 0) {
       set_error(_KCCODELINE_, Error::INVALID, "not opened");
-      return false;
-    }
-    if (writable && !(omode_ & OWRITER)) {
+      err = true;
+    } else if (writable && !(omode_ & OWRITER)) {
       set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
-      return false;
+      err = true;
+    } else {
+      ScopedVisitor svis(visitor);
+#ifdef LOCKING
+      for (size_t i = 0; i < snum; i++) {
+        slots_[sidxs[i]].lock.lock();
+      }
+#endif
+      for (size_t i = 0; i < knum; i++) {
+        BulkKey* bkey = bkeys + i;
+        accept_impl(slots_ + bkey->sidx, bkey->hash, bkey->kbuf, bkey->ksiz,
+                    visitor, rttmode_);
+      }
+#ifdef LOCKING
+      for (size_t i = 0; i < snum; i++) {
+        slots_[sidxs[i]].lock.unlock();
+      }
+#endif
     }
-    ScopedVisitor svis(visitor);
+    }
+#ifdef RTM
+    if (elide && !err) adapt_chunk(knum, *txstats.stats());
+#endif
+#ifdef LOCKING
+    delete[] sidxs;
+#endif
+    delete[] bkeys;
+    return !err;
+  }
+  /**
+   * Accept a visitor to multiple records, each of which is accessed atomically.
+   * @param keys specifies a string vector of the keys.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   * @note The keys are grouped by the slot tables and accessed in chunks, each of which is
+   * performed atomically.  In the rtm build, the chunk size is halved whenever a chunk overflows
+   * the transactional buffer and grows by one key whenever a full chunk commits, up to
+   * CacheDB::BULKCHUNKMAX.  To avoid deadlock, any explicit database operation must not be
+   * performed in this function.
+   */
+  bool accept_batch(const std::vector<std::string>& keys, Visitor* visitor,
+                    bool writable = true) {
+    _assert_(visitor);
+    ScopedTxStats txstats(this, TXBULK);
+    ScopedArenaCommit acommit;
     size_t knum = keys.size();
     if (knum < 1) return true;
-    struct RecordKey {
-      const char* kbuf;
-      size_t ksiz;
-      uint64_t hash;
-      int32_t sidx;
+    BulkKey* bkeys = make_bulk_keys(keys);
+    std::sort(bkeys, bkeys + knum, BulkKeyComparator());
+    ScopedVisitor svis(visitor);
+    bool err = false;
+    size_t kidx = 0;
+    while (kidx < knum) {
+      size_t num = __atomic_load_n(&bchunk_, __ATOMIC_RELAXED);
+      if (num > knum - kidx) num = knum - kidx;
+      TxStats cstats = TxStats();
+      if (comp_ ? !accept_compressed(bkeys + kidx, num, visitor, writable, &cstats, NULL) :
+          !accept_chunk(bkeys + kidx, num, visitor, writable, &cstats)) {
+        err = true;
+        break;
+      }
+#ifdef RTM
+      adapt_chunk(num, cstats);
+#endif
+      add_tx(txstats.stats(), cstats);
+      kidx += num;
+    }
+    delete[] bkeys;
+    return !err;
+  }
+  /**
+   * Retrieve the values of multiple records at once.
+   * @param kbufs the array of the pointers to the key regions.
+   * @param ksizs the array of the sizes of the key regions.
+   * @param num the number of the keys.
+   * @param obuf the pointer to the buffer into which the values are written one after another.
+   * @param osiz the size of the buffer.
+   * @param vsizs the array into which the size of the value of each key is written, or -1 if
+   * the corresponding record does not exist.
+   * @return the number of retrieved records, or -1 on failure.
+   * @note A value which does not fit in the rest of the buffer is truncated, so the buffer was
+   * too small if the sum of the sizes exceeds its size.  The keys are looked up in groups of
+   * CacheDB::MULTIBATCH and the index entries and the records of a group are prefetched before
+   * any of them is read, so that the cache misses overlap.  Each group is read atomically.  If
+   * the values are compressed, they are decompressed after the group is read.
+   */
+  int64_t get_multi(const char** kbufs, const size_t* ksizs, size_t num,
+                    char* obuf, size_t osiz, int64_t* vsizs) {
+    _assert_(kbufs && ksizs && obuf && vsizs);
+    class VisitorImpl : public Visitor {
+     public:
+      explicit VisitorImpl(char* obuf, size_t osiz, int64_t* vsizs) :
+          obuf_(obuf), osiz_(osiz), off_(0), vsizp_(vsizs), hits_(0) {}
+      int64_t hits() const {
+        return hits_;
+      }
+     private:
+      const char* visit_full(const char* kbuf, size_t ksiz,
+                             const char* vbuf, size_t vsiz, size_t* sp) {
+        size_t csiz = osiz_ - off_;
+        if (csiz > vsiz) csiz = vsiz;
+        std::memcpy(obuf_ + off_, vbuf, csiz);
+        off_ += csiz;
+        *(vsizp_++) = vsiz;
+        hits_++;
+        return NOP;
+      }
+      const char* visit_empty(const char* kbuf, size_t ksiz, size_t* sp) {
+        *(vsizp_++) = -1;
+        return NOP;
+      }
+      char* obuf_;
+      size_t osiz_;
+      size_t off_;
+      int64_t* vsizp_;
+      int64_t hits_;
     };
-    RecordKey* rkeys = new RecordKey[knum];
+    ScopedTxStats txstats(this, TXBULK);
+    ScopedArenaCommit acommit;
+    VisitorImpl visitor(obuf, osiz, vsizs);
+    BulkKey bkeys[MULTIBATCH];
+    size_t kidx = 0;
+    while (kidx < num) {
+      size_t bnum = num - kidx;
+      if (bnum > MULTIBATCH) bnum = MULTIBATCH;
+      for (size_t i = 0; i < bnum; i++) {
+        make_bulk_key(kbufs[kidx + i], ksizs[kidx + i], bkeys + i);
+        __builtin_prefetch(slots_ + bkeys[i].sidx);
+      }
+      if (comp_) {
+        if (!accept_compressed(bkeys, bnum, &visitor, false, txstats.stats(), NULL)) return -1;
+        kidx += bnum;
+        continue;
+      }
 #ifdef LOCKING
-    std::set<int32_t> sidxs;
+      int32_t sidxs[MULTIBATCH];
+      for (size_t i = 0; i < bnum; i++) {
+        sidxs[i] = bkeys[i].sidx;
+      }
+      std::sort(sidxs, sidxs + bnum);
+      size_t snum = std::unique(sidxs, sidxs + bnum) - sidxs;
 #endif
-    for (size_t i = 0; i < knum; i++) {
-      const std::string& key = keys[i];
-      RecordKey* rkey = rkeys + i;
-      rkey->kbuf = key.data();
-      rkey->ksiz = key.size();
-      if (rkey->ksiz > KSIZMAX) rkey->ksiz = KSIZMAX;
-      rkey->hash = hash_record(rkey->kbuf, rkey->ksiz);
-      rkey->sidx = rkey->hash % SLOTNUM;
+      __transaction_atomic
 #ifdef LOCKING
-      sidxs.insert(rkey->sidx);
+      ScopedRWLock lock(&mlock_, false);
 #endif
-      rkey->hash /= SLOTNUM;
-    }
+#ifdef RTM
+      ScopedElision elision(&elock_, txstats.stats());
+#endif
+      {
+      if (omode_ == 0) {
+        set_error(_KCCODELINE_, Error::INVALID, "not opened");
+        return -1;
+      }
 #ifdef LOCKING
-    std::set<int32_t>::iterator sit = sidxs.begin();
-    std::set<int32_t>::iterator sitend = sidxs.end();
-    while (sit != sitend) {
-      Slot* slot = slots_ + *sit;
-      slot->lock.lock();
-      ++sit;
-    }
+      for (size_t i = 0; i < snum; i++) {
+        slots_[sidxs[i]].lock.lock();
+      }
 #endif
-    for (size_t i = 0; i < knum; i++) {
-      RecordKey* rkey = rkeys + i;
-      Slot* slot = slots_ + rkey->sidx;
-      accept_impl(slot, rkey->hash, rkey->kbuf, rkey->ksiz, visitor, comp_, rttmode_);
-    }
+      for (size_t i = 0; i < bnum; i++) {
+        prefetch_entry(slots_ + bkeys[i].sidx, bkeys[i].hash);
+      }
+      for (size_t i = 0; i < bnum; i++) {
+        prefetch_record(slots_ + bkeys[i].sidx, bkeys[i].hash);
+      }
+      for (size_t i = 0; i < bnum; i++) {
+        BulkKey* bkey = bkeys + i;
+        accept_impl(slots_ + bkey->sidx, bkey->hash, bkey->kbuf, bkey->ksiz,
+                    &visitor, rttmode_);
+      }
 #ifdef LOCKING
-    sit = sidxs.begin();
-    sitend = sidxs.end();
-    while (sit != sitend) {
-      Slot* slot = slots_ + *sit;
-      slot->lock.unlock();
-      ++sit;
-    }
+      for (size_t i = 0; i < snum; i++) {
+        slots_[sidxs[i]].lock.unlock();
+      }
 #endif
-    delete[] rkeys;
-    return true;
-  }
-    assert(0);
-    return false;
+      }
+      kidx += bnum;
+    }
+    return visitor.hits();
   }
   /**
    * Iterate to accept a visitor for each record.
@@ -694,6 +986,7 @@ class CacheDB : public BasicDB {
    */
   bool iterate(Visitor *visitor, bool writable = true, ProgressChecker* checker = NULL) {
     _assert_(visitor);
+    ScopedArenaCommit acommit;
     ScopedRWLock lock(&mlock_, true);
     if (omode_ == 0) {
       set_error(_KCCODELINE_, Error::INVALID, "not opened");
@@ -710,7 +1003,7 @@ class CacheDB : public BasicDB {
       return false;
     }
     int64_t curcnt = 0;
-    for (int32_t i = 0; i < SLOTNUM; i++) {
+    for (int32_t i = 0; i < slotnum_; i++) {
       Slot* slot = slots_ + i;
       Record* rec = slot->first;
       while (rec) {
@@ -721,7 +1014,7 @@ class CacheDB : public BasicDB {
         size_t rvsiz = rec->vsiz;
         char* zbuf = NULL;
         size_t zsiz = 0;
-        if (comp_) {
+        if (rec->ksiz & KSIZCOMP) {
           zbuf = comp_->decompress(rvbuf, rvsiz, &zsiz);
           if (zbuf) {
             rvbuf = zbuf;
@@ -730,16 +1023,18 @@ class CacheDB : public BasicDB {
         }
         size_t vsiz;
         const char* vbuf = visitor->visit_full(dbuf, rksiz, rvbuf, rvsiz, &vsiz);
-        delete[] zbuf;
         if (vbuf == Visitor::REMOVE) {
-          uint64_t hash = hash_record(dbuf, rksiz) / SLOTNUM;
+          uint64_t hash = hash_record(dbuf, rksiz) / slotnum_;
           Repeater repeater(Visitor::REMOVE, 0);
-          accept_impl(slot, hash, dbuf, rksiz, &repeater, comp_, false);
+          accept_impl(slot, hash, dbuf, rksiz, &repeater, false);
         } else if (vbuf != Visitor::NOP) {
-          uint64_t hash = hash_record(dbuf, rksiz) / SLOTNUM;
-          Repeater repeater(vbuf, vsiz);
-          accept_impl(slot, hash, dbuf, rksiz, &repeater, comp_, false);
+          uint64_t hash = hash_record(dbuf, rksiz) / slotnum_;
+          char* nbuf = comp_ ? compress_value(vbuf, vsiz, &zsiz) : NULL;
+          Repeater repeater(nbuf ? nbuf : vbuf, nbuf ? zsiz : vsiz);
+          accept_impl(slot, hash, dbuf, rksiz, &repeater, false, nbuf != NULL);
+          delete[] nbuf;
         }
+        delete[] zbuf;
         rec = next;
         curcnt++;
         if (checker && !checker->check("iterate", "processing", curcnt, allcnt)) {
@@ -763,7 +1058,10 @@ class CacheDB : public BasicDB {
    * @return true on success, or false on failure.
    * @note This function is for reading records and not for updating ones.  The return value of
    * the visitor is just ignored.  To avoid deadlock, any explicit database operation must not
-   * be performed in this function.
+   * be performed in this function.  Each slot table is copied into a buffer of the worker
+   * atomically and visited from the copy, so the records of a slot are a snapshot while those
+   * of different slots may be from different moments, and writers are only blocked while their
+   * slot is copied.  The workers take the slots one by one from a shared index.
    */
   bool scan_parallel(Visitor *visitor, size_t thnum, ProgressChecker* checker = NULL) {
     _assert_(visitor && thnum <= MEMMAXSIZ);
@@ -774,7 +1072,7 @@ class CacheDB : public BasicDB {
     }
     if (thnum < 1) thnum = 1;
     thnum = std::pow(2.0, (int32_t)(std::log(thnum * std::sqrt(2.0)) / std::log(2.0)));
-    if (thnum > (size_t)SLOTNUM) thnum = SLOTNUM;
+    if (thnum > (size_t)slotnum_) thnum = slotnum_;
     ScopedVisitor svis(visitor);
     int64_t allcnt = count_impl();
     if (checker && !checker->check("scan_parallel", "beginning", -1, allcnt)) {
@@ -784,15 +1082,14 @@ class CacheDB : public BasicDB {
     class ThreadImpl : public Thread {
      public:
       explicit ThreadImpl() :
-          db_(NULL), visitor_(NULL), checker_(NULL), allcnt_(0), slots_(), error_() {}
-      void init(CacheDB* db, Visitor* visitor, ProgressChecker* checker, int64_t allcnt) {
+          db_(NULL), visitor_(NULL), checker_(NULL), allcnt_(0), sidxp_(NULL), error_() {}
+      void init(CacheDB* db, Visitor* visitor, ProgressChecker* checker, int64_t allcnt,
+                int32_t* sidxp) {
         db_ = db;
         visitor_ = visitor;
         checker_ = checker;
         allcnt_ = allcnt;
-      }
-      void add_slot(Slot* slot) {
-        slots_.push_back(slot);
+        sidxp_ = sidxp;
       }
       const Error& error() {
         return error_;
@@ -804,69 +1101,74 @@ class CacheDB : public BasicDB {
         ProgressChecker* checker = checker_;
         int64_t allcnt = allcnt_;
         Compressor* comp = db->comp_;
-        std::vector<Slot*>::iterator sit = slots_.begin();
-        std::vector<Slot*>::iterator sitend = slots_.end();
-        while (sit != sitend) {
-          Slot* slot = *sit;
-          Record* rec = slot->first;
-          while (rec) {
-            Record* next = rec->next;
-            uint32_t rksiz = rec->ksiz & KSIZMAX;
-            char* dbuf = (char*)rec + sizeof(*rec);
+        size_t scap = SNAPBUFSIZ;
+        char* sbuf = (char*)xmalloc(scap);
+        while (error_ == Error::SUCCESS) {
+          int32_t sidx = __atomic_fetch_add(sidxp_, 1, __ATOMIC_RELAXED);
+          if (sidx >= db->slotnum_) break;
+          Slot* slot = db->slots_ + sidx;
+          size_t ssiz;
+          while ((ssiz = db->snapshot_slot(slot, sbuf, scap)) > scap) {
+            scap = ssiz + ssiz / 4;
+            sbuf = (char*)xrealloc(sbuf, scap);
+          }
+          const char* rp = sbuf;
+          const char* ep = sbuf + ssiz;
+          while (rp < ep) {
+            uint32_t rksiz, rvsiz;
+            std::memcpy(&rksiz, rp, sizeof(rksiz));
+            std::memcpy(&rvsiz, rp + sizeof(rksiz), sizeof(rvsiz));
+            bool zip = rksiz & KSIZCOMP;
+            rksiz &= KSIZMAX;
+            const char* dbuf = rp + sizeof(rksiz) + sizeof(rvsiz);
             const char* rvbuf = dbuf + rksiz;
-            size_t rvsiz = rec->vsiz;
+            rp = rvbuf + rvsiz;
+            size_t vsiz = rvsiz;
             char* zbuf = NULL;
             size_t zsiz = 0;
-            if (comp) {
-              zbuf = comp->decompress(rvbuf, rvsiz, &zsiz);
+            if (zip) {
+              zbuf = comp->decompress(rvbuf, vsiz, &zsiz);
               if (zbuf) {
                 rvbuf = zbuf;
-                rvsiz = zsiz;
+                vsiz = zsiz;
               }
             }
-            size_t vsiz;
-            visitor->visit_full(dbuf, rksiz, rvbuf, rvsiz, &vsiz);
+            size_t sp;
+            visitor->visit_full(dbuf, rksiz, rvbuf, vsiz, &sp);
             delete[] zbuf;
-            rec = next;
+            arena_commit();
             if (checker && !checker->check("scan_parallel", "processing", -1, allcnt)) {
               db->set_error(_KCCODELINE_, Error::LOGIC, "checker failed");
               error_ = db->error();
               break;
             }
           }
-          ++sit;
         }
+        xfree(sbuf);
       }
       CacheDB* db_;
       Visitor* visitor_;
       ProgressChecker* checker_;
       int64_t allcnt_;
-      std::vector<Slot*> slots_;
+      int32_t* sidxp_;
       Error error_;
     };
     bool err = false;
-    bool orttmode = rttmode_;
-    rttmode_ = false;
+    int32_t sidx = 0;
     ThreadImpl* threads = new ThreadImpl[thnum];
-    for (int32_t i = 0; i < SLOTNUM; i++) {
-      ThreadImpl* thread = threads + (i % thnum);
-      thread->add_slot(slots_ + i);
-    }
     for (size_t i = 0; i < thnum; i++) {
       ThreadImpl* thread = threads + i;
-      thread->init(this, visitor, checker, allcnt);
-      thread->start();
+      thread->init(this, visitor, checker, allcnt, &sidx);
     }
+    scanpool_.run(threads, thnum);
     for (size_t i = 0; i < thnum; i++) {
       ThreadImpl* thread = threads + i;
-      thread->join();
       if (thread->error() != Error::SUCCESS) {
         *error_ = thread->error();
         err = true;
       }
     }
     delete[] threads;
-    rttmode_ = orttmode;
     if (err) return false;
     if (checker && !checker->check("scan_parallel", "ending", -1, allcnt)) {
       set_error(_KCCODELINE_, Error::LOGIC, "checker failed");
@@ -940,16 +1242,38 @@ class CacheDB : public BasicDB {
     report(_KCCODELINE_, Logger::DEBUG, "opening the database (path=%s)", path.c_str());
     omode_ = mode;
     path_.append(path);
-    size_t bnum = nearbyprime(bnum_ / SLOTNUM);
-    size_t capcnt = capcnt_ > 0 ? capcnt_ / SLOTNUM + 1 : (1ULL << (sizeof(capcnt) * 8 - 1));
-    size_t capsiz = capsiz_ > 0 ? capsiz_ / SLOTNUM + 1 : (1ULL << (sizeof(capsiz) * 8 - 1));
-    if (capsiz > sizeof(*this) / SLOTNUM) capsiz -= sizeof(*this) / SLOTNUM;
+    size_t bnum = nearbyprime(bnum_ / slotnum_);
+    size_t capcnt = capcnt_ > 0 ? capcnt_ / slotnum_ + 1 : (1ULL << (sizeof(capcnt) * 8 - 1));
+    size_t capsiz = capsiz_ > 0 ? capsiz_ / slotnum_ + 1 : (1ULL << (sizeof(capsiz) * 8 - 1));
+    if (capsiz > sizeof(*this) / slotnum_) capsiz -= sizeof(*this) / slotnum_;
+    if (capsiz > sizeof(Slot)) capsiz -= sizeof(Slot);
     if (capsiz > bnum * sizeof(Record*)) capsiz -= bnum * sizeof(Record*);
-    for (int32_t i = 0; i < SLOTNUM; i++) {
+    slotbuf_ = (char*)xmalloc(sizeof(Slot) * slotnum_ + sizeof(Counter) * COUNTERNUM +
+                              sizeof(TxCounter) * COUNTERNUM + CACHELINE);
+    slots_ = (Slot*)(slotbuf_ + CACHELINE - (size_t)slotbuf_ % CACHELINE);
+    counters_ = (Counter*)(slots_ + slotnum_);
+    txcounters_ = (TxCounter*)(counters_ + COUNTERNUM);
+    for (size_t i = 0; i < COUNTERNUM; i++) {
+      counters_[i].count = 0;
+      counters_[i].size = 0;
+      std::memset(txcounters_ + i, 0, sizeof(TxCounter));
+    }
+    slotstat_ = capcnt_ > 0 || capsiz_ > 0 || (opts_ & TADAPTIVE);
+    for (int32_t i = 0; i < slotnum_; i++) {
       initialize_slot(slots_ + i, bnum, capcnt, capsiz);
     }
     comp_ = (opts_ & TCOMPRESS) ? embcomp_ : NULL;
-    assert(!comp_);
+    if (hotnum_ > 0 && !comp_) {
+      size_t hnum = slotnum_ * hotnum_;
+      hotbuf_ = (char*)xmalloc(sizeof(HotEntry) * hnum + CACHELINE);
+      hots_ = (HotEntry*)(hotbuf_ + CACHELINE - (size_t)hotbuf_ % CACHELINE);
+      hotcnts_ = (uint32_t*)xmalloc(sizeof(*hotcnts_) * hnum);
+      for (size_t i = 0; i < hnum; i++) {
+        hots_[i].seq = 0;
+        hots_[i].ksiz = UINT32MAX;
+        hotcnts_[i] = 0;
+      }
+    }
     std::memset(opaque_, 0, sizeof(opaque_));
     trigger_meta(MetaTrigger::OPEN, "open");
     return true;
@@ -960,16 +1284,30 @@ class CacheDB : public BasicDB {
    */
   bool close() {
     _assert_(true);
+    ScopedArenaCommit acommit;
     ScopedRWLock lock(&mlock_, true);
     if (omode_ == 0) {
       set_error(_KCCODELINE_, Error::INVALID, "not opened");
       return false;
     }
     report(_KCCODELINE_, Logger::DEBUG, "closing the database (path=%s)", path_.c_str());
+    if (tran_) trlock_.unlock();
     tran_ = false;
-    for (int32_t i = SLOTNUM - 1; i >= 0; i--) {
+    disable_cursors();
+    scanpool_.stop();
+    for (int32_t i = slotnum_ - 1; i >= 0; i--) {
       destroy_slot(slots_ + i);
     }
+    xfree(slotbuf_);
+    slotbuf_ = NULL;
+    slots_ = NULL;
+    counters_ = NULL;
+    txcounters_ = NULL;
+    xfree(hotbuf_);
+    xfree(hotcnts_);
+    hotbuf_ = NULL;
+    hots_ = NULL;
+    hotcnts_ = NULL;
     path_.clear();
     omode_ = 0;
     trigger_meta(MetaTrigger::CLOSE, "close");
@@ -1041,29 +1379,21 @@ class CacheDB : public BasicDB {
    */
   bool begin_transaction(bool hard = false) {
     _assert_(true);
-    uint32_t wcnt = 0;
-    while (true) {
-      mlock_.lock_writer();
-      if (omode_ == 0) {
-        set_error(_KCCODELINE_, Error::INVALID, "not opened");
-        mlock_.unlock();
-        return false;
-      }
-      if (!(omode_ & OWRITER)) {
-        set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
-        mlock_.unlock();
-        return false;
-      }
-      if (!tran_) break;
+    trlock_.lock();
+    mlock_.lock_writer();
+    if (omode_ == 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
       mlock_.unlock();
-      if (wcnt >= LOCKBUSYLOOP) {
-        Thread::chill();
-      } else {
-        Thread::yield();
-        wcnt++;
-      }
+      trlock_.unlock();
+      return false;
+    }
+    if (!(omode_ & OWRITER)) {
+      set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+      mlock_.unlock();
+      trlock_.unlock();
+      return false;
     }
-    tran_ = true;
+    set_transaction(true);
     trigger_meta(MetaTrigger::BEGINTRAN, "begin_transaction");
     mlock_.unlock();
     return true;
@@ -1087,12 +1417,12 @@ class CacheDB : public BasicDB {
       mlock_.unlock();
       return false;
     }
-    if (tran_) {
+    if (!trlock_.lock_try()) {
       set_error(_KCCODELINE_, Error::LOGIC, "competition avoided");
       mlock_.unlock();
       return false;
     }
-    tran_ = true;
+    set_transaction(true);
     trigger_meta(MetaTrigger::BEGINTRAN, "begin_transaction_try");
     mlock_.unlock();
     return true;
@@ -1104,6 +1434,7 @@ class CacheDB : public BasicDB {
    */
   bool end_transaction(bool commit = true) {
     _assert_(true);
+    ScopedArenaCommit acommit;
     ScopedRWLock lock(&mlock_, true);
     if (omode_ == 0) {
       set_error(_KCCODELINE_, Error::INVALID, "not opened");
@@ -1114,12 +1445,11 @@ class CacheDB : public BasicDB {
       return false;
     }
     if (!commit) disable_cursors();
-    for (int32_t i = 0; i < SLOTNUM; i++) {
-      if (!commit) apply_slot_trlogs(slots_ + i);
-      slots_[i].trlogs.clear();
-      adjust_slot_capacity(slots_ + i);
+    for (int32_t i = 0; i < slotnum_; i++) {
+      end_slot_transaction(slots_ + i, commit);
     }
-    tran_ = false;
+    set_transaction(false);
+    trlock_.unlock();
     trigger_meta(commit ? MetaTrigger::COMMITTRAN : MetaTrigger::ABORTTRAN, "end_transaction");
     return true;
   }
@@ -1129,15 +1459,18 @@ class CacheDB : public BasicDB {
    */
   bool clear() {
     _assert_(true);
+    ScopedArenaCommit acommit;
     ScopedRWLock lock(&mlock_, true);
     if (omode_ == 0) {
       set_error(_KCCODELINE_, Error::INVALID, "not opened");
       return false;
     }
     disable_cursors();
-    for (int32_t i = 0; i < SLOTNUM; i++) {
+    for (int32_t i = 0; i < slotnum_; i++) {
       Slot* slot = slots_ + i;
+      begin_slot_update(slot);
       clear_slot(slot);
+      end_slot_update(slot);
     }
     std::memset(opaque_, 0, sizeof(opaque_));
     trigger_meta(MetaTrigger::CLEAR, "clear");
@@ -1178,6 +1511,35 @@ class CacheDB : public BasicDB {
 //    }
     return size_impl();
   }
+  /**
+   * Get the exact number of records.
+   * @return the number of records, or -1 on failure.
+   * @note CacheDB::count merges the per-thread counters without stopping updates and may be
+   * off while other threads are updating.  This method merges them atomically instead.
+   */
+  int64_t count_exact() {
+    _assert_(true);
+    ScopedRWLock lock(&mlock_, true);
+    if (omode_ == 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return -1;
+    }
+    return count_impl(true);
+  }
+  /**
+   * Get the exact size of the database.
+   * @return the size of the database in bytes, or -1 on failure.
+   * @note See CacheDB::count_exact.
+   */
+  int64_t size_exact() {
+    _assert_(true);
+    ScopedRWLock lock(&mlock_, true);
+    if (omode_ == 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return -1;
+    }
+    return size_impl(true);
+  }
   /**
    * Get the path of the database file.
    * @return the path of the database file, or an empty string on failure.
@@ -1211,6 +1573,7 @@ class CacheDB : public BasicDB {
     (*strmap)["fmtver"] = strprintf("%u", FMTVER);
     (*strmap)["chksum"] = strprintf("%u", 0xff);
     (*strmap)["opts"] = strprintf("%u", opts_);
+    (*strmap)["slotnum"] = strprintf("%d", (int)slotnum_);
     (*strmap)["bnum"] = strprintf("%lld", (long long)bnum_);
     (*strmap)["capcnt"] = strprintf("%lld", (long long)capcnt_);
     (*strmap)["capsiz"] = strprintf("%lld", (long long)capsiz_);
@@ -1218,38 +1581,66 @@ class CacheDB : public BasicDB {
     (*strmap)["reorganized"] = strprintf("%d", false);
     if (strmap->count("opaque") > 0)
       (*strmap)["opaque"] = std::string(opaque_, sizeof(opaque_));
-    if (strmap->count("bnum_used") > 0) {
-      int64_t cnt = 0;
-      for (int32_t i = 0; i < SLOTNUM; i++) {
-        Slot* slot = slots_ + i;
-        Record** buckets = slot->buckets;
-        size_t bnum = slot->bnum;
-        for (size_t j = 0; j < bnum; j++) {
-          if (buckets[j]) cnt++;
-        }
-      }
-      (*strmap)["bnum_used"] = strprintf("%lld", (long long)cnt);
-    }
+    if (strmap->count("bnum_used") > 0)
+      (*strmap)["bnum_used"] = strprintf("%lld", (long long)bnum_used());
     (*strmap)["count"] = strprintf("%lld", (long long)count_impl());
     (*strmap)["size"] = strprintf("%lld", (long long)size_impl());
+#ifdef RTM
+    (*strmap)["rtm_supported"] = strprintf("%d", ElidedLock::supported());
+#endif
+    TxStats total = TxStats();
+    for (int32_t i = 0; i < TXOPNUM; i++) {
+      TxStats stats;
+      merge_tx(i, &stats);
+      std::string prefix = std::string("tx_") + tx_name(i) + "_";
+      status_tx(strmap, prefix, stats);
+      add_tx(&total, stats);
+    }
+    status_tx(strmap, "tx_", total);
+    (*strmap)["bulk_chunk"] = strprintf("%u", (unsigned)__atomic_load_n(&bchunk_,
+                                                                     __ATOMIC_RELAXED));
+    trlock_.status(strmap, "trlock_");
     return true;
   }
 
   int64_t bnum_used() const { // not safe
     int64_t cnt = 0;
-    for (int32_t i = 0; i < SLOTNUM; i++) {
+    for (int32_t i = 0; i < slotnum_; i++) {
       const Slot* slot = slots_ + i;
       Record** buckets = slot->buckets;
       size_t bnum = slot->bnum;
       for (size_t j = 0; j < bnum; j++) {
         if (buckets[j]) cnt++;
       }
+      for (size_t j = 0; j < slot->obnum; j++) {
+        if (slot->obuckets[j]) cnt++;
+      }
+      const Group* groups = slot->groups;
+      size_t gnum = slot->gnum;
+      for (size_t j = 0; j < gnum; j++) {
+        for (size_t k = 0; k < GROUPWIDTH; k++) {
+          if (groups[j].tags[k] >= TAGMIN) cnt++;
+        }
+      }
+      for (size_t j = 0; j < slot->ognum; j++) {
+        for (size_t k = 0; k < GROUPWIDTH; k++) {
+          if (slot->ogroups[j].tags[k] >= TAGMIN) cnt++;
+        }
+      }
     }
     return cnt;
   }
 
   int64_t bnum_total() const { // not safe
-    return slots_[0].bnum * SLOTNUM;
+    int64_t cnt = 0;
+    for (int32_t i = 0; i < slotnum_; i++) {
+      cnt += slots_[i].bnum + slots_[i].obnum + (slots_[i].gnum + slots_[i].ognum) * GROUPWIDTH;
+    }
+    return cnt;
+  }
+
+  int32_t slotnum() const {
+    return slotnum_;
   }
 
   /**
@@ -1313,7 +1704,11 @@ class CacheDB : public BasicDB {
   }
   /**
    * Set the optional features.
-   * @param opts the optional features by bitwise-or: DirDB::TCOMPRESS to compress each record.
+   * @param opts the optional features by bitwise-or: DirDB::TCOMPRESS to compress each record,
+   * CacheDB::TCLOCK to only mark accessed records and rotate them lazily when evicting,
+   * CacheDB::TADAPTIVE to double the buckets of a slot whose records outnumber them too much,
+   * CacheDB::TOPENADDR to index records by open addressing with 16-bit tags instead of bucket
+   * trees, so that a lookup mostly touches one cache line.
    * @return true on success, or false on failure.
    */
   bool tune_options(int8_t opts) {
@@ -1341,6 +1736,65 @@ class CacheDB : public BasicDB {
     bnum_ = bnum >= 0 ? bnum : DEFBNUM;
     return true;
   }
+  /**
+   * Set the number of slot tables.
+   * @param snum the number of slot tables.  If it is not more than 0, the default setting is
+   * specified.  It is rounded to a nearby prime number.
+   * @return true on success, or false on failure.
+   * @note Each slot table has its own lock and LRU list, so more slots lower contention among
+   * threads at the cost of a less precise eviction order.
+   */
+  bool tune_slots(int64_t snum) {
+    _assert_(true);
+    ScopedRWLock lock(&mlock_, true);
+    if (omode_ != 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "already opened");
+      return false;
+    }
+    slotnum_ = snum > 0 ? nearbyprime(snum) : DEFSLOTNUM;
+    return true;
+  }
+  /**
+   * Set the number of hot-key entries of each slot table.
+   * @param num the number of the entries.  If it is not more than 0, hot keys are not detected.
+   * @return true on success, or false on failure.
+   * @note Every HOTSAMPLE-th read of each thread by CacheDB::accept is sampled, and the record
+   * read by every HOTTHRES-th sampled read of an entry is replicated into it if the key and the
+   * value fit in HOTBUFSIZ bytes.  The other reads of a replicated record only read its entry,
+   * so they neither rotate the record in the LRU list nor touch the slot, and the return value
+   * of the visitor is ignored then.  An entry is invalidated by any update of its record.  Hot
+   * keys are not detected if the values are compressed.
+   */
+  bool tune_hotkeys(int64_t num) {
+    _assert_(true);
+    ScopedRWLock lock(&mlock_, true);
+    if (omode_ != 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "already opened");
+      return false;
+    }
+    hotnum_ = num > 0 ? num : 0;
+    return true;
+  }
+  /**
+   * Set the number of attempts of a hardware transaction before taking the fallback lock.
+   * @param retry the number of attempts.  If it is not more than 0, the fallback lock is always
+   * taken.
+   * @return true on success, or false on failure.
+   * @note This is only effective in the rtm build.  The outcomes of the transactions are
+   * reported by CacheDB::status with the keys prefixed by "tx_".
+   */
+  bool tune_elision(int32_t retry) {
+    _assert_(true);
+    ScopedRWLock lock(&mlock_, true);
+    if (omode_ != 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "already opened");
+      return false;
+    }
+#ifdef RTM
+    elock_.set_retry(retry);
+#endif
+    return true;
+  }
   /**
    * Set the data compressor.
    * @param comp the data compressor object.
@@ -1375,6 +1829,9 @@ class CacheDB : public BasicDB {
    * Set the capacity by memory usage.
    * @param size the maximum size of memory usage.
    * @return true on success, or false on failure.
+   * @note The records are counted by their sizes.  Small records are allocated from slabs,
+   * which are released when they become empty, so the free blocks of the partly used slabs and
+   * one empty slab per slot table are kept in addition.
    */
   bool cap_size(int64_t size) {
     _assert_(true);
@@ -1726,38 +2183,66 @@ class CacheDB : public BasicDB {
   };
   /**
    * Transaction log.
+   * @note A log is allocated by the arena allocator in one region followed by the old key and
+   * the old value, and the logs of a slot are chained from the newest one.
    */
   struct TranLog {
+    TranLog* prev;                       ///< previous log of the slot
+    size_t ksiz;                         ///< size of the old key
+    size_t vsiz;                         ///< size of the old value
     bool full;                           ///< flag whether full
-    std::string key;                     ///< old key
-    std::string value;                   ///< old value
-    /** constructor for a full record */
-    explicit TranLog(const char* kbuf, size_t ksiz, const char* vbuf, size_t vsiz) :
-        full(true), key(kbuf, ksiz), value(vbuf, vsiz) {
-      _assert_(true);
-    }
-    /** constructor for an empty record */
-    explicit TranLog(const char* kbuf, size_t ksiz) : full(false), key(kbuf, ksiz) {
-      _assert_(true);
-    }
+    bool zip;                            ///< flag whether the old value is compressed
+  };
+  /**
+   * Header of a slab.
+   * @note A slab is divided into the blocks of one size class.  The blocks follow the header.
+   */
+  struct Slab {
+    Slab* prev;                          ///< previous slab with room in the same class
+    Slab* next;                          ///< next slab with room in the same class
+    char* frees;                         ///< free blocks
+    uint32_t cls;                        ///< size class
+    uint32_t live;                       ///< number of allocated blocks
+    uint32_t used;                       ///< size of the region carved out including the header
   };
   /**
    * Slot table.
+   * @note The fields only read by ordinary operations and the fields written by every update
+   * are kept on separate cache lines, and each slot starts on its own line, so that an update
+   * of one slot does not conflict with readers of its buckets or with the neighboring slots.
    */
-  struct Slot {
-#ifdef LOCKING
-    Mutex lock;                       ///< lock
+  struct alignas(CACHELINE) Slot {
+#if defined(LOCKING) && defined(QUEUELOCK)
+    QueueMutex lock;                     ///< lock
+#elif defined(LOCKING)
+    Mutex lock;                          ///< lock
+#endif
+#ifdef SEQLOCK
+    uint32_t seq;                        ///< version, odd while the slot is being updated
 #endif
-    Record** buckets;                    ///< bucket array
+    Record** buckets;                    ///< bucket array, or NULL for the tagged index
     size_t bnum;                         ///< number of buckets
+    Record** obuckets;                   ///< replaced bucket array being moved, or NULL
+    size_t obnum;                        ///< number of the replaced buckets
+    Group* groups;                       ///< groups of the tagged index, or NULL
+    size_t gnum;                         ///< number of groups
+    Group* ogroups;                      ///< replaced groups being moved, or NULL
+    size_t ognum;                        ///< number of the replaced groups
     size_t capcnt;                       ///< cap of record number
     size_t capsiz;                       ///< cap of memory usage
-    Record* first;                       ///< first record
+    bool bmap;                           ///< whether the bucket array is mapped
+    Cursor* curs;                        ///< first of the cursors positioned in the slot
+    alignas(CACHELINE) Record* first;    ///< first record
     Record* last;                        ///< last record
-    size_t count;                        ///< number of records
-    size_t size;                         ///< total size of records
-    TranLogList trlogs;                  ///< transaction logs
-    size_t trsize;                       ///< size before transaction
+    size_t count;                        ///< number of records, if slotstat_
+    size_t size;                         ///< total size of records, if slotstat_
+    size_t mcur;                         ///< index of the next replaced bucket or group to move
+    Slab* partials[SLABCLASSNUM];        ///< slabs with room of each size class
+    Slab** slabs;                        ///< directory of the slabs sorted by address
+    size_t slabnum;                      ///< number of the slabs in the directory
+    size_t slabcap;                      ///< capacity of the directory
+    Slab* spare;                         ///< empty slab kept for the next class, or NULL
+    TranLog* trlogs;                     ///< newest transaction log
 
     void repcheck() const {
 //      bool fnull = (first == NULL);
@@ -1793,6 +2278,109 @@ class CacheDB : public BasicDB {
 //      assert (cnt == count);
     }
   };
+  /**
+   * Shard of the record counters.
+   */
+  struct alignas(CACHELINE) Counter {
+    int64_t count;                       ///< number of records
+    int64_t size;                        ///< total size of records
+  };
+  /**
+   * Shard of the statistics of atomic sections.
+   */
+  struct alignas(CACHELINE) TxCounter {
+    TxStats ops[TXOPNUM];                ///< statistics of each kind of operations
+  };
+  /**
+   * Entry of the replicas of hot records.
+   * @note An entry fills four cache lines, and it is only written when a record is replicated or
+   * invalidated, so that the readers of a hot record share its cache lines with no writer.
+   */
+  struct alignas(CACHELINE) HotEntry {
+    uint32_t seq;                        ///< version, odd while the entry is being written
+    uint32_t ksiz;                       ///< size of the key, or more than HOTBUFSIZ if empty
+    uint32_t vsiz;                       ///< size of the value
+    uint64_t hash;                       ///< hash value of the key in the slot
+    char buf[HOTBUFSIZ];                 ///< key and value
+  };
+  /**
+   * Key of a bulk operation.
+   */
+  struct BulkKey {
+    const char* kbuf;                    ///< pointer to the key
+    size_t ksiz;                         ///< size of the key
+    uint64_t hash;                       ///< hash value in the slot table
+    int32_t sidx;                        ///< index of the slot table
+  };
+  /**
+   * Comparator of keys of a bulk operation to group them by the slot tables.
+   */
+  struct BulkKeyComparator {
+    /** comparing operator */
+    bool operator ()(const BulkKey& a, const BulkKey& b) const {
+      return a.sidx < b.sidx;
+    }
+  };
+  /**
+   * Value of a bulk operation on compressed records.
+   */
+  struct BulkValue {
+    const char* obuf;                    ///< copy of the stored value, or NULL if absent
+    size_t osiz;                         ///< size of the copy of the stored value
+    bool ozip;                           ///< whether the stored value is compressed
+    const char* nbuf;                    ///< new value given by the visitor, or a marker
+    size_t nsiz;                         ///< size of the new value
+    bool nzip;                           ///< whether the new value is compressed
+    char* wbuf;                          ///< region of the new value to be released
+  };
+  /**
+   * Bulk operation on compressed records.
+   */
+  struct CompBatch {
+    /** constructor */
+    explicit CompBatch(const BulkKey* bkeys, size_t knum, TxStats* stats) :
+        bkeys(bkeys), knum(knum), bvals(new BulkValue[knum]()), sidxs(NULL), snum(0),
+        elide(true), stats(stats) {
+      _assert_(bkeys && knum > 0 && stats);
+#ifdef LOCKING
+      sidxs = new int32_t[knum];
+      for (size_t i = 0; i < knum; i++) {
+        sidxs[i] = bkeys[i].sidx;
+      }
+      std::sort(sidxs, sidxs + knum);
+      snum = std::unique(sidxs, sidxs + knum) - sidxs;
+#endif
+    }
+    /** destructor */
+    ~CompBatch() {
+      _assert_(true);
+      for (size_t i = 0; i < knum; i++) {
+        delete[] bvals[i].wbuf;
+      }
+      delete[] sidxs;
+      delete[] bvals;
+    }
+    const BulkKey* bkeys;                ///< keys
+    size_t knum;                         ///< number of the keys
+    BulkValue* bvals;                    ///< values of the keys
+    int32_t* sidxs;                      ///< sorted indices of the slots to be locked
+    size_t snum;                         ///< number of the slots to be locked
+    bool elide;                          ///< whether to elide the lock in the rtm build
+    TxStats* stats;                      ///< statistics of the sections
+   private:
+    /** Dummy constructor to forbid the use. */
+    CompBatch(const CompBatch&);
+    /** Dummy Operator to forbid the use. */
+    CompBatch& operator =(const CompBatch&);
+  };
+  /**
+   * Group of the tagged index, filling one cache line.
+   * @note In each group, the entries after the first empty one are also empty.
+   */
+  struct alignas(CACHELINE) Group {
+    uint16_t tags[GROUPWIDTH];           ///< tags of the hash values
+    Record* recs[GROUPWIDTH];            ///< records
+  };
 
 
   /**
@@ -1867,6 +2455,34 @@ class CacheDB : public BasicDB {
    private:
     Visitor* visitor_;                   ///< visitor
   };
+  /**
+   * Scoped recorder of the statistics of an atomic section.
+   * @note It must be declared before the section so that it is recorded after the section ends.
+   */
+  class ScopedTxStats {
+   public:
+    /** constructor */
+    explicit ScopedTxStats(CacheDB* db, TxOp op) : db_(db), op_(op), stats_() {
+      _assert_(db);
+    }
+    /** destructor */
+    ~ScopedTxStats() {
+      _assert_(true);
+      db_->record_tx(op_, &stats_);
+    }
+    /** get the statistics of the section */
+    TxStats* stats() {
+      return &stats_;
+    }
+    /** set the kind of the operation */
+    void set_op(TxOp op) {
+      op_ = op;
+    }
+   private:
+    CacheDB* db_;                        ///< database
+    TxOp op_;                            ///< kind of the operation
+    TxStats stats_;                      ///< statistics of the section
+  };
   /**
    * Accept a visitor to a record.
    * @param slot the slot of the record.
@@ -1874,295 +2490,1907 @@ class CacheDB : public BasicDB {
    * @param kbuf the pointer to the key region.
    * @param ksiz the size of the key region.
    * @param visitor a visitor object.
-   * @param comp the data compressor.
    * @param rtt whether to move the record to the last.
+   * @param zip true if the value returned by the visitor is compressed, or false if not.
+   * @return the kind of the operation which has been performed.
+   * @note The visitor is given the value as it is stored, even if it is compressed.
    */
-  void __attribute__((transaction_safe))
+  TxOp __attribute__((transaction_safe))
   accept_impl(
       Slot* slot,
       uint64_t hash,
       const char* kbuf,
       size_t ksiz,
       Visitor* visitor,
-      Compressor* comp,
-      bool rtt)
+      bool rtt,
+      bool zip = false)
   {
     _assert_(slot && kbuf && ksiz <= MEMMAXSIZ && visitor);
-    size_t bidx = hash % slot->bnum;
     slot->repcheck();
-    Record* rec = slot->buckets[bidx];
-    Record** entp = slot->buckets + bidx;
-    assert(*entp == rec);
-    uint32_t fhash = fold_hash(hash) & ~KSIZMAX;
-    while (rec) {
-      uint32_t rhash = rec->ksiz & ~KSIZMAX;
+    uint32_t fhash = fold_hash(hash) & KSIZHASH;
+    Record** entp = search_record(slot, hash, kbuf, ksiz);
+    Record* rec = *entp;
+    if (rec) {
       uint32_t rksiz = rec->ksiz & KSIZMAX;
-      if (fhash > rhash) {
-        entp = &rec->left;
-        rec = rec->left;
-      } else if (fhash < rhash) {
-        entp = &rec->right;
-        rec = rec->right;
+      char* dbuf = (char*)rec + sizeof(*rec);
+      const char* rvbuf = dbuf + rksiz;
+      size_t rvsiz = rec->vsiz;
+      size_t vsiz = 0;
+      const char* vbuf = visitor->visit_full(dbuf, rksiz, rvbuf, rvsiz, &vsiz);
+      slot->repcheck();
+      bool mark = rtt && slot->last != rec && (!(opts_ & TCLOCK) || !(rec->ksiz & KSIZREF));
+      bool upd = vbuf != Visitor::NOP || mark;
+      if (upd) begin_slot_update(slot);
+      if (vbuf != Visitor::NOP && hots_) drop_hot(slot, hash);
+      if (vbuf == Visitor::REMOVE) {
+        if (tran_) log_record(slot, dbuf, rksiz, rvbuf, rvsiz, rec->ksiz & KSIZCOMP);
+        remove_record(slot, rec, entp);
       } else {
-        char* dbuf = (char*)rec + sizeof(*rec);
-        int32_t kcmp = compare_keys(kbuf, ksiz, dbuf, rksiz);
-        if (kcmp < 0) {
-          entp = &rec->left;
-          rec = rec->left;
-        } else if (kcmp > 0) {
-          entp = &rec->right;
-          rec = rec->right;
-        } else {
-          const char* rvbuf = dbuf + rksiz;
-          size_t rvsiz = rec->vsiz;
-          char* zbuf = NULL;
-          assert(!comp);
-//          size_t zsiz = 0;
-//          if (comp) {
-//            zbuf = comp->decompress(rvbuf, rvsiz, &zsiz);
-//            if (zbuf) {
-//              rvbuf = zbuf;
-//              rvsiz = zsiz;
-//            }
-//          }
-          size_t vsiz = 0;
-          const char* vbuf = visitor->visit_full(dbuf, rksiz, rvbuf, rvsiz, &vsiz);
-          delete[] zbuf;
-          slot->repcheck();
-          if (vbuf == Visitor::REMOVE) {
-            if (tran_) {
-              assert(false);
-//              TranLog log(kbuf, ksiz, dbuf + rksiz, rec->vsiz);
-//              slot->trlogs.push_back(log);
-            }
-            if (!curs_.empty()) escape_cursors(rec);
-            slot->repcheck();
-            if (rec == slot->first) slot->first = rec->next;
-            if (rec == slot->last) slot->last = rec->prev;
-            if (rec->prev) rec->prev->next = rec->next;
-            if (rec->next) rec->next->prev = rec->prev;
-            if (rec->left && !rec->right) {
-              *entp = rec->left;
-            } else if (!rec->left && rec->right) {
-              *entp = rec->right;
-            } else if (!rec->left) {
-              *entp = NULL;
-            } else {
-              Record* pivot = rec->left;
-              if (pivot->right) {
-                Record** pentp = &pivot->right;
-                pivot = pivot->right;
-                while (pivot->right) {
-                  pentp = &pivot->right;
-                  pivot = pivot->right;
-                }
-                *entp = pivot;
-                *pentp = pivot->left;
-                pivot->left = rec->left;
-                pivot->right = rec->right;
-              } else {
-                *entp = pivot;
-                pivot->right = rec->right;
-              }
-            }
-
-            slot->count--;
-            slot->size -= sizeof(Record) + rksiz + rec->vsiz;
-            slot->repcheck();
-            xfree(rec);
+        bool adj = false;
+        if (vbuf != Visitor::NOP) {
+          if (tran_) {
+            log_record(slot, dbuf, rksiz, rvbuf, rvsiz, rec->ksiz & KSIZCOMP);
           } else {
-            bool adj = false;
-            if (vbuf != Visitor::NOP) {
-              char* zbuf = NULL;
-              assert(!comp);
-//              size_t zsiz = 0;
-//              if (comp) {
-//                zbuf = comp->compress(vbuf, vsiz, &zsiz);
-//                if (zbuf) {
-//                  vbuf = zbuf;
-//                  vsiz = zsiz;
-//                }
-//              }
-              if (tran_) {
-                assert(false);
-//                TranLog log(kbuf, ksiz, dbuf + rksiz, rec->vsiz);
-//                slot->trlogs.push_back(log);
-              } else {
-                adj = vsiz > rec->vsiz;
-              }
-              slot->size -= rec->vsiz;
-              slot->size += vsiz;
-              if (vsiz > rec->vsiz) {
-                Record* old = rec;
-                //xrealloc is not transaction safe bc realloc is not
-                //so, using the more expensive xmalloc  +mymemcpy
-                //instead for now.
-                rec = (Record*)xmalloc(sizeof(*rec) + ksiz + vsiz);
-                mymemcpy(rec, old, sizeof(*rec) + ksiz); //only rec + key.
-                xfree(old);
-                // the value gets copied later.
-              if (rec != old) {
-                  if (!curs_.empty()) adjust_cursors(old, rec);
-                  if (slot->first == old) slot->first = rec;
-                  if (slot->last == old) slot->last = rec;
-                  *entp = rec;
-                  if (rec->prev) rec->prev->next = rec;
-                  if (rec->next) rec->next->prev = rec;
-                  dbuf = (char*)rec + sizeof(*rec);
-                }
-              }
-              mymemcpy(dbuf + ksiz, vbuf, vsiz);
-              rec->vsiz = vsiz;
-              delete[] zbuf;
+            adj = vsiz > rec->vsiz;
+          }
+          add_counters(slot, 0, (int64_t)vsiz - (int64_t)rec->vsiz);
+          if (!fit_record(sizeof(*rec) + ksiz + rec->vsiz, sizeof(*rec) + ksiz + vsiz)) {
+            Record* old = rec;
+            rec = alloc_record(slot, sizeof(*rec) + ksiz + vsiz);
+            mymemcpy(rec, old, sizeof(*rec) + ksiz); //only rec + key.
+            free_record(slot, old);
+            // the value gets copied later.
+          if (rec != old) {
+              if (slot->curs) adjust_cursors(slot, old, rec);
+              if (slot->first == old) slot->first = rec;
+              if (slot->last == old) slot->last = rec;
+              *entp = rec;
+              if (rec->prev) rec->prev->next = rec;
+              if (rec->next) rec->next->prev = rec;
+              dbuf = (char*)rec + sizeof(*rec);
             }
-            slot->repcheck();
+          }
+          mymemcpy(dbuf + ksiz, vbuf, vsiz);
+          rec->vsiz = vsiz;
+          rec->ksiz = zip ? rec->ksiz | KSIZCOMP : rec->ksiz & ~KSIZCOMP;
+        }
+        slot->repcheck();
 
-            if (rtt && slot->last != rec) {
-              assert(rec->next);
-              if (!curs_.empty()) escape_cursors(rec);
-              if (slot->first == rec) slot->first = rec->next;
-              if (rec->prev) rec->prev->next = rec->next;
-              if (rec->next) rec->next->prev = rec->prev;
-              rec->prev = slot->last;
-              rec->next = NULL;
-              slot->last->next = rec;
-              slot->last = rec;
-              slot->repcheck();
-            }
-            if (adj) adjust_slot_capacity(slot);
+        if (mark) {
+          if (opts_ & TCLOCK) {
+            // only mark the record so that a read does not write the slot's list ends.
+            rec->ksiz |= KSIZREF;
+          } else {
+            rotate_record(slot, rec);
           }
-          slot->repcheck();
-          return;
         }
+        if (adj) adjust_slot_capacity(slot);
       }
-    } // NB. end of while loop.
+      if (vbuf != Visitor::NOP) adjust_slot_index(slot);
+      if (upd) end_slot_update(slot);
+      slot->repcheck();
+      if (vbuf == Visitor::REMOVE) return TXREMOVE;
+      return vbuf == Visitor::NOP ? TXGET : TXSET;
+    }
     size_t vsiz = 0;
     const char* vbuf = visitor->visit_empty(kbuf, ksiz, &vsiz);
 
     slot->repcheck();
     if (vbuf != Visitor::NOP && vbuf != Visitor::REMOVE) {
-      char* zbuf = NULL;
-      assert(!comp);
-//      size_t zsiz = 0;
-//      if (comp) {
-//        zbuf = comp->compress(vbuf, vsiz, &zsiz);
-//        if (zbuf) {
-//          vbuf = zbuf;
-//          vsiz = zsiz;
-//        }
-//      }
-      if (tran_) {
-        assert(0);
-//        TranLog log(kbuf, ksiz);
-//        slot->trlogs.push_back(log);
-      }
+      if (tran_) log_record(slot, kbuf, ksiz, NULL, 0, false);
       slot->repcheck();
-      slot->size += sizeof(Record) + ksiz + vsiz;
-      rec = (Record*)xmalloc(sizeof(*rec) + ksiz + vsiz);
+      begin_slot_update(slot);
+      rec = alloc_record(slot, sizeof(*rec) + ksiz + vsiz);
       char* dbuf = (char*)rec + sizeof(*rec);
       mymemcpy(dbuf, kbuf, ksiz);
-      rec->ksiz = ksiz | fhash;
+      rec->ksiz = ksiz | fhash | (zip ? KSIZCOMP : 0);
       mymemcpy(dbuf + ksiz, vbuf, vsiz);
       rec->vsiz = vsiz;
       rec->left = NULL;
       rec->right = NULL;
       rec->prev = slot->last;
       rec->next = NULL;
-      *entp = rec;
+      link_record(slot, hash, entp, rec);
       if (!slot->first) slot->first = rec;
       if (slot->last) slot->last->next = rec;
       slot->last = rec;
-      slot->count++;
+      add_counters(slot, 1, sizeof(Record) + ksiz + vsiz);
+      adjust_slot_index(slot);
       if (!tran_) adjust_slot_capacity(slot);
+      end_slot_update(slot);
       slot->repcheck();
-      delete[] zbuf;
+      return TXSET;
     }
-
+    return TXGET;
   }
   /**
-   * Get the number of records.
-   * @return the number of records, or -1 on failure.
+   * Search the bucket tree of a slot for a record.
+   * @param slot the slot of the record.
+   * @param hash the hash value of the key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @return the pointer to the link referring to the record, or to the empty link where the
+   * record would be inserted if it does not exist.
+   * @note While the index is being replaced, a record not moved yet is found in the replaced
+   * index, but a new record is always inserted in the new one.
    */
-  int64_t count_impl() {
-    _assert_(true);
-    int64_t sum = 0;
-    //__transaction_atomic { //disable thread safety for now.
-      myassert(this->omode_);
-    for (int32_t i = 0; i < SLOTNUM; i++) {
-      Slot* slot = slots_ + i;
-#ifdef LOCKING
-      ScopedMutex lock(&slot->lock);
-#endif
-      sum += slot->count;
-    //}
+  Record** __attribute__((transaction_safe))
+  search_record(Slot* slot, uint64_t hash, const char* kbuf, size_t ksiz) {
+    _assert_(slot && kbuf && ksiz <= MEMMAXSIZ);
+    if (slot->groups) {
+      Record** entp = search_group(slot->groups, slot->gnum, hash, kbuf, ksiz);
+      if (!*entp && slot->ogroups) {
+        Record** oentp = search_group(slot->ogroups, slot->ognum, hash, kbuf, ksiz);
+        if (*oentp) return oentp;
+      }
+      return entp;
     }
-    return sum;
+    Record** entp = search_tree(slot->buckets, slot->bnum, hash, kbuf, ksiz);
+    if (!*entp && slot->obuckets) {
+      Record** oentp = search_tree(slot->obuckets, slot->obnum, hash, kbuf, ksiz);
+      if (*oentp) return oentp;
+    }
+    return entp;
   }
   /**
-   * Get the size of the database file.
-   * @return the size of the database file in bytes.
+   * Search a bucket array for a record.
+   * @param buckets the bucket array.
+   * @param bnum the number of the buckets.
+   * @param hash the hash value of the key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @return the pointer to the link referring to the record, or to the empty link where the
+   * record would be inserted if it does not exist.
    */
-  int64_t size_impl() {
-    _assert_(true);
-    int64_t sum = sizeof(*this);
-    //__transaction_atomic {
-      myassert(this->omode_);
-    for (int32_t i = 0; i < SLOTNUM; i++) {
-      Slot* slot = slots_ + i;
-#ifdef LOCKING
-      ScopedMutex lock(&slot->lock);
-#endif
-      sum += slot->bnum * sizeof(Record*);
-      sum += slot->size;
+  Record** __attribute__((transaction_safe))
+  search_tree(Record** buckets, size_t bnum, uint64_t hash, const char* kbuf, size_t ksiz) {
+    _assert_(buckets && bnum > 0 && kbuf && ksiz <= MEMMAXSIZ);
+    Record** entp = buckets + hash % bnum;
+    Record* rec = *entp;
+    uint32_t fhash = fold_hash(hash) & KSIZHASH;
+    while (rec) {
+      uint32_t rhash = rec->ksiz & KSIZHASH;
+      uint32_t rksiz = rec->ksiz & KSIZMAX;
+      if (fhash > rhash) {
+        entp = &rec->left;
+      } else if (fhash < rhash) {
+        entp = &rec->right;
+      } else {
+        char* dbuf = (char*)rec + sizeof(*rec);
+        int32_t kcmp = compare_keys(kbuf, ksiz, dbuf, rksiz);
+        if (kcmp < 0) {
+          entp = &rec->left;
+        } else if (kcmp > 0) {
+          entp = &rec->right;
+        } else {
+          break;
+        }
+      }
+      rec = *entp;
     }
-//    }
-    return sum;
+    return entp;
   }
   /**
-   * Initialize a slot table.
-   * @param slot the slot table.
-   * @param bnum the number of buckets.
-   * @param capcnt the capacity of record number.
-   * @param capsiz the capacity of memory usage.
+   * Search the tagged index for a record.
+   * @param groups the groups of the tagged index.
+   * @param gnum the number of the groups.
+   * @param hash the hash value of the key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @return the pointer to the entry referring to the record, or to the free entry where the
+   * record would be inserted if it does not exist.  If it does not exist and there is no free
+   * entry within GROUPPROBE groups, the result of CacheDB::no_group_entry is returned.
    */
-  void initialize_slot(Slot* slot, size_t bnum, size_t capcnt, size_t capsiz) {
-    _assert_(slot);
-    Record** buckets;
-    if (bnum >= ZMAPBNUM) {
-      buckets = (Record**)mapalloc(sizeof(*buckets) * bnum);
-    } else {
-      buckets = new Record*[bnum];
-      for (size_t i = 0; i < bnum; i++) {
-        buckets[i] = NULL;
+  Record** __attribute__((transaction_safe))
+  search_group(Group* groups, size_t gnum, uint64_t hash, const char* kbuf, size_t ksiz) {
+    _assert_(groups && gnum > 0 && kbuf && ksiz <= MEMMAXSIZ);
+    uint16_t tag = group_tag(hash);
+    size_t gidx = hash % gnum;
+    Record** freep = NULL;
+    for (size_t i = 0; i < GROUPPROBE; i++) {
+      Group* group = groups + gidx;
+      for (size_t j = 0; j < GROUPWIDTH; j++) {
+        uint16_t gtag = group->tags[j];
+        if (gtag == tag) {
+          Record* rec = group->recs[j];
+          char* dbuf = (char*)rec + sizeof(*rec);
+          if (compare_keys(kbuf, ksiz, dbuf, rec->ksiz & KSIZMAX) == 0) return group->recs + j;
+        } else if (gtag == TAGEMPTY) {
+          return freep ? freep : group->recs + j;
+        } else if (gtag == TAGDELETED && !freep) {
+          freep = group->recs + j;
+        }
       }
+      if (++gidx >= gnum) gidx = 0;
     }
-    slot->buckets = buckets;
-    slot->bnum = bnum;
-    slot->capcnt = capcnt;
-    slot->capsiz = capsiz;
-    slot->first = NULL;
-    slot->last = NULL;
-    slot->count = 0;
-    slot->size = 0;
+    return freep ? freep : no_group_entry();
   }
   /**
-   * Destroy a slot table.
-   * @param slot the slot table.
+   * Get the dummy entry of the tagged index meaning that there is no room for a record.
+   * @return the pointer to the dummy entry, which always refers to NULL.
    */
-  void destroy_slot(Slot* slot) {
-    _assert_(slot);
-    slot->trlogs.clear();
-    Record* rec = slot->last;
-    while (rec) {
-      Record* prev = rec->prev;
-      xfree(rec);
-      rec = prev;
-    }
-    if (slot->bnum >= ZMAPBNUM) {
-      mapfree(slot->buckets);
+  static Record** __attribute__((transaction_safe)) no_group_entry() {
+    static Record* dummy = NULL;
+    return &dummy;
+  }
+  /**
+   * Get the tag of a hash value in the tagged index.
+   * @param hash the hash value.
+   * @return the tag, which is not less than TAGMIN.
+   */
+  static uint16_t __attribute__((transaction_safe)) group_tag(uint64_t hash) {
+    uint16_t tag = (hash >> 40) & 0xffff;
+    return tag < TAGMIN ? tag + TAGMIN : tag;
+  }
+  /**
+   * Get the group of the tagged index containing an entry.
+   * @param entp the pointer to the entry.
+   * @return the group containing the entry.
+   */
+  static Group* __attribute__((transaction_safe)) entry_group(Record** entp) {
+    return (Group*)((size_t)entp & ~(size_t)(CACHELINE - 1));
+  }
+  /**
+   * Link a new record to the index of its slot.
+   * @param slot the slot of the record.
+   * @param hash the hash value of the key.
+   * @param entp the empty link or the free entry given by CacheDB::search_record.
+   * @param rec the record.
+   * @note The tagged index is grown if there is no room for the record.  If it is still being
+   * moved from a previous growth, it is rebuilt at once instead.
+   */
+  void __attribute__((transaction_safe))
+  link_record(Slot* slot, uint64_t hash, Record** entp, Record* rec) {
+    _assert_(slot && entp && rec);
+    if (!slot->groups) {
+      *entp = rec;
+      return;
+    }
+    char* dbuf = (char*)rec + sizeof(*rec);
+    uint32_t rksiz = rec->ksiz & KSIZMAX;
+    while (entp == no_group_entry()) {
+      if (slot->ogroups) {
+        rebuild_slot_groups(slot);
+      } else {
+        grow_slot_groups(slot);
+      }
+      entp = search_group(slot->groups, slot->gnum, hash, dbuf, rksiz);
+    }
+    Group* group = entry_group(entp);
+    group->tags[entp - group->recs] = group_tag(hash);
+    *entp = rec;
+  }
+  /**
+   * Allocate the groups of the tagged index.
+   * @param gnum the number of the groups.
+   * @return the groups aligned to a cache line, all of whose entries are empty.
+   * @note The address of the whole region is stored just before the groups.
+   */
+  Group* __attribute__((transaction_safe)) alloc_groups(size_t gnum) {
+    _assert_(gnum > 0);
+    char* buf = (char*)xcalloc(sizeof(Group) * gnum + CACHELINE, 1);
+    Group* groups = (Group*)(buf + CACHELINE - (size_t)buf % CACHELINE);
+    ((char**)groups)[-1] = buf;
+    return groups;
+  }
+  /**
+   * Free the groups of the tagged index.
+   * @param groups the groups.
+   */
+  void __attribute__((transaction_safe)) free_groups(Group* groups) {
+    _assert_(groups);
+    xfree(((char**)groups)[-1]);
+  }
+  /**
+   * Double the tagged index of a slot.
+   * @param slot the slot table.
+   * @note As with CacheDB::grow_slot_buckets, the records are left in the replaced index and
+   * moved by the following updates of the slot, see CacheDB::migrate_slot_groups.
+   */
+  void __attribute__((transaction_safe)) grow_slot_groups(Slot* slot) {
+    _assert_(slot && slot->groups && !slot->ogroups);
+    size_t gnum = slot->gnum * 2 + 1;
+    slot->ogroups = slot->groups;
+    slot->ognum = slot->gnum;
+    slot->mcur = 0;
+    slot->groups = alloc_groups(gnum);
+    slot->gnum = gnum;
+  }
+  /**
+   * Move the records of a few groups of the replaced tagged index of a slot to the new one.
+   * @param slot the slot table.
+   * @note At most MIGRATESTEP groups are moved.  A moved entry is marked as deleted, so that
+   * the probes for the records of the preceding groups go on.  If the new index has no room for
+   * a record, the whole index is rebuilt by CacheDB::rebuild_slot_groups.
+   */
+  void __attribute__((transaction_safe)) migrate_slot_groups(Slot* slot) {
+    _assert_(slot && slot->ogroups);
+    size_t end = slot->mcur + MIGRATESTEP;
+    if (end > slot->ognum) end = slot->ognum;
+    while (slot->mcur < end) {
+      Group* group = slot->ogroups + slot->mcur;
+      for (size_t i = 0; i < GROUPWIDTH; i++) {
+        if (group->tags[i] < TAGMIN) continue;
+        Record* rec = group->recs[i];
+        uint32_t rksiz = rec->ksiz & KSIZMAX;
+        char* dbuf = (char*)rec + sizeof(*rec);
+        uint64_t hash = hash_record(dbuf, rksiz) / slotnum_;
+        Record** entp = search_group(slot->groups, slot->gnum, hash, dbuf, rksiz);
+        if (entp == no_group_entry()) {
+          rebuild_slot_groups(slot);
+          return;
+        }
+        Group* ngroup = entry_group(entp);
+        ngroup->tags[entp - ngroup->recs] = group_tag(hash);
+        *entp = rec;
+        group->tags[i] = TAGDELETED;
+        group->recs[i] = NULL;
+      }
+      slot->mcur++;
+    }
+    if (slot->mcur >= slot->ognum) {
+      release_groups(slot, slot->ogroups);
+      slot->ogroups = NULL;
+      slot->ognum = 0;
+      slot->mcur = 0;
+    }
+  }
+  /**
+   * Rebuild the tagged index of a slot at once in a larger one.
+   * @param slot the slot table.
+   * @note The records are taken from the LRU list, so the list and the cursors are left intact.
+   * This is only done when a growth overflows before the previous one has been moved.
+   */
+  void __attribute__((transaction_safe)) rebuild_slot_groups(Slot* slot) {
+    _assert_(slot && slot->groups);
+    size_t gnum = slot->gnum;
+    Group* groups = NULL;
+    while (!groups) {
+      gnum = gnum * 2 + 1;
+      groups = alloc_groups(gnum);
+      Record* rec = slot->first;
+      while (rec) {
+        uint32_t rksiz = rec->ksiz & KSIZMAX;
+        char* dbuf = (char*)rec + sizeof(*rec);
+        uint64_t hash = hash_record(dbuf, rksiz) / slotnum_;
+        Record** entp = search_group(groups, gnum, hash, dbuf, rksiz);
+        if (entp == no_group_entry()) {
+          free_groups(groups);
+          groups = NULL;
+          break;
+        }
+        Group* group = entry_group(entp);
+        group->tags[entp - group->recs] = group_tag(hash);
+        *entp = rec;
+        rec = rec->next;
+      }
+    }
+    release_groups(slot, slot->groups);
+    slot->groups = groups;
+    slot->gnum = gnum;
+    if (slot->ogroups) {
+      release_groups(slot, slot->ogroups);
+      slot->ogroups = NULL;
+      slot->ognum = 0;
+      slot->mcur = 0;
+    }
+  }
+  /**
+   * Unlink a record from its slot and release it.
+   * @param slot the slot of the record.
+   * @param rec the record.
+   * @param entp the link referring to the record in the bucket tree.
+   */
+  void __attribute__((transaction_safe)) remove_record(Slot* slot, Record* rec, Record** entp) {
+    _assert_(slot && rec && entp && *entp == rec);
+    if (slot->curs) escape_cursors(slot, rec);
+    slot->repcheck();
+    if (rec == slot->first) slot->first = rec->next;
+    if (rec == slot->last) slot->last = rec->prev;
+    if (rec->prev) rec->prev->next = rec->next;
+    if (rec->next) rec->next->prev = rec->prev;
+    if (slot->groups) {
+      Group* group = entry_group(entp);
+      size_t gidx = entp - group->recs;
+      bool probed = gidx + 1 >= GROUPWIDTH || group->tags[gidx+1] != TAGEMPTY;
+      group->tags[gidx] = probed ? TAGDELETED : TAGEMPTY;
+      *entp = NULL;
+    } else if (rec->left && !rec->right) {
+      *entp = rec->left;
+    } else if (!rec->left && rec->right) {
+      *entp = rec->right;
+    } else if (!rec->left) {
+      *entp = NULL;
+    } else {
+      Record* pivot = rec->left;
+      if (pivot->right) {
+        Record** pentp = &pivot->right;
+        pivot = pivot->right;
+        while (pivot->right) {
+          pentp = &pivot->right;
+          pivot = pivot->right;
+        }
+        *entp = pivot;
+        *pentp = pivot->left;
+        pivot->left = rec->left;
+        pivot->right = rec->right;
+      } else {
+        *entp = pivot;
+        pivot->right = rec->right;
+      }
+    }
+    add_counters(slot, -1, -(int64_t)(sizeof(Record) + (rec->ksiz & KSIZMAX) + rec->vsiz));
+    slot->repcheck();
+    free_record(slot, rec);
+  }
+  /**
+   * Get the size class of a record.
+   * @param rsiz the size of the record including the header.
+   * @return the size class, or SLABCLASSNUM if the record is not allocated from slabs.
+   */
+  static size_t __attribute__((transaction_safe)) record_class(size_t rsiz) {
+    return rsiz <= SLABMAX ? (rsiz - 1) / SLABUNIT : SLABCLASSNUM;
+  }
+  /**
+   * Check whether a record can be resized in place.
+   * @param osiz the current size of the record including the header.
+   * @param nsiz the new size of the record including the header.
+   * @return true if the record can keep its region, or false if not.
+   * @note A record in slabs is kept while it stays in its size class.  A record allocated by
+   * the heap is only kept while it shrinks and stays too large for slabs.
+   */
+  static bool __attribute__((transaction_safe)) fit_record(size_t osiz, size_t nsiz) {
+    size_t cls = record_class(osiz);
+    if (cls < SLABCLASSNUM) return record_class(nsiz) == cls;
+    return nsiz <= osiz && nsiz > SLABMAX;
+  }
+  /**
+   * Allocate the region of a record.
+   * @param slot the slot of the record.
+   * @param rsiz the size of the record including the header.
+   * @return the region of the record.
+   * @note A small record is taken from a slab of the slot which has room in its size class, so
+   * the heap is only called once per slab.
+   */
+  Record* __attribute__((transaction_safe)) alloc_record(Slot* slot, size_t rsiz) {
+    _assert_(slot && rsiz > sizeof(Record));
+    size_t cls = record_class(rsiz);
+    if (cls >= SLABCLASSNUM) return (Record*)arena_malloc(rsiz);
+    Slab* slab = slot->partials[cls];
+    if (!slab) slab = add_slab(slot, cls);
+    size_t bsiz = (cls + 1) * SLABUNIT;
+    char* blk = slab->frees;
+    if (blk) {
+      slab->frees = *(char**)blk;
+    } else {
+      blk = (char*)slab + slab->used;
+      slab->used += bsiz;
+    }
+    slab->live++;
+    if (!slab->frees && slab->used + bsiz > SLABSIZ) unlink_slab(slot, slab);
+    return (Record*)blk;
+  }
+  /**
+   * Release the region of a record.
+   * @param slot the slot of the record.
+   * @param rec the record.
+   * @note A slab is released as soon as its last block is freed, except that one empty slab is
+   * kept by each slot for the next class which needs one.  So the memory kept by the slabs of
+   * a slot only exceeds the size of its records by the partly used slabs.
+   */
+  void __attribute__((transaction_safe)) free_record(Slot* slot, Record* rec) {
+    _assert_(slot && rec);
+    size_t cls = record_class(sizeof(*rec) + (rec->ksiz & KSIZMAX) + rec->vsiz);
+    if (cls >= SLABCLASSNUM) {
+#ifdef SEQLOCK
+      Epoch::retire(rec, free_retired_record);
+#else
+      arena_free(rec);
+#endif
+      return;
+    }
+    Slab* slab = find_slab(slot, (char*)rec);
+    assert(slab->cls == cls && slab->live > 0);
+    size_t bsiz = (cls + 1) * SLABUNIT;
+    if (!slab->frees && slab->used + bsiz > SLABSIZ) link_slab(slot, slab);
+    *(char**)rec = slab->frees;
+    slab->frees = (char*)rec;
+    if (--slab->live == 0) remove_slab(slot, slab);
+  }
+  /**
+   * Add a slab of a size class to a slot.
+   * @param slot the slot table.
+   * @param cls the size class.
+   * @return the new slab, which is linked as having room.
+   */
+  Slab* __attribute__((transaction_safe)) add_slab(Slot* slot, size_t cls) {
+    _assert_(slot && cls < SLABCLASSNUM);
+    Slab* slab = slot->spare;
+    if (slab) {
+      slot->spare = NULL;
+    } else {
+      slab = (Slab*)arena_malloc(SLABSIZ);
+      if (slot->slabnum >= slot->slabcap) {
+        size_t cap = slot->slabcap > 0 ? slot->slabcap * 2 : SLABDIRNUM;
+        Slab** slabs = (Slab**)xmalloc(sizeof(*slabs) * cap);
+        for (size_t i = 0; i < slot->slabnum; i++) {
+          slabs[i] = slot->slabs[i];
+        }
+        xfree(slot->slabs);
+        slot->slabs = slabs;
+        slot->slabcap = cap;
+      }
+      size_t idx = slot->slabnum;
+      while (idx > 0 && slot->slabs[idx-1] > slab) {
+        slot->slabs[idx] = slot->slabs[idx-1];
+        idx--;
+      }
+      slot->slabs[idx] = slab;
+      slot->slabnum++;
+    }
+    slab->frees = NULL;
+    slab->cls = cls;
+    slab->live = 0;
+    slab->used = SLABHEAD;
+    link_slab(slot, slab);
+    return slab;
+  }
+  /**
+   * Remove an empty slab from a slot.
+   * @param slot the slot table.
+   * @param slab the slab, which must be linked as having room.
+   * @note In the seqlock build, the slab is retired to Epoch because readers without the lock
+   * may still be reading its records.
+   */
+  void __attribute__((transaction_safe)) remove_slab(Slot* slot, Slab* slab) {
+    _assert_(slot && slab && slab->live == 0);
+    unlink_slab(slot, slab);
+    if (!slot->spare) {
+      slot->spare = slab;
+      return;
+    }
+    size_t idx = find_slab_index(slot, (char*)slab);
+    slot->slabnum--;
+    for (size_t i = idx; i < slot->slabnum; i++) {
+      slot->slabs[i] = slot->slabs[i+1];
+    }
+#ifdef SEQLOCK
+    Epoch::retire(slab, free_retired_record);
+#else
+    arena_free(slab);
+#endif
+  }
+  /**
+   * Link a slab to the list of the slabs with room of its class.
+   * @param slot the slot table.
+   * @param slab the slab.
+   */
+  static void __attribute__((transaction_safe)) link_slab(Slot* slot, Slab* slab) {
+    _assert_(slot && slab);
+    Slab* head = slot->partials[slab->cls];
+    slab->prev = NULL;
+    slab->next = head;
+    if (head) head->prev = slab;
+    slot->partials[slab->cls] = slab;
+  }
+  /**
+   * Unlink a slab from the list of the slabs with room of its class.
+   * @param slot the slot table.
+   * @param slab the slab.
+   */
+  static void __attribute__((transaction_safe)) unlink_slab(Slot* slot, Slab* slab) {
+    _assert_(slot && slab);
+    if (slab->prev) {
+      slab->prev->next = slab->next;
+    } else {
+      slot->partials[slab->cls] = slab->next;
+    }
+    if (slab->next) slab->next->prev = slab->prev;
+  }
+  /**
+   * Find the slab containing a block.
+   * @param slot the slot table.
+   * @param blk the pointer to the block.
+   * @return the slab.
+   */
+  static Slab* __attribute__((transaction_safe)) find_slab(Slot* slot, const char* blk) {
+    _assert_(slot && blk);
+    return slot->slabs[find_slab_index(slot, blk)];
+  }
+  /**
+   * Find the index of the slab containing a block in the directory of a slot.
+   * @param slot the slot table.
+   * @param blk the pointer to the block.
+   * @return the index of the last slab whose address is not more than the block.
+   */
+  static size_t __attribute__((transaction_safe)) find_slab_index(Slot* slot, const char* blk) {
+    _assert_(slot && slot->slabnum > 0 && blk);
+    size_t low = 0;
+    size_t high = slot->slabnum;
+    while (high - low > 1) {
+      size_t mid = (low + high) / 2;
+      if ((const char*)slot->slabs[mid] <= blk) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  }
+#ifdef SEQLOCK
+  /**
+   * Release the region of a record or a slab retired to Epoch.
+   * @param ptr the pointer to the region.
+   */
+  static void free_retired_record(void* ptr) {
+    _assert_(ptr);
+    arena_free(ptr);
+  }
+#endif
+  /**
+   * Move a record to the end of the LRU list of its slot.
+   * @param slot the slot of the record.
+   * @param rec the record, which must not be the last one.
+   */
+  void __attribute__((transaction_safe)) rotate_record(Slot* slot, Record* rec) {
+    _assert_(slot && rec && rec != slot->last);
+    assert(rec->next);
+    if (slot->curs) escape_cursors(slot, rec);
+    if (slot->first == rec) slot->first = rec->next;
+    if (rec->prev) rec->prev->next = rec->next;
+    if (rec->next) rec->next->prev = rec->prev;
+    rec->prev = slot->last;
+    rec->next = NULL;
+    slot->last->next = rec;
+    slot->last = rec;
+    slot->repcheck();
+  }
+  /**
+   * Grow the index of a slot if it is crowded, and move a part of the index being replaced.
+   * @param slot the slot table, which is being updated.
+   */
+  void __attribute__((transaction_safe)) adjust_slot_index(Slot* slot) {
+    _assert_(slot);
+    if ((opts_ & TADAPTIVE) && slot->buckets && !slot->obuckets &&
+        slot->count > slot->bnum * ADAPTLOAD) grow_slot_buckets(slot);
+    if (slot->obuckets) migrate_slot_buckets(slot);
+    if (slot->ogroups) migrate_slot_groups(slot);
+  }
+  /**
+   * Double the bucket array of a slot.
+   * @param slot the slot table.
+   * @note The records are left in the replaced array, and the following updates of the slot
+   * move them by CacheDB::migrate_slot_buckets, so that no single update rebuilds the trees of
+   * the whole slot in its atomic section.  A memory-mapped bucket array is kept as it is
+   * because unmapping it is not transaction safe.
+   */
+  void __attribute__((transaction_safe)) grow_slot_buckets(Slot* slot) {
+    _assert_(slot && !slot->obuckets);
+    if (slot->bmap) return;
+    size_t bnum = slot->bnum * 2 + 1;
+    slot->obuckets = slot->buckets;
+    slot->obnum = slot->bnum;
+    slot->mcur = 0;
+    slot->buckets = (Record**)xcalloc(bnum, sizeof(*slot->buckets));
+    slot->bnum = bnum;
+  }
+  /**
+   * Move the records of a few buckets of the replaced bucket array of a slot to the new one.
+   * @param slot the slot table.
+   * @note At most MIGRATESTEP buckets are moved.  Each tree is consumed by rotating its left
+   * children up, so no stack is needed.  The replaced array is released after its last bucket.
+   */
+  void __attribute__((transaction_safe)) migrate_slot_buckets(Slot* slot) {
+    _assert_(slot && slot->obuckets);
+    size_t end = slot->mcur + MIGRATESTEP;
+    if (end > slot->obnum) end = slot->obnum;
+    while (slot->mcur < end) {
+      Record* rec = slot->obuckets[slot->mcur];
+      slot->obuckets[slot->mcur] = NULL;
+      slot->mcur++;
+      while (rec) {
+        Record* child = rec->left;
+        if (child) {
+          rec->left = child->right;
+          child->right = rec;
+          rec = child;
+          continue;
+        }
+        Record* next = rec->right;
+        uint32_t rksiz = rec->ksiz & KSIZMAX;
+        char* dbuf = (char*)rec + sizeof(*rec);
+        uint64_t hash = hash_record(dbuf, rksiz) / slotnum_;
+        rec->right = NULL;
+        *search_tree(slot->buckets, slot->bnum, hash, dbuf, rksiz) = rec;
+        rec = next;
+      }
+    }
+    if (slot->mcur >= slot->obnum) {
+      release_buckets(slot, slot->obuckets);
+      slot->obuckets = NULL;
+      slot->obnum = 0;
+      slot->mcur = 0;
+    }
+  }
+  /**
+   * Release a bucket array replaced in a slot.
+   * @param slot the slot table.
+   * @param buckets the replaced bucket array.
+   * @note In the seqlock build, the array is retired to Epoch because readers without the lock
+   * may still be probing it.
+   */
+  void __attribute__((transaction_safe)) release_buckets(Slot* slot, Record** buckets) {
+    _assert_(slot && buckets);
+#ifdef SEQLOCK
+    Epoch::retire(buckets, xfree);
+#else
+    xfree(buckets);
+#endif
+  }
+  /**
+   * Release a tagged index replaced in a slot.
+   * @param slot the slot table.
+   * @param groups the groups of the replaced tagged index.
+   * @note See CacheDB::release_buckets.
+   */
+  void __attribute__((transaction_safe)) release_groups(Slot* slot, Group* groups) {
+    _assert_(slot && groups);
+#ifdef SEQLOCK
+    Epoch::retire(((char**)groups)[-1], xfree);
+#else
+    free_groups(groups);
+#endif
+  }
+  /**
+   * Mark the beginning of an update of a slot.
+   * @param slot the slot table, which must be locked or otherwise owned by the caller.
+   * @note In the seqlock build, the version of the slot is made odd so that readers without the
+   * lock retry.  Otherwise, nothing is done.
+   */
+  static void __attribute__((transaction_safe)) begin_slot_update(Slot* slot) {
+    _assert_(slot);
+#ifdef SEQLOCK
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+  }
+  /**
+   * Mark the end of an update of a slot.
+   * @param slot the slot table.
+   */
+  static void __attribute__((transaction_safe)) end_slot_update(Slot* slot) {
+    _assert_(slot);
+#ifdef SEQLOCK
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+#endif
+  }
+  /**
+   * Get the buffer of the calling thread to copy values out of the atomic sections.
+   * @param size the minimum size of the buffer.
+   * @return the pointer to the buffer, which is valid until the next call by the same thread.
+   * @note The buffer is separate from the one of arena_buffer, which get_view hands out to the
+   * caller, and it is released at the exit of the thread.
+   */
+  static char* read_buffer(size_t size) {
+    /** Buffer released at the exit of the thread. */
+    struct ReadBuffer {
+      ~ReadBuffer() {
+        xfree(buf);
+      }
+      char* buf;
+      size_t bsiz;
+    };
+    static thread_local ReadBuffer rbuf = { NULL, 0 };
+    if (size > rbuf.bsiz) {
+      rbuf.bsiz = rbuf.bsiz * 2 > size ? rbuf.bsiz * 2 : size + RECBUFSIZ;
+      xfree(rbuf.buf);
+      rbuf.buf = (char*)xmalloc(rbuf.bsiz);
+    }
+    return rbuf.buf;
+  }
+#ifdef SEQLOCK
+  /**
+   * Check whether a slot has not been updated since its version was read.
+   * @param slot the slot table.
+   * @param seq the version read before.
+   * @return true if the slot is unchanged, or false if not.
+   */
+  static bool slot_stable(const Slot* slot, uint32_t seq) {
+    _assert_(slot);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+  }
+  /**
+   * Search the index of a slot for a record without the lock.
+   * @param slot the slot of the record.
+   * @param seq the version of the slot read before.
+   * @param hash the hash value of the key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param recp the pointer to the variable into which the record, or NULL if it does not exist,
+   * is assigned.
+   * @return true on success, or false if the slot was updated meanwhile.
+   * @note The version is checked before every dereference of a loaded link, so a link written
+   * by a concurrent update is never followed.  The size of a key is also validated before the
+   * key is compared, because the block of a record freed meanwhile may be reused by another
+   * record.  The comparison itself may then see a torn key, but it never reads beyond the block,
+   * which stays mapped while the epoch is pinned, and its result is discarded by the next check.
+   */
+  bool read_record(const Slot* slot, uint32_t seq, uint64_t hash, const char* kbuf, size_t ksiz,
+                   Record** recp) {
+    _assert_(slot && kbuf && ksiz <= MEMMAXSIZ && recp);
+    *recp = NULL;
+    Group* groups = slot->groups;
+    if (groups) {
+      size_t gnum = slot->gnum;
+      Group* ogroups = slot->ogroups;
+      size_t ognum = slot->ognum;
+      if (!read_groups(slot, seq, groups, gnum, hash, kbuf, ksiz, recp)) return false;
+      if (*recp || !ogroups) return true;
+      return read_groups(slot, seq, ogroups, ognum, hash, kbuf, ksiz, recp);
+    }
+    Record** buckets = slot->buckets;
+    size_t bnum = slot->bnum;
+    Record** obuckets = slot->obuckets;
+    size_t obnum = slot->obnum;
+    if (!read_tree(slot, seq, buckets, bnum, hash, kbuf, ksiz, recp)) return false;
+    if (*recp || !obuckets) return true;
+    return read_tree(slot, seq, obuckets, obnum, hash, kbuf, ksiz, recp);
+  }
+  /**
+   * Search a tagged index of a slot for a record without the lock.
+   * @param slot the slot of the record.
+   * @param seq the version of the slot read before.
+   * @param groups the groups of the tagged index read under the version.
+   * @param gnum the number of the groups.
+   * @param hash the hash value of the key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param recp the pointer to the variable into which the record, or NULL if it does not exist,
+   * is assigned.
+   * @return true on success, or false if the slot was updated meanwhile.
+   */
+  bool read_groups(const Slot* slot, uint32_t seq, Group* groups, size_t gnum, uint64_t hash,
+                   const char* kbuf, size_t ksiz, Record** recp) {
+    _assert_(slot && kbuf && ksiz <= MEMMAXSIZ && recp);
+    if (!slot_stable(slot, seq)) return false;
+    uint16_t tag = group_tag(hash);
+    size_t gidx = hash % gnum;
+    for (size_t i = 0; i < GROUPPROBE; i++) {
+      Group* group = groups + gidx;
+      for (size_t j = 0; j < GROUPWIDTH; j++) {
+        uint16_t gtag = group->tags[j];
+        if (gtag == TAGEMPTY) return slot_stable(slot, seq);
+        if (gtag != tag) continue;
+        Record* rec = group->recs[j];
+        if (!slot_stable(slot, seq)) return false;
+        uint32_t rksiz = rec->ksiz;
+        if (!slot_stable(slot, seq)) return false;
+        char* dbuf = (char*)rec + sizeof(*rec);
+        if (compare_keys(kbuf, ksiz, dbuf, rksiz & KSIZMAX) == 0) {
+          *recp = rec;
+          return slot_stable(slot, seq);
+        }
+      }
+      if (++gidx >= gnum) gidx = 0;
+    }
+    return slot_stable(slot, seq);
+  }
+  /**
+   * Search a bucket array of a slot for a record without the lock.
+   * @param slot the slot of the record.
+   * @param seq the version of the slot read before.
+   * @param buckets the bucket array read under the version.
+   * @param bnum the number of the buckets.
+   * @param hash the hash value of the key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param recp the pointer to the variable into which the record, or NULL if it does not exist,
+   * is assigned.
+   * @return true on success, or false if the slot was updated meanwhile.
+   */
+  bool read_tree(const Slot* slot, uint32_t seq, Record** buckets, size_t bnum, uint64_t hash,
+                 const char* kbuf, size_t ksiz, Record** recp) {
+    _assert_(slot && kbuf && ksiz <= MEMMAXSIZ && recp);
+    if (!slot_stable(slot, seq)) return false;
+    Record* rec = buckets[hash % bnum];
+    uint32_t fhash = fold_hash(hash) & KSIZHASH;
+    while (true) {
+      if (!slot_stable(slot, seq)) return false;
+      if (!rec) return true;
+      uint32_t rksiz = rec->ksiz;
+      uint32_t rhash = rksiz & KSIZHASH;
+      if (fhash > rhash) {
+        rec = rec->left;
+      } else if (fhash < rhash) {
+        rec = rec->right;
+      } else {
+        if (!slot_stable(slot, seq)) return false;
+        char* dbuf = (char*)rec + sizeof(*rec);
+        int32_t kcmp = compare_keys(kbuf, ksiz, dbuf, rksiz & KSIZMAX);
+        if (kcmp < 0) {
+          rec = rec->left;
+        } else if (kcmp > 0) {
+          rec = rec->right;
+        } else {
+          *recp = rec;
+          return slot_stable(slot, seq);
+        }
+      }
+    }
+  }
+  /**
+   * Accept a visitor to a record for reading without any lock.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param visitor a visitor object.
+   * @param stats the statistics to which the attempts are added.  An attempt which finds the
+   * slot updated is counted as a conflict.
+   * @return true if the visitor has been called, or false if the caller must take the locks.
+   * @note The value is copied into the buffer of the calling thread and the copy is validated
+   * against the version of the slot before the visitor sees it, so the visitor only sees a
+   * consistent record, and a compressed value is decompressed from the copy.  The return value
+   * of the visitor is ignored.  If the slot keeps being updated for SEQRETRY attempts, or if
+   * the record has to be rotated in the LRU list, false is returned.  If LRU rotation is on
+   * without CacheDB::TCLOCK, nearly every hit would have to be rotated, so false is returned
+   * at once instead of probing the slot in vain.  The epoch is pinned meanwhile, so the index
+   * arrays and the records on the heap which a writer unlinks are not freed under the reader.
+   */
+  bool accept_optimistic(const char* kbuf, size_t ksiz, Visitor* visitor, TxStats* stats) {
+    _assert_(kbuf && ksiz <= MEMMAXSIZ && visitor && stats);
+    if (omode_ == 0 || ksiz > KSIZMAX || (rttmode_ && !(opts_ & TCLOCK))) return false;
+    ScopedEpoch epoch;
+    uint64_t hash = hash_record(kbuf, ksiz);
+    Slot* slot = slots_ + hash % slotnum_;
+    hash /= slotnum_;
+    bool rtt = rttmode_;
+    for (uint32_t i = 0; i < SEQRETRY; i++) {
+      stats->starts++;
+      uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+      if (seq & 1) {
+        stats->conflicts++;
+        _mm_pause();
+        continue;
+      }
+      Record* rec;
+      if (!read_record(slot, seq, hash, kbuf, ksiz, &rec)) {
+        stats->conflicts++;
+        continue;
+      }
+      size_t vsiz;
+      if (!rec) {
+        visitor->visit_empty(kbuf, ksiz, &vsiz);
+        stats->commits++;
+        return true;
+      }
+      uint32_t rksiz = rec->ksiz;
+      size_t rvsiz = rec->vsiz;
+      bool mark = rtt && slot->last != rec && (!(opts_ & TCLOCK) || !(rksiz & KSIZREF));
+      if (!slot_stable(slot, seq)) {
+        stats->conflicts++;
+        continue;
+      }
+      if (mark) {
+        stats->explicits++;
+        return false;
+      }
+      char* vbuf = read_buffer(rvsiz);
+      std::memcpy(vbuf, (char*)rec + sizeof(*rec) + (rksiz & KSIZMAX), rvsiz);
+      if (!slot_stable(slot, seq)) {
+        stats->conflicts++;
+        continue;
+      }
+      char* zbuf = NULL;
+      size_t zsiz = 0;
+      if (rksiz & KSIZCOMP) {
+        zbuf = comp_->decompress(vbuf, rvsiz, &zsiz);
+        if (zbuf) {
+          vbuf = zbuf;
+          rvsiz = zsiz;
+        }
+      }
+      visitor->visit_full(kbuf, ksiz, vbuf, rvsiz, &vsiz);
+      delete[] zbuf;
+      stats->commits++;
+      return true;
+    }
+    return false;
+  }
+#endif
+  /**
+   * Sample a read for the detection of hot keys.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param fillp the pointer to the variable into which whether to replicate the record after
+   * the read is assigned.
+   * @return true if the read is sampled, or false if not.
+   * @note A sampled read is counted for the hot-key entry of the key and takes the ordinary
+   * path, so that a hot record is still rotated in the LRU list now and then.
+   */
+  bool sample_hot(const char* kbuf, size_t ksiz, bool* fillp) {
+    _assert_(kbuf && ksiz <= MEMMAXSIZ && fillp);
+    static __thread uint32_t cnt = 0;
+    if (++cnt % HOTSAMPLE != 0) return false;
+    uint64_t hash = hash_record(kbuf, ksiz);
+    size_t hidx = (hash % slotnum_) * hotnum_ + hash / slotnum_ % hotnum_;
+    *fillp = __atomic_add_fetch(hotcnts_ + hidx, 1, __ATOMIC_RELAXED) % HOTTHRES == 0;
+    return true;
+  }
+  /**
+   * Accept a visitor to the replica of a hot record for reading.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param visitor a visitor object.
+   * @param stats the statistics to which the attempts are added.
+   * @return true if the visitor has been called, or false if the record is not replicated.
+   * @note The value is copied out of the entry before the visitor sees it, in the builds with
+   * locks against the version of the entry, and in an atomic section in the others.  The return
+   * value of the visitor is ignored.
+   */
+  bool accept_hot(const char* kbuf, size_t ksiz, Visitor* visitor, TxStats* stats) {
+    _assert_(kbuf && ksiz <= MEMMAXSIZ && visitor && stats);
+    if (ksiz > HOTBUFSIZ) return false;
+    uint64_t hash = hash_record(kbuf, ksiz);
+    const Slot* slot = slots_ + hash % slotnum_;
+    hash /= slotnum_;
+    const HotEntry* ent = hot_entry(slot, hash);
+    char vbuf[HOTBUFSIZ];
+    size_t vsiz = 0;
+    bool hit = false;
+#ifdef LOCKING
+    if (omode_ == 0) return false;
+    for (uint32_t i = 0; i < SEQRETRY; i++) {
+      stats->starts++;
+      uint32_t seq = __atomic_load_n(&ent->seq, __ATOMIC_ACQUIRE);
+      if (seq & 1) {
+        stats->conflicts++;
+        continue;
+      }
+      hit = read_hot(ent, hash, kbuf, ksiz, vbuf, &vsiz);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&ent->seq, __ATOMIC_RELAXED) == seq) break;
+      stats->conflicts++;
+      hit = false;
+    }
+#else
+#ifndef RTM
+    stats->starts++;
+#endif
+    __transaction_atomic
+#ifdef RTM
+    ScopedElision elision(&elock_, stats);
+#endif
+    {
+    if (omode_ != 0) hit = read_hot(ent, hash, kbuf, ksiz, vbuf, &vsiz);
+    }
+#endif
+    if (!hit) return false;
+#ifndef RTM
+    stats->commits++;
+#endif
+    size_t sp;
+    visitor->visit_full(kbuf, ksiz, vbuf, vsiz, &sp);
+    return true;
+  }
+  /**
+   * Get the hot-key entry of a key.
+   * @param slot the slot of the key.
+   * @param hash the hash value of the key.
+   * @return the entry.
+   */
+  HotEntry* __attribute__((transaction_safe)) hot_entry(const Slot* slot, uint64_t hash) {
+    _assert_(slot);
+    return hots_ + (slot - slots_) * hotnum_ + hash % hotnum_;
+  }
+  /**
+   * Copy the value out of a hot-key entry.
+   * @param ent the entry.
+   * @param hash the hash value of the key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param vbuf the pointer to the buffer of HOTBUFSIZ bytes into which the value is copied.
+   * @param sp the pointer to the variable into which the size of the value is assigned.
+   * @return true if the entry holds the key, or false if not.
+   * @note The sizes are checked before the copy, so a torn read never overruns the buffer.
+   */
+  bool __attribute__((transaction_safe))
+  read_hot(const HotEntry* ent, uint64_t hash, const char* kbuf, size_t ksiz, char* vbuf,
+           size_t* sp) {
+    _assert_(ent && kbuf && ksiz <= MEMMAXSIZ && vbuf && sp);
+    size_t rksiz = ent->ksiz;
+    size_t rvsiz = ent->vsiz;
+    if (rksiz != ksiz || ent->hash != hash || rvsiz > HOTBUFSIZ - rksiz) return false;
+    if (compare_keys(kbuf, ksiz, ent->buf, rksiz) != 0) return false;
+    mymemcpy(vbuf, ent->buf + rksiz, rvsiz);
+    *sp = rvsiz;
+    return true;
+  }
+  /**
+   * Replicate a record into its hot-key entry.
+   * @param slot the slot of the record.
+   * @param hash the hash value of the key.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @note This must be called in the atomic section holding the slot.  The record replaces the
+   * one held by the entry, if any.
+   */
+  void __attribute__((transaction_safe))
+  fill_hot(Slot* slot, uint64_t hash, const char* kbuf, size_t ksiz) {
+    _assert_(slot && kbuf && ksiz <= MEMMAXSIZ);
+    const Record* rec = *search_record(slot, hash, kbuf, ksiz);
+    if (!rec || (rec->ksiz & KSIZCOMP) || ksiz + rec->vsiz > HOTBUFSIZ) return;
+    HotEntry* ent = hot_entry(slot, hash);
+    if (ent->ksiz == ksiz && ent->hash == hash &&
+        compare_keys(kbuf, ksiz, ent->buf, ksiz) == 0) return;
+    begin_hot_update(ent);
+    ent->ksiz = ksiz;
+    ent->vsiz = rec->vsiz;
+    ent->hash = hash;
+    mymemcpy(ent->buf, (const char*)rec + sizeof(*rec), ksiz + rec->vsiz);
+    end_hot_update(ent);
+  }
+  /**
+   * Invalidate the hot-key entry of a record.
+   * @param slot the slot of the record.
+   * @param hash the hash value of the key.
+   * @note This must be called in the atomic section holding the slot.  The entry is kept if it
+   * holds another key.
+   */
+  void __attribute__((transaction_safe)) drop_hot(const Slot* slot, uint64_t hash) {
+    _assert_(slot);
+    HotEntry* ent = hot_entry(slot, hash);
+    if (ent->ksiz > HOTBUFSIZ || ent->hash != hash) return;
+    begin_hot_update(ent);
+    ent->ksiz = UINT32MAX;
+    end_hot_update(ent);
+  }
+  /**
+   * Invalidate all hot-key entries of a slot table.
+   * @param slot the slot table.
+   */
+  void __attribute__((transaction_safe)) clear_slot_hots(const Slot* slot) {
+    _assert_(slot);
+    HotEntry* ents = hots_ + (slot - slots_) * hotnum_;
+    for (int64_t i = 0; i < hotnum_; i++) {
+      begin_hot_update(ents + i);
+      ents[i].ksiz = UINT32MAX;
+      end_hot_update(ents + i);
+    }
+  }
+  /**
+   * Mark the beginning of an update of a hot-key entry.
+   * @param ent the entry.
+   * @note The version is only kept in the builds with locks, whose readers of the entries do not
+   * run in atomic sections.
+   */
+  static void __attribute__((transaction_safe)) begin_hot_update(HotEntry* ent) {
+    _assert_(ent);
+#ifdef LOCKING
+    __atomic_store_n(&ent->seq, ent->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+  }
+  /**
+   * Mark the end of an update of a hot-key entry.
+   * @param ent the entry.
+   */
+  static void __attribute__((transaction_safe)) end_hot_update(HotEntry* ent) {
+    _assert_(ent);
+#ifdef LOCKING
+    __atomic_store_n(&ent->seq, ent->seq + 1, __ATOMIC_RELEASE);
+#endif
+  }
+  /**
+   * Get the index of the counter shard of the calling thread.
+   * @return the index of the counter shard.
+   */
+  static uint32_t __attribute__((transaction_safe)) counter_index() {
+    static uint32_t seq = 0;
+    static __thread uint32_t idx = 0;
+    if (idx == 0) {
+#ifdef LOCKING
+      idx = __sync_add_and_fetch(&seq, 1);
+#else
+      idx = ++seq;
+#endif
+    }
+    return idx % COUNTERNUM;
+  }
+  /**
+   * Add to the record counters.
+   * @param slot the slot table of the records.
+   * @param cnt the difference of the number of records.
+   * @param siz the difference of the total size of records.
+   * @note Only the counter shard of the calling thread is written, and the slot counters only
+   * if the capacity or the bucket growth needs them.
+   */
+  void __attribute__((transaction_safe)) add_counters(Slot* slot, int64_t cnt, int64_t siz) {
+    _assert_(slot);
+    if (slotstat_) {
+      slot->count += cnt;
+      slot->size += siz;
+    }
+    Counter* ctr = counters_ + counter_index();
+#ifdef LOCKING
+    __sync_fetch_and_add(&ctr->count, cnt);
+    __sync_fetch_and_add(&ctr->size, siz);
+#else
+    ctr->count += cnt;
+    ctr->size += siz;
+#endif
+  }
+  /**
+   * Merge the record counters.
+   * @param cntp the pointer to the variable into which the number of records is assigned.
+   * @param sizp the pointer to the variable into which the total size of records is assigned.
+   * @param exact true to read all shards atomically, or false to read them one by one.
+   */
+  void merge_counters(int64_t* cntp, int64_t* sizp, bool exact) {
+    _assert_(cntp && sizp);
+    int64_t cnt = 0;
+    int64_t siz = 0;
+    if (exact) {
+      __transaction_atomic {
+#ifdef RTM
+        ScopedElision elision(&elock_);
+#endif
+        for (size_t i = 0; i < COUNTERNUM; i++) {
+          cnt += counters_[i].count;
+          siz += counters_[i].size;
+        }
+      }
+    } else {
+      for (size_t i = 0; i < COUNTERNUM; i++) {
+        cnt += counters_[i].count;
+        siz += counters_[i].size;
+      }
+    }
+    *cntp = cnt;
+    *sizp = siz;
+  }
+  /**
+   * Add the statistics of an atomic section to the shard of the calling thread.
+   * @param op the kind of the operation.
+   * @param stats the statistics of the section.
+   * @note This must be called outside the section.  A section of the locking builds which did
+   * not commit without the locks is counted as a fallback, and a section of the tm build,
+   * whose attempts are not visible, is counted as one committed transaction.
+   */
+  void record_tx(TxOp op, TxStats* stats) {
+    _assert_(op < TXOPNUM && stats);
+    if (!txcounters_) return;
+#if defined(LOCKING)
+    if (stats->commits < 1) stats->fallbacks++;
+#elif !defined(RTM)
+    stats->starts++;
+    stats->commits++;
+#endif
+    TxStats* sst = txcounters_[counter_index()].ops + op;
+    if (stats->starts) __atomic_fetch_add(&sst->starts, stats->starts, __ATOMIC_RELAXED);
+    if (stats->commits) __atomic_fetch_add(&sst->commits, stats->commits, __ATOMIC_RELAXED);
+    if (stats->conflicts) __atomic_fetch_add(&sst->conflicts, stats->conflicts, __ATOMIC_RELAXED);
+    if (stats->capacities)
+      __atomic_fetch_add(&sst->capacities, stats->capacities, __ATOMIC_RELAXED);
+    if (stats->explicits) __atomic_fetch_add(&sst->explicits, stats->explicits, __ATOMIC_RELAXED);
+    if (stats->others) __atomic_fetch_add(&sst->others, stats->others, __ATOMIC_RELAXED);
+    if (stats->fallbacks) __atomic_fetch_add(&sst->fallbacks, stats->fallbacks, __ATOMIC_RELAXED);
+  }
+  /**
+   * Add statistics of atomic sections to others.
+   * @param dest the statistics to which the others are added.
+   * @param src the statistics to add.
+   */
+  static void add_tx(TxStats* dest, const TxStats& src) {
+    _assert_(dest);
+    dest->starts += src.starts;
+    dest->commits += src.commits;
+    dest->conflicts += src.conflicts;
+    dest->capacities += src.capacities;
+    dest->explicits += src.explicits;
+    dest->others += src.others;
+    dest->fallbacks += src.fallbacks;
+  }
+  /**
+   * Merge the statistics of atomic sections of a kind of operations.
+   * @param op the kind of the operation.
+   * @param stats the pointer to the variable into which the sum of all shards is assigned.
+   * @note The shards are read one by one while other threads may be updating them.
+   */
+  void merge_tx(int32_t op, TxStats* stats) {
+    _assert_(op < TXOPNUM && stats);
+    std::memset(stats, 0, sizeof(*stats));
+    for (size_t i = 0; i < COUNTERNUM; i++) {
+      const TxStats* sst = txcounters_[i].ops + op;
+      stats->starts += __atomic_load_n(&sst->starts, __ATOMIC_RELAXED);
+      stats->commits += __atomic_load_n(&sst->commits, __ATOMIC_RELAXED);
+      stats->conflicts += __atomic_load_n(&sst->conflicts, __ATOMIC_RELAXED);
+      stats->capacities += __atomic_load_n(&sst->capacities, __ATOMIC_RELAXED);
+      stats->explicits += __atomic_load_n(&sst->explicits, __ATOMIC_RELAXED);
+      stats->others += __atomic_load_n(&sst->others, __ATOMIC_RELAXED);
+      stats->fallbacks += __atomic_load_n(&sst->fallbacks, __ATOMIC_RELAXED);
+    }
+  }
+  /**
+   * Get the name of a kind of operations.
+   * @param op the kind of the operation.
+   * @return the name of the kind.
+   */
+  static const char* tx_name(int32_t op) {
+    switch (op) {
+      case TXGET: return "get";
+      case TXSET: return "set";
+      case TXREMOVE: return "remove";
+      case TXBULK: return "bulk";
+      case TXCURSOR: return "cursor";
+      case TXHOT: return "hot";
+    }
+    return "unknown";
+  }
+  /**
+   * Store statistics of atomic sections into a status map.
+   * @param strmap the status map.
+   * @param prefix the prefix of the keys.
+   * @param stats the statistics.
+   */
+  static void status_tx(std::map<std::string, std::string>* strmap, const std::string& prefix,
+                        const TxStats& stats) {
+    _assert_(strmap);
+    (*strmap)[prefix + "starts"] = strprintf("%lld", (long long)stats.starts);
+    (*strmap)[prefix + "commits"] = strprintf("%lld", (long long)stats.commits);
+    (*strmap)[prefix + "abort_conflict"] = strprintf("%lld", (long long)stats.conflicts);
+    (*strmap)[prefix + "abort_capacity"] = strprintf("%lld", (long long)stats.capacities);
+    (*strmap)[prefix + "abort_explicit"] = strprintf("%lld", (long long)stats.explicits);
+    (*strmap)[prefix + "abort_other"] = strprintf("%lld", (long long)stats.others);
+    (*strmap)[prefix + "fallbacks"] = strprintf("%lld", (long long)stats.fallbacks);
+  }
+  /**
+   * Make the keys of a bulk operation.
+   * @param keys specifies a string vector of the keys, which must not be empty.
+   * @return the array of the keys, which should be released with the delete[] operator.
+   * @note The hash values are calculated outside of any atomic section so that the section
+   * only touches the records.
+   */
+  BulkKey* make_bulk_keys(const std::vector<std::string>& keys) {
+    _assert_(!keys.empty());
+    size_t knum = keys.size();
+    BulkKey* bkeys = new BulkKey[knum];
+    for (size_t i = 0; i < knum; i++) {
+      const std::string& key = keys[i];
+      make_bulk_key(key.data(), key.size(), bkeys + i);
+    }
+    return bkeys;
+  }
+  /**
+   * Make a key of a bulk operation.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param bkey the key to be made.
+   */
+  void make_bulk_key(const char* kbuf, size_t ksiz, BulkKey* bkey) {
+    _assert_(kbuf && ksiz <= MEMMAXSIZ && bkey);
+    bkey->kbuf = kbuf;
+    bkey->ksiz = ksiz > KSIZMAX ? KSIZMAX : ksiz;
+    bkey->hash = hash_record(bkey->kbuf, bkey->ksiz);
+    bkey->sidx = bkey->hash % slotnum_;
+    bkey->hash /= slotnum_;
+  }
+  /**
+   * Prefetch the index entry of a key.
+   * @param slot the slot of the key.
+   * @param hash the hash value of the key.
+   * @note The slot must be locked.
+   */
+  void prefetch_entry(const Slot* slot, uint64_t hash) {
+    _assert_(slot);
+    if (slot->groups) {
+      __builtin_prefetch(slot->groups + hash % slot->gnum);
+    } else {
+      __builtin_prefetch(slot->buckets + hash % slot->bnum);
+    }
+  }
+  /**
+   * Prefetch the record which the index entry of a key refers to first.
+   * @param slot the slot of the key.
+   * @param hash the hash value of the key.
+   * @note The slot must be locked.  In the tagged index, the first record whose tag matches
+   * in the home group is prefetched.
+   */
+  void prefetch_record(const Slot* slot, uint64_t hash) {
+    _assert_(slot);
+    const Record* rec = NULL;
+    if (slot->groups) {
+      const Group* group = slot->groups + hash % slot->gnum;
+      uint16_t tag = group_tag(hash);
+      for (size_t i = 0; i < GROUPWIDTH; i++) {
+        if (group->tags[i] == tag) {
+          rec = group->recs[i];
+          break;
+        }
+      }
+    } else {
+      rec = slot->buckets[hash % slot->bnum];
+    }
+    if (rec) __builtin_prefetch(rec);
+  }
+  /**
+   * Accept a visitor to a chunk of a batch atomically.
+   * @param bkeys the keys of the chunk, sorted by the slot tables.
+   * @param num the number of the keys.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @param stats the statistics to which the outcomes of the section are added.
+   * @return true on success, or false on failure.
+   */
+  bool accept_chunk(const BulkKey* bkeys, size_t num, Visitor* visitor, bool writable,
+                    TxStats* stats) {
+    _assert_(bkeys && visitor && stats);
+    __transaction_atomic
+#ifdef LOCKING
+    ScopedRWLock lock(&mlock_, false);
+#endif
+#ifdef RTM
+    ScopedElision elision(&elock_, stats);
+#endif
+    {
+    if (omode_ == 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    if (writable && !(omode_ & OWRITER)) {
+      set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+      return false;
+    }
+    size_t beg = 0;
+    while (beg < num) {
+      int32_t sidx = bkeys[beg].sidx;
+      size_t end = beg + 1;
+      while (end < num && bkeys[end].sidx == sidx) {
+        end++;
+      }
+      Slot* slot = slots_ + sidx;
+#ifdef LOCKING
+      slot->lock.lock();
+#endif
+      for (size_t i = beg; i < end; i++) {
+        const BulkKey* bkey = bkeys + i;
+        accept_impl(slot, bkey->hash, bkey->kbuf, bkey->ksiz, visitor, rttmode_);
+      }
+#ifdef LOCKING
+      slot->lock.unlock();
+#endif
+      beg = end;
+    }
+    }
+    return true;
+  }
+  /**
+   * Accept a visitor to records whose values are compressed.
+   * @param bkeys the keys.
+   * @param knum the number of the keys.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @param stats the statistics to which the outcomes of the sections are added.
+   * @param opp the pointer to the variable into which the kind of the last update is assigned.
+   * If it is NULL, it is not used.
+   * @return true on success, or false on failure.
+   * @note A read-only operation copies the values in a section and the visitor sees them
+   * decompressed out of it, so the compressor is not called in an atomic section and the return
+   * value of the visitor is ignored.  A writable operation is performed in one section which
+   * excludes the others, see CacheDB::visit_locked.
+   */
+  bool accept_compressed(const BulkKey* bkeys, size_t knum, Visitor* visitor, bool writable,
+                         TxStats* stats, TxOp* opp) {
+    _assert_(bkeys && knum > 0 && visitor && stats);
+    CompBatch batch(bkeys, knum, stats);
+#ifdef RTM
+    batch.elide = knum <= __atomic_load_n(&bchunk_, __ATOMIC_RELAXED);
+#endif
+    if (!writable) {
+      if (!copy_batch(&batch, false, rttmode_)) return false;
+      for (size_t i = 0; i < knum; i++) {
+        const BulkKey* bkey = bkeys + i;
+        const BulkValue* bval = batch.bvals + i;
+        size_t vsiz;
+        if (!bval->obuf) {
+          visitor->visit_empty(bkey->kbuf, bkey->ksiz, &vsiz);
+          continue;
+        }
+        const char* rvbuf = bval->obuf;
+        size_t rvsiz = bval->osiz;
+        char* zbuf = NULL;
+        size_t zsiz = 0;
+        if (bval->ozip) {
+          zbuf = comp_->decompress(rvbuf, rvsiz, &zsiz);
+          if (zbuf) {
+            rvbuf = zbuf;
+            rvsiz = zsiz;
+          }
+        }
+        visitor->visit_full(bkey->kbuf, bkey->ksiz, rvbuf, rvsiz, &vsiz);
+        delete[] zbuf;
+      }
+      return true;
+    }
+    return visit_locked(&batch, visitor, opp);
+  }
+  /**
+   * Copy the values of a bulk operation on compressed records atomically.
+   * @param batch the operation.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @param rtt whether to move the records to the last.
+   * @return true on success, or false on failure.
+   * @note The values are copied as stored into the buffer of the calling thread, which is
+   * valid until the next call by the same thread.
+   */
+  bool copy_batch(CompBatch* batch, bool writable, bool rtt) {
+    _assert_(batch);
+    size_t scap = RECBUFSIZ;
+    while (true) {
+      char* sbuf = read_buffer(scap);
+      size_t off = 0;
+      bool err = false;
+      __transaction_atomic
+#ifdef LOCKING
+      ScopedRWLock lock(&mlock_, false);
+#endif
+#ifdef RTM
+      ScopedElision elision(&elock_, batch->stats, batch->elide);
+#endif
+      {
+      if (omode_ == 0) {
+        set_error(_KCCODELINE_, Error::INVALID, "not opened");
+        err = true;
+      } else if (writable && !(omode_ & OWRITER)) {
+        set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+        err = true;
+      } else {
+#ifdef LOCKING
+        for (size_t i = 0; i < batch->snum; i++) {
+          slots_[batch->sidxs[i]].lock.lock();
+        }
+#endif
+        for (size_t i = 0; i < batch->knum; i++) {
+          const BulkKey* bkey = batch->bkeys + i;
+          BulkValue* bval = batch->bvals + i;
+          Slot* slot = slots_ + bkey->sidx;
+          const Record* rec = *search_record(slot, bkey->hash, bkey->kbuf, bkey->ksiz);
+          if (!rec) {
+            bval->obuf = NULL;
+            bval->osiz = 0;
+            bval->ozip = false;
+            continue;
+          }
+          bval->obuf = sbuf + off;
+          bval->osiz = rec->vsiz;
+          bval->ozip = rec->ksiz & KSIZCOMP;
+          if (off + bval->osiz <= scap) {
+            mymemcpy(sbuf + off, (const char*)rec + sizeof(*rec) + (rec->ksiz & KSIZMAX),
+                     bval->osiz);
+          }
+          off += bval->osiz;
+          if (rtt) {
+            Visitor visitor;
+            accept_impl(slot, bkey->hash, bkey->kbuf, bkey->ksiz, &visitor, true);
+          }
+        }
+#ifdef LOCKING
+        for (size_t i = 0; i < batch->snum; i++) {
+          slots_[batch->sidxs[i]].lock.unlock();
+        }
+#endif
+      }
+      }
+      if (err) return false;
+      if (off <= scap) return true;
+      scap = off;
+    }
+  }
+  /**
+   * Accept a visitor to the records of a bulk operation on compressed records exclusively.
+   * @param batch the operation.
+   * @param visitor a visitor object.
+   * @param opp the pointer to the variable into which the kind of the last update is assigned.
+   * If it is NULL, it is not used.
+   * @return true on success, or false on failure.
+   * @note Each value is decompressed, given to the visitor and its new value is compressed
+   * and stored, all in the section.  The section is a relaxed transaction, which runs
+   * irrevocably in the tm build, and it holds the lock without elision in the rtm build, so it
+   * is never rolled back and the visitor is called just once for each record.  The visitor
+   * can not be called out of the section instead, because a visitor which accumulates the
+   * values it is given, as DB::increment does, must not be called again if the record is
+   * updated before the new value is stored.
+   */
+  bool visit_locked(CompBatch* batch, Visitor* visitor, TxOp* opp) {
+    _assert_(batch && visitor);
+    bool err = false;
+    __transaction_relaxed
+#ifdef LOCKING
+    ScopedRWLock lock(&mlock_, false);
+#endif
+#ifdef RTM
+    ScopedElision elision(&elock_, batch->stats, false);
+#endif
+    {
+    if (omode_ == 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      err = true;
+    } else {
+#ifdef LOCKING
+      for (size_t i = 0; i < batch->snum; i++) {
+        slots_[batch->sidxs[i]].lock.lock();
+      }
+#endif
+      for (size_t i = 0; i < batch->knum; i++) {
+        const BulkKey* bkey = batch->bkeys + i;
+        BulkValue* bval = batch->bvals + i;
+        Slot* slot = slots_ + bkey->sidx;
+        const Record* rec = *search_record(slot, bkey->hash, bkey->kbuf, bkey->ksiz);
+        delete[] bval->wbuf;
+        if (rec) {
+          const char* rvbuf = (const char*)rec + sizeof(*rec) + (rec->ksiz & KSIZMAX);
+          size_t rvsiz = rec->vsiz;
+          char* zbuf = NULL;
+          size_t zsiz = 0;
+          if (rec->ksiz & KSIZCOMP) {
+            zbuf = comp_->decompress(rvbuf, rvsiz, &zsiz);
+            if (zbuf) {
+              rvbuf = zbuf;
+              rvsiz = zsiz;
+            }
+          }
+          bval->nbuf = visitor->visit_full(bkey->kbuf, bkey->ksiz, rvbuf, rvsiz, &bval->nsiz);
+          encode_value(bval);
+          delete[] zbuf;
+        } else {
+          bval->nbuf = visitor->visit_empty(bkey->kbuf, bkey->ksiz, &bval->nsiz);
+          encode_value(bval);
+        }
+        Setter setter(bval->nbuf, bval->nsiz);
+        TxOp op = accept_impl(slot, bkey->hash, bkey->kbuf, bkey->ksiz, &setter, rttmode_,
+                              bval->nzip);
+        if (opp && op != TXGET) *opp = op;
+      }
+#ifdef LOCKING
+      for (size_t i = 0; i < batch->snum; i++) {
+        slots_[batch->sidxs[i]].lock.unlock();
+      }
+#endif
+    }
+    }
+    return !err;
+  }
+  /**
+   * Take over the new value given by a visitor, compressing it if it is shrunk.
+   * @param bval the value, whose new value has been given by the visitor.
+   * @note The new value is copied or compressed into a region owned by the value, because the
+   * region of the visitor is only valid until its next call.
+   */
+  void encode_value(BulkValue* bval) {
+    _assert_(bval);
+    bval->nzip = false;
+    bval->wbuf = NULL;
+    if (bval->nbuf == Visitor::NOP || bval->nbuf == Visitor::REMOVE) return;
+    size_t zsiz = 0;
+    bval->wbuf = compress_value(bval->nbuf, bval->nsiz, &zsiz);
+    if (bval->wbuf) {
+      bval->nsiz = zsiz;
+      bval->nzip = true;
+    } else {
+      bval->wbuf = new char[bval->nsiz];
+      std::memcpy(bval->wbuf, bval->nbuf, bval->nsiz);
+    }
+    bval->nbuf = bval->wbuf;
+  }
+  /**
+   * Compress a value to be stored.
+   * @param vbuf the pointer to the value region.
+   * @param vsiz the size of the value region.
+   * @param sp the pointer to the variable into which the size of the region of the return
+   * value is assigned.
+   * @return the pointer to the region of the compressed value, which should be released with
+   * the delete[] operator, or NULL if the compression fails or does not shrink the value.
+   */
+  char* compress_value(const char* vbuf, size_t vsiz, size_t* sp) {
+    _assert_(vbuf && vsiz <= MEMMAXSIZ && sp);
+    char* zbuf = comp_->compress(vbuf, vsiz, sp);
+    if (zbuf && *sp >= vsiz) {
+      delete[] zbuf;
+      zbuf = NULL;
+    }
+    return zbuf;
+  }
+  /**
+   * Check whether a record holds a copied value.
+   * @param rec the record.
+   * @param vbuf the pointer to the copied value.
+   * @param vsiz the size of the copied value.
+   * @return true if the record holds the value, or false if not.
+   */
+  bool match_value(const Record* rec, const char* vbuf, size_t vsiz) {
+    _assert_(rec && vbuf && vsiz <= MEMMAXSIZ);
+    const char* rvbuf = (const char*)rec + sizeof(*rec) + (rec->ksiz & KSIZMAX);
+    return compare_keys(rvbuf, rec->vsiz, vbuf, vsiz) == 0;
+  }
+  /**
+   * Copy the records of a slot into a buffer atomically.
+   * @param slot the slot table.
+   * @param buf the buffer, into which each record is written as the sizes of the key and the
+   * value in 32-bit integers followed by the key and the value as stored.  The size of the key
+   * carries CacheDB::KSIZCOMP if the value is compressed.
+   * @param size the size of the buffer.
+   * @return the size of the whole snapshot.  If it is more than the size of the buffer, the
+   * content of the buffer is undefined and the caller should retry with a larger buffer.
+   * @note Nothing is allocated in the section, so it only reads the records and writes the
+   * buffer.  In the rtm build, the lock is acquired without trying a transaction, because a
+   * copy of the whole slot would overflow the transactional buffer.
+   */
+  size_t snapshot_slot(Slot* slot, char* buf, size_t size) {
+    _assert_(slot && buf);
+    size_t off = 0;
+    __transaction_atomic
+#ifdef RTM
+    ScopedElision elision(&elock_, NULL, false);
+#endif
+    {
+#ifdef LOCKING
+    slot->lock.lock();
+#endif
+    for (const Record* rec = slot->first; rec; rec = rec->next) {
+      uint32_t rksiz = rec->ksiz & KSIZMAX;
+      uint32_t rvsiz = rec->vsiz;
+      size_t rsiz = sizeof(rksiz) + sizeof(rvsiz) + rksiz + rvsiz;
+      if (off + rsiz <= size) {
+        char* wp = buf + off;
+        uint32_t fksiz = rec->ksiz & (KSIZMAX | KSIZCOMP);
+        std::memcpy(wp, &fksiz, sizeof(fksiz));
+        wp += sizeof(rksiz);
+        std::memcpy(wp, &rvsiz, sizeof(rvsiz));
+        wp += sizeof(rvsiz);
+        std::memcpy(wp, (const char*)rec + sizeof(*rec), rksiz + rvsiz);
+      }
+      off += rsiz;
+    }
+#ifdef LOCKING
+    slot->lock.unlock();
+#endif
+    }
+    return off;
+  }
+  /**
+   * Adapt the chunk size of batches to the outcome of a section.
+   * @param num the number of the keys accessed in the section.
+   * @param stats the statistics of the section.
+   * @note The size is halved by an overflow of the transactional buffer and grows by one key
+   * by a full chunk committed as a transaction.
+   */
+  void adapt_chunk(size_t num, const TxStats& stats) {
+    _assert_(true);
+    uint32_t chunk = __atomic_load_n(&bchunk_, __ATOMIC_RELAXED);
+    if (stats.capacities > 0) {
+      if (num > chunk) return;
+      chunk = num / 2;
+      if (chunk < 1) chunk = 1;
+    } else if (stats.commits > 0 && num >= chunk && chunk < BULKCHUNKMAX) {
+      chunk++;
+    } else {
+      return;
+    }
+    __atomic_store_n(&bchunk_, chunk, __ATOMIC_RELAXED);
+  }
+  /**
+   * Get the number of records.
+   * @param exact true to merge the counter shards atomically.
+   * @return the number of records, or -1 on failure.
+   */
+  int64_t count_impl(bool exact = false) {
+    _assert_(true);
+    myassert(this->omode_);
+    int64_t cnt, siz;
+    merge_counters(&cnt, &siz, exact);
+    return cnt;
+  }
+  /**
+   * Get the size of the database file.
+   * @param exact true to merge the counter shards atomically.
+   * @return the size of the database file in bytes.
+   */
+  int64_t size_impl(bool exact = false) {
+    _assert_(true);
+    myassert(this->omode_);
+    int64_t cnt, siz;
+    merge_counters(&cnt, &siz, exact);
+    int64_t sum = sizeof(*this) + sizeof(Slot) * slotnum_ +
+        (sizeof(Counter) + sizeof(TxCounter)) * COUNTERNUM + siz;
+    for (int32_t i = 0; i < slotnum_; i++) {
+      sum += (slots_[i].bnum + slots_[i].obnum) * sizeof(Record*) +
+          (slots_[i].gnum + slots_[i].ognum) * sizeof(Group);
+    }
+    return sum;
+  }
+  /**
+   * Initialize a slot table.
+   * @param slot the slot table.
+   * @param bnum the number of buckets.
+   * @param capcnt the capacity of record number.
+   * @param capsiz the capacity of memory usage.
+   */
+  void initialize_slot(Slot* slot, size_t bnum, size_t capcnt, size_t capsiz) {
+    _assert_(slot);
+    new(slot) Slot;
+    Record** buckets = NULL;
+    Group* groups = NULL;
+    size_t gnum = 0;
+    bool bmap = false;
+    if (opts_ & TOPENADDR) {
+      gnum = bnum / GROUPWIDTH + 1;
+      groups = alloc_groups(gnum);
+      bnum = 0;
+    } else if (bnum >= ZMAPBNUM) {
+      buckets = (Record**)mapalloc(sizeof(*buckets) * bnum);
+      bmap = true;
     } else {
-      delete[] slot->buckets;
+      buckets = (Record**)xmalloc(sizeof(*buckets) * bnum);
+      for (size_t i = 0; i < bnum; i++) {
+        buckets[i] = NULL;
+      }
+    }
+    slot->buckets = buckets;
+    slot->bnum = bnum;
+    slot->obuckets = NULL;
+    slot->obnum = 0;
+    slot->mcur = 0;
+    slot->groups = groups;
+    slot->gnum = gnum;
+    slot->ogroups = NULL;
+    slot->ognum = 0;
+    slot->bmap = bmap;
+    slot->curs = NULL;
+    slot->capcnt = capcnt;
+    slot->capsiz = capsiz;
+    slot->first = NULL;
+    slot->last = NULL;
+    slot->count = 0;
+    slot->size = 0;
+    for (size_t i = 0; i < SLABCLASSNUM; i++) {
+      slot->partials[i] = NULL;
+    }
+    slot->slabs = NULL;
+    slot->slabnum = 0;
+    slot->slabcap = 0;
+    slot->spare = NULL;
+    slot->trlogs = NULL;
+#ifdef SEQLOCK
+    slot->seq = 0;
+#endif
+  }
+  /**
+   * Destroy a slot table.
+   * @param slot the slot table.
+   */
+  void destroy_slot(Slot* slot) {
+    _assert_(slot);
+    clear_slot_trlogs(slot);
+    Record* rec = slot->last;
+    while (rec) {
+      Record* prev = rec->prev;
+      if (record_class(sizeof(*rec) + (rec->ksiz & KSIZMAX) + rec->vsiz) >= SLABCLASSNUM)
+        arena_free(rec);
+      rec = prev;
+    }
+    for (size_t i = 0; i < slot->slabnum; i++) {
+      arena_free(slot->slabs[i]);
+    }
+    xfree(slot->slabs);
+    if (slot->groups) {
+      free_groups(slot->groups);
+    } else if (slot->bmap) {
+      mapfree(slot->buckets);
+    } else {
+      xfree(slot->buckets);
     }
+    xfree(slot->obuckets);
+    if (slot->ogroups) free_groups(slot->ogroups);
+    slot->~Slot();
   }
   /**
    * Clear a slot table.
@@ -2170,16 +4398,19 @@ class CacheDB : public BasicDB {
    */
   void clear_slot(Slot* slot) {
     _assert_(slot);
+    int64_t cnt = 0;
+    int64_t siz = 0;
     Record* rec = slot->last;
     while (rec) {
+      cnt++;
+      siz += sizeof(Record) + (rec->ksiz & KSIZMAX) + rec->vsiz;
       if (tran_) {
         uint32_t rksiz = rec->ksiz & KSIZMAX;
         char* dbuf = (char*)rec + sizeof(*rec);
-        TranLog log(dbuf, rksiz, dbuf + rksiz, rec->vsiz);
-        slot->trlogs.push_back(log);
+        log_record(slot, dbuf, rksiz, dbuf + rksiz, rec->vsiz, rec->ksiz & KSIZCOMP);
       }
       Record* prev = rec->prev;
-      xfree(rec);
+      free_record(slot, rec);
       rec = prev;
     }
     Record** buckets = slot->buckets;
@@ -2187,56 +4418,153 @@ class CacheDB : public BasicDB {
     for (size_t i = 0; i < bnum; i++) {
       buckets[i] = NULL;
     }
+    if (slot->obuckets) {
+      release_buckets(slot, slot->obuckets);
+      slot->obuckets = NULL;
+      slot->obnum = 0;
+      slot->mcur = 0;
+    }
+    if (slot->ogroups) {
+      release_groups(slot, slot->ogroups);
+      slot->ogroups = NULL;
+      slot->ognum = 0;
+      slot->mcur = 0;
+    }
+    if (slot->groups) {
+      Group* groups = alloc_groups(slot->gnum);
+      release_groups(slot, slot->groups);
+      slot->groups = groups;
+    }
+    if (hots_) clear_slot_hots(slot);
+    add_counters(slot, -cnt, -siz);
     slot->first = NULL;
     slot->last = NULL;
     slot->count = 0;
     slot->size = 0;
   }
+  /**
+   * Record a transaction log of a slot table.
+   * @param slot the slot table.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param vbuf the pointer to the old value region, or NULL if the record did not exist.
+   * @param vsiz the size of the old value region.
+   * @param zip true if the old value is compressed, or false if not.
+   * @note The log is taken from the arena allocator and linked in place, so that logging
+   * neither calls the heap nor copies anything but the record in an atomic section.
+   */
+  void __attribute__((transaction_safe))
+  log_record(Slot* slot, const char* kbuf, size_t ksiz, const char* vbuf, size_t vsiz,
+             bool zip) {
+    _assert_(slot && kbuf && ksiz <= MEMMAXSIZ && vsiz <= MEMMAXSIZ);
+    TranLog* log = (TranLog*)arena_malloc(sizeof(*log) + ksiz + vsiz);
+    char* wp = (char*)log + sizeof(*log);
+    mymemcpy(wp, kbuf, ksiz);
+    if (vbuf) mymemcpy(wp + ksiz, vbuf, vsiz);
+    log->prev = slot->trlogs;
+    log->ksiz = ksiz;
+    log->vsiz = vbuf ? vsiz : 0;
+    log->full = vbuf != NULL;
+    log->zip = zip;
+    slot->trlogs = log;
+  }
   /**
    * Apply transaction logs of a slot table.
    * @param slot the slot table.
+   * @note The logs are replayed from the newest one.  The logs recorded by the replay are not
+   * replayed and should be released with the others.
    */
-  void apply_slot_trlogs(Slot* slot) {
+  void __attribute__((transaction_safe)) apply_slot_trlogs(Slot* slot) {
     _assert_(slot);
-    const TranLogList& logs = slot->trlogs;
-    TranLogList::const_iterator it = logs.end();
-    TranLogList::const_iterator itbeg = logs.begin();
-    while (it != itbeg) {
-      --it;
-      const char* kbuf = it->key.c_str();
-      size_t ksiz = it->key.size();
-      const char* vbuf = it->value.c_str();
-      size_t vsiz = it->value.size();
-      uint64_t hash = hash_record(kbuf, ksiz) / SLOTNUM;
-      if (it->full) {
-        Setter setter(vbuf, vsiz);
-        accept_impl(slot, hash, kbuf, ksiz, &setter, NULL, false);
+    for (const TranLog* log = slot->trlogs; log; log = log->prev) {
+      const char* kbuf = (const char*)log + sizeof(*log);
+      size_t ksiz = log->ksiz;
+      uint64_t hash = hash_record(kbuf, ksiz) / slotnum_;
+      if (log->full) {
+        Setter setter(kbuf + ksiz, log->vsiz);
+        accept_impl(slot, hash, kbuf, ksiz, &setter, false, log->zip);
       } else {
         Remover remover;
-        accept_impl(slot, hash, kbuf, ksiz, &remover, NULL, false);
+        accept_impl(slot, hash, kbuf, ksiz, &remover, false);
       }
     }
   }
+  /**
+   * Release transaction logs of a slot table.
+   * @param slot the slot table.
+   * @note The logs may have been recorded by other threads.  Such a log is given back to the
+   * arena of its thread by the arena_commit call after the section, see arena_free.
+   */
+  void __attribute__((transaction_safe)) clear_slot_trlogs(Slot* slot) {
+    _assert_(slot);
+    TranLog* log = slot->trlogs;
+    while (log) {
+      TranLog* prev = log->prev;
+      arena_free(log);
+      log = prev;
+    }
+    slot->trlogs = NULL;
+  }
+  /**
+   * Finish the transaction of a slot table.
+   * @param slot the slot table.
+   * @param commit true to commit the transaction, or false to abort the transaction.
+   * @note The slot is rolled back and adjusted to the capacity in an atomic section, so that it
+   * is isolated from the other sections in the tm and rtm builds.
+   */
+  void end_slot_transaction(Slot* slot, bool commit) {
+    _assert_(slot);
+    __transaction_atomic
+#ifdef RTM
+    ScopedElision elision(&elock_, NULL, false);
+#endif
+    {
+    if (!commit) apply_slot_trlogs(slot);
+    clear_slot_trlogs(slot);
+    begin_slot_update(slot);
+    adjust_slot_capacity(slot);
+    end_slot_update(slot);
+    }
+  }
+  /**
+   * Set the flag of the transaction.
+   * @param tran true if in transaction, or false if not.
+   * @note The flag is set in an atomic section, so that the sections of the other threads in
+   * the tm and rtm builds see it consistently with the logs.
+   */
+  void set_transaction(bool tran) {
+    _assert_(true);
+    __transaction_atomic
+#ifdef RTM
+    ScopedElision elision(&elock_, NULL, false);
+#endif
+    {
+    tran_ = tran;
+    }
+  }
   /**
    * Addjust a slot table to the capacity.
    * @param slot the slot table.
+   * @note The least recently used record is unlinked in place rather than by visiting it with
+   * a Remover, so that eviction neither re-enters accept_impl nor copies the key while the
+   * enclosing transaction is running.  In the CLOCK mode, a few records referenced since their
+   * last rotation are given a second chance and rotated to the end first.
    */
-  void adjust_slot_capacity(Slot* slot) {
+  void __attribute__((transaction_safe)) adjust_slot_capacity(Slot* slot) {
     _assert_(slot);
     if ((slot->count > slot->capcnt || slot->size > slot->capsiz) && slot->first) {
-      myassert(false);
-        // make sure we are not trying to evict anything (this  also makes sure slots are not growing
-        // in the worst case.
       Record* rec = slot->first;
+      for (uint32_t i = 0; i < CLOCKSWEEP && (rec->ksiz & KSIZREF) && rec != slot->last; i++) {
+        rec->ksiz &= ~KSIZREF;
+        rotate_record(slot, rec);
+        rec = slot->first;
+      }
       uint32_t rksiz = rec->ksiz & KSIZMAX;
       char* dbuf = (char*)rec + sizeof(*rec);
-      char stack[RECBUFSIZ];
-      char* kbuf = rksiz > sizeof(stack) ? new char[rksiz] : stack;
-      mymemcpy(kbuf, dbuf, rksiz);
-      uint64_t hash = hash_record(kbuf, rksiz) / SLOTNUM;
-      Remover remover;
-      accept_impl(slot, hash, dbuf, rksiz, &remover, NULL, false);
-      if (kbuf != stack) delete[] kbuf;
+      uint64_t hash = hash_record(dbuf, rksiz) / slotnum_;
+      Record** entp = search_record(slot, hash, dbuf, rksiz);
+      if (hots_) drop_hot(slot, hash);
+      remove_record(slot, rec, entp);
     }
   }
   /**
@@ -2273,46 +4601,87 @@ class CacheDB : public BasicDB {
     if (asiz != bsiz) return (int32_t)asiz - (int32_t)bsiz;
     return mymemcmp(abuf, bbuf, asiz);
   }
+  /**
+   * Register a cursor.
+   * @param cur the cursor.
+   */
+  void link_cursor(Cursor* cur) {
+    _assert_(cur);
+    cur->prev_ = NULL;
+    cur->next_ = curs_;
+    if (curs_) curs_->prev_ = cur;
+    curs_ = cur;
+  }
+  /**
+   * Unregister a cursor.
+   * @param cur the cursor, which must not be positioned in any slot.
+   */
+  void unlink_cursor(Cursor* cur) {
+    _assert_(cur && cur->sidx_ < 0);
+    if (cur->prev_) {
+      cur->prev_->next_ = cur->next_;
+    } else {
+      curs_ = cur->next_;
+    }
+    if (cur->next_) cur->next_->prev_ = cur->prev_;
+    cur->prev_ = NULL;
+    cur->next_ = NULL;
+  }
+  /**
+   * Set the position of a cursor.
+   * @param cur the cursor.
+   * @param sidx the index of the slot, or -1 for no position.
+   * @param rec the record, or NULL for no position.
+   * @note The cursor is moved between the lists of the slots, which is only allowed while no
+   * other thread is in an atomic section.
+   */
+  void place_cursor(Cursor* cur, int32_t sidx, Record* rec) {
+    _assert_(cur);
+    if (cur->sidx_ != sidx) {
+      if (cur->sidx_ >= 0) {
+        Slot* slot = slots_ + cur->sidx_;
+        if (cur->sprev_) {
+          cur->sprev_->snext_ = cur->snext_;
+        } else {
+          slot->curs = cur->snext_;
+        }
+        if (cur->snext_) cur->snext_->sprev_ = cur->sprev_;
+        cur->sprev_ = NULL;
+        cur->snext_ = NULL;
+      }
+      if (sidx >= 0) {
+        Slot* slot = slots_ + sidx;
+        cur->snext_ = slot->curs;
+        if (slot->curs) slot->curs->sprev_ = cur;
+        slot->curs = cur;
+      }
+      cur->sidx_ = sidx;
+    }
+    cur->rec_ = rec;
+  }
   /**
    * Escape cursors on a shifted or removed records.
+   * @param slot the slot of the record.
    * @param rec the record.
+   * @note Only the cursors positioned in the slot are scanned.  A cursor escaped from the last
+   * record of the slot stays in the slot without a record until Cursor::settle moves it.
    */
-  void escape_cursors(Record* rec) {
-    _assert_(rec);
-    __transaction_atomic {
-#ifdef LOCKING
-    ScopedMutex lock(&flock_);
-#endif
-
-    if (curs_.empty()) return;
-    CursorList::const_iterator cit = curs_.begin();
-    CursorList::const_iterator citend = curs_.end();
-    while (cit != citend) {
-      Cursor* cur = *cit;
-      if (cur != nullptr && cur->rec_ == rec) cur->step_impl();
-      ++cit;
-    }
+  void __attribute__((transaction_safe)) escape_cursors(Slot* slot, Record* rec) {
+    _assert_(slot && rec);
+    for (Cursor* cur = slot->curs; cur; cur = cur->snext_) {
+      if (cur->rec_ == rec) cur->rec_ = rec->next;
     }
   }
   /**
    * Adjust cursors on re-allocated records.
+   * @param slot the slot of the record.
    * @param orec the old address.
    * @param nrec the new address.
    */
-  void adjust_cursors(Record* orec, Record* nrec) {
-    _assert_(orec && nrec);
-    __transaction_atomic {
-#ifdef LOCKING
-    ScopedMutex lock(&flock_);
-#endif
-    if (curs_.empty()) return;
-    CursorList::const_iterator cit = curs_.begin();
-    CursorList::const_iterator citend = curs_.end();
-    while (cit != citend) {
-      Cursor* cur = *cit;
-      if (cur != nullptr && cur->rec_ == orec) cur->rec_ = nrec;
-      ++cit;
-    }
+  void __attribute__((transaction_safe)) adjust_cursors(Slot* slot, Record* orec, Record* nrec) {
+    _assert_(slot && orec && nrec);
+    for (Cursor* cur = slot->curs; cur; cur = cur->snext_) {
+      if (cur->rec_ == orec) cur->rec_ = nrec;
     }
   }
   /**
@@ -2321,18 +4690,11 @@ class CacheDB : public BasicDB {
   void disable_cursors() {
     _assert_(true);
     __transaction_atomic {
-#ifdef LOCKING
-    ScopedMutex lock(&flock_);
+#ifdef RTM
+    ScopedElision elision(&elock_);
 #endif
-    CursorList::const_iterator cit = curs_.begin();
-    CursorList::const_iterator citend = curs_.end();
-    while (cit != citend) {
-      Cursor* cur = *cit;
-      if (cur != nullptr) {
-       cur->sidx_ = -1;
-       cur->rec_ = NULL;
-      }
-      ++cit;
+    for (Cursor* cur = curs_; cur; cur = cur->next_) {
+      place_cursor(cur, -1, NULL);
     }
     }
   }
@@ -2342,9 +4704,9 @@ class CacheDB : public BasicDB {
   CacheDB& operator =(const CacheDB&);
   /** The method lock. */
   RWLock mlock_;
-#ifdef LOCKING
-  /** The file lock. */
-  Mutex flock_;
+#ifdef RTM
+  /** The lock elided by the atomic sections. */
+  ElidedLock elock_;
 #endif
 
   /** The last happened error. */
@@ -2357,32 +4719,56 @@ class CacheDB : public BasicDB {
   MetaTrigger* mtrigger_;
   /** The open mode. */
   uint32_t omode_;
-  /** The cursor objects. */
-  CursorList curs_;
+  /** The first of the cursor objects. */
+  Cursor* curs_;
   /** The path of the database file. */
   std::string path_;
   /** The database type. */
   uint8_t type_;
   /** The options. */
   uint8_t opts_;
+  /** The number of slot tables. */
+  int32_t slotnum_;
   /** The bucket number. */
   int64_t bnum_;
   /** The capacity of record number. */
   int64_t capcnt_;
   /** The capacity of memory usage. */
   int64_t capsiz_;
+  /** The number of hot-key entries of each slot. */
+  int64_t hotnum_;
   /** The opaque data. */
   char opaque_[OPAQUESIZ];
   /** The embedded data compressor. */
   Compressor* embcomp_;
   /** The data compressor. */
   Compressor* comp_;
-  /** The slot tables. */
-  Slot slots_[SLOTNUM];
+  /** The region of the slot tables and the record counters. */
+  char* slotbuf_;
+  /** The slot tables, aligned to a cache line in the region. */
+  Slot* slots_;
+  /** The shards of the record counters, following the slot tables. */
+  Counter* counters_;
+  /** The shards of the statistics of atomic sections, following the record counters. */
+  TxCounter* txcounters_;
+  /** The region of the hot-key entries. */
+  char* hotbuf_;
+  /** The hot-key entries of all slots, aligned to a cache line in the region, or NULL. */
+  HotEntry* hots_;
+  /** The counters of sampled reads of the hot-key entries. */
+  uint32_t* hotcnts_;
+  /** The number of keys accessed in an atomic section of a batch. */
+  uint32_t bchunk_;
+  /** The flag whether each slot keeps its own record count and size. */
+  bool slotstat_;
   /** The flag whether in LRU rotation. */
   bool rttmode_;
   /** The flag whether in transaction. */
   bool tran_;
+  /** The lock held while in transaction. */
+  AdaptiveMutex trlock_;
+  /** The pool of worker threads for parallel scanning. */
+  ThreadPool scanpool_;
 };
 
 
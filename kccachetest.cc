@@ -177,6 +177,26 @@ public:
     return rtt_;
   }
 
+  bool clock() const {
+    return clock_;
+  }
+
+  bool adaptive() const {
+    return adaptive_;
+  }
+
+  bool openaddr() const {
+    return openaddr_;
+  }
+
+  int64_t slotnum() const {
+    return slotnum_;
+  }
+
+  int retry() const {
+    return retry_;
+  }
+
   int keyrange() const {
     return targetcnt() * 2; // 50 percent chance of hitting a non-existing element
   }
@@ -189,9 +209,27 @@ public:
     return reps_;
   }
 
+  int64_t capcnt() const {
+    return capcnt_;
+  }
+
+  int64_t capsiz() const {
+    return capsiz_;
+  }
+
+  double zipf() const {
+    return zipf_;
+  }
+
+  int64_t hotnum() const {
+    return hotnum_;
+  }
+
   BenchParams() = default;
-  BenchParams(size_t targetcnt, int thnum, size_t kvsize, int readpercent, int durations, bool rtt, int reps)
-  : targetcnt_(targetcnt), thnum_(thnum), kvsize_(kvsize), readpercent_(readpercent), duration_(durations), rtt_(rtt), reps_(reps) {}
+  BenchParams(size_t targetcnt, int thnum, size_t kvsize, int readpercent, int durations, bool rtt, int reps,
+              int64_t capcnt, int64_t capsiz)
+  : targetcnt_(targetcnt), thnum_(thnum), kvsize_(kvsize), readpercent_(readpercent), duration_(durations), rtt_(rtt), reps_(reps),
+    capcnt_(capcnt), capsiz_(capsiz) {}
 
   void print() {
     OUTPUT(targetcnt_);
@@ -200,6 +238,15 @@ public:
     OUTPUT(readpercent_);
     OUTPUT(duration_);
     OUTPUT(rtt_);
+    OUTPUT(clock_);
+    OUTPUT(adaptive_);
+    OUTPUT(openaddr_);
+    OUTPUT(slotnum_);
+    OUTPUT(retry_);
+    OUTPUT(capcnt_);
+    OUTPUT(capsiz_);
+    OUTPUT(zipf_);
+    OUTPUT(hotnum_);
   }
 
   size_t targetcnt_ = 0;
@@ -209,7 +256,17 @@ public:
   int readpercent_ = 0; // between 0 and 100
   int duration_ = 0; // in seconds
   bool rtt_ = false;
+  bool clock_ = false; // lazy (CLOCK) rotation instead of relinking on every access
+  bool adaptive_ = false; // grow the buckets of crowded slots online
+  bool openaddr_ = false; // tagged open addressing index instead of bucket trees
+  int64_t slotnum_ = -1; // number of slots, -1 for the default
+  int retry_ = -1; // attempts of a hardware transaction before the fallback lock (rtm), -1 for the default
   int reps_ = 1;
+  int64_t capcnt_ = -1; // record cap, -1 for unbounded (exercises LRU eviction when set)
+  int64_t capsiz_ = -1; // memory cap, -1 for unbounded
+  double zipf_ = 0; // skew of the Zipfian key distribution between 0 and 1, 0 for uniform keys
+  double zetan_ = 0; // zeta of the key range for the Zipfian distribution, set by procbench
+  int64_t hotnum_ = -1; // hot-key entries of each slot, -1 for none
 };
 
 
@@ -219,6 +276,28 @@ void set_key(char *keybuf, int range, int * seed) {
 }
 
 
+// zeta(n, theta) of the Zipfian distribution, computed once per run
+double zipf_zeta(int range, double theta) {
+  double sum = 0;
+  for (int i = 1; i <= range; i++) sum += 1 / std::pow((double)i, theta);
+  return sum;
+}
+
+
+// Zipfian keys by the method of Gray et al. used by YCSB, the key "0" being the hottest
+void set_key_zipf(char *keybuf, const BenchParams& params, int * seed) {
+  int range = params.keyrange();
+  double theta = params.zipf();
+  double zeta2 = 1 + std::pow(0.5, theta);
+  double alpha = 1 / (1 - theta);
+  double eta = (1 - std::pow(2.0 / range, 1 - theta)) / (1 - zeta2 / params.zetan_);
+  double u = (double)MarsagliaXOR(seed) / 0x80000000;
+  double uz = u * params.zetan_;
+  int rank = uz < 1 ? 0 : uz < zeta2 ? 1 : (int)(range * std::pow(eta * u - eta + 1, alpha));
+  sprintf(keybuf, "%d", rank < range ? rank : range - 1);
+}
+
+
 #define ERR(db)\
     do {\
       dberrprint(db, __LINE__, __FILE__);\
@@ -269,7 +348,11 @@ static void runbench(kc::CacheDB* db, struct BenchParams params, int seed, std::
     while (iters % period != 0 || fl->load() != 1) { // check flag every period
 
       ++iters;
-      set_key(keybuf, params.keyrange(), &seed);
+      if (params.zipf() > 0) {
+        set_key_zipf(keybuf, params, &seed);
+      } else {
+        set_key(keybuf, params.keyrange(), &seed);
+      }
       //printf("%s\n", keybuf);
 
       if (myrandmarsaglia(100, &seed) <= params.readpercent()) { // do a read depending on readpercent
@@ -312,6 +395,17 @@ static void procbench(BenchParams params) {
 
   kc::CacheDB db;
   db.switch_rotation(params.rtt());
+  int8_t opts = 0;
+  if (params.clock()) opts |= kc::CacheDB::TCLOCK;
+  if (params.adaptive()) opts |= kc::CacheDB::TADAPTIVE;
+  if (params.openaddr()) opts |= kc::CacheDB::TOPENADDR;
+  if (opts) db.tune_options(opts);
+  if (params.slotnum() > 0) db.tune_slots(params.slotnum());
+  if (params.retry() >= 0) db.tune_elision(params.retry());
+  if (params.capcnt() > 0) db.cap_count(params.capcnt());
+  if (params.capsiz() > 0) db.cap_size(params.capsiz());
+  if (params.hotnum() > 0) db.tune_hotkeys(params.hotnum());
+  if (params.zipf() > 0) params.zetan_ = zipf_zeta(params.keyrange(), params.zipf());
   uint32_t omode = kc::CacheDB::OWRITER | kc::CacheDB::OCREATE;
   int ropen = db.open("*", omode);
   myassert(ropen);
@@ -476,6 +570,14 @@ static void procbench(BenchParams params) {
   float load_ratio = ((double)output.final_count/bnum_used);
   printf("load_ratio:%.3f\n", load_ratio);
   printf("algo:%s\n", algo);
+  std::map<std::string, std::string> status;
+  if (db.status(&status)) {
+    for (auto it = status.begin(); it != status.end(); ++it) {
+      if ((it->first.compare(0, 4, "rtm_") == 0 ||
+           (it->first.compare(0, 3, "tx_") == 0 && it->second != "0")))
+        printf("%s:%s\n", it->first.c_str(), it->second.c_str());
+    }
+  }
   cout.flush();
   }
   //pthread_exit(0);
@@ -497,6 +599,15 @@ BenchParams parsebench(int argc, char** argv) {
   int durations = 5;
   int reps = 1;
   bool rtt = false;
+  bool clock = false;
+  bool adaptive = false;
+  bool openaddr = false;
+  int64_t slotnum = -1;
+  int retry = -1;
+  int64_t capcnt = -1;
+  int64_t capsiz = -1;
+  double zipf = 0;
+  int64_t hotnum = -1;
   for (int32_t i = 2; i < argc; i++) {
     if (argv[i][0] == '-') {
       if (!std::strcmp(argv[i], "-th")) {
@@ -516,16 +627,49 @@ BenchParams parsebench(int argc, char** argv) {
         durations = kc::atoix(argv[i]);
       } else if (!std::strcmp(argv[i], "-rtt")) { //rtt flag
         rtt = true;
+      } else if (!std::strcmp(argv[i], "-clock")) { //lazy rotation, only meaningful with -rtt
+        clock = true;
+      } else if (!std::strcmp(argv[i], "-adaptive")) { //grow buckets of crowded slots
+        adaptive = true;
+      } else if (!std::strcmp(argv[i], "-openaddr")) { //tagged open addressing index
+        openaddr = true;
+      } else if (!std::strcmp(argv[i], "-slots")) { //number of slots, rounded to a prime
+        if (++i >= argc) usage();
+        slotnum = kc::atoix(argv[i]);
+      } else if (!std::strcmp(argv[i], "-retry")) { //transaction attempts before the fallback lock (rtm)
+        if (++i >= argc) usage();
+        retry = kc::atoix(argv[i]);
       } else if (!std::strcmp(argv[i], "-rep")) { //reps
         if (++i >= argc) usage();
         reps = kc::atoix(argv[i]);
+      } else if (!std::strcmp(argv[i], "-capcnt")) { //records, should be below targetcnt to force eviction
+        if (++i >= argc) usage();
+        capcnt = kc::atoix(argv[i]);
+      } else if (!std::strcmp(argv[i], "-capsiz")) { //bytes
+        if (++i >= argc) usage();
+        capsiz = kc::atoix(argv[i]);
+      } else if (!std::strcmp(argv[i], "-zipf")) { //skew of Zipfian keys, below 1 (0.99 for YCSB)
+        if (++i >= argc) usage();
+        zipf = kc::atof(argv[i]);
+        if (zipf < 0 || zipf >= 1) usage();
+      } else if (!std::strcmp(argv[i], "-hotkeys")) { //hot-key entries of each slot
+        if (++i >= argc) usage();
+        hotnum = kc::atoix(argv[i]);
       } else {
         printf("arg parse error\n");
         exit(1);
     }
   }}
 
-  return BenchParams(targetcnt, thnum, kvsize, readpcnt, durations, rtt, reps);
+  ans = BenchParams(targetcnt, thnum, kvsize, readpcnt, durations, rtt, reps, capcnt, capsiz);
+  ans.clock_ = clock;
+  ans.adaptive_ = adaptive;
+  ans.openaddr_ = openaddr;
+  ans.slotnum_ = slotnum;
+  ans.retry_ = retry;
+  ans.zipf_ = zipf;
+  ans.hotnum_ = hotnum;
+  return ans;
 }
 
 
@@ -580,14 +724,18 @@ static void usage() {
   eprintf("%s: test cases of the cache hash database of Kyoto Cabinet\n", g_progname);
   eprintf("\n");
   eprintf("usage:\n");
-  eprintf("  %s order [-th num] [-rnd] [-etc] [-tran] [-tc] [-bnum num]"
+  eprintf("  %s order [-th num] [-rnd] [-etc] [-tran] [-tc] [-to] [-bnum num]"
           " [-capcnt num] [-capsiz num] [-lv] rnum\n", g_progname);
-  eprintf("  %s queue [-th num] [-it num] [-rnd] [-tc] [-bnum num]"
+  eprintf("  %s queue [-th num] [-it num] [-rnd] [-tc] [-to] [-bnum num]"
           " [-capcnt num] [-capsiz num] [-lv] rnum\n", g_progname);
-  eprintf("  %s wicked [-th num] [-it num] [-tc] [-bnum num]"
+  eprintf("  %s wicked [-th num] [-it num] [-tc] [-to] [-bnum num]"
           " [-capcnt num] [-capsiz num] [-lv] rnum\n", g_progname);
-  eprintf("  %s tran [-th num] [-it num] [-tc] [-bnum num]"
+  eprintf("  %s tran [-th num] [-it num] [-tc] [-to] [-bnum num]"
           " [-capcnt num] [-capsiz num] [-lv] rnum\n", g_progname);
+  eprintf("  %s sanity thnum rnum\n", g_progname);
+  eprintf("  %s bench [-th num] [-targetcnt num] [-kvsize num] [-readpcnt num] [-durations num]"
+          " [-rtt] [-clock] [-adaptive] [-openaddr] [-slots num] [-retry num] [-rep num] [-capcnt num] [-capsiz num]"
+          " [-zipf num] [-hotkeys num]\n", g_progname);
   eprintf("\n");
   std::exit(1);
 }
@@ -632,6 +780,9 @@ static void dbmetaprint(kc::BasicDB* db, bool verbose) {
       if (opts & kc::CacheDB::TSMALL) oprintf(" small");
       if (opts & kc::CacheDB::TLINEAR) oprintf(" linear");
       if (opts & kc::CacheDB::TCOMPRESS) oprintf(" compress");
+      if (opts & kc::CacheDB::TCLOCK) oprintf(" clock");
+      if (opts & kc::CacheDB::TADAPTIVE) oprintf(" adaptive");
+      if (opts & kc::CacheDB::TOPENADDR) oprintf(" openaddr");
       oprintf(" (opts=%d)\n", opts);
       if (status["opaque"].size() >= 16) {
         const char* opaque = status["opaque"].c_str();
@@ -700,6 +851,8 @@ static int32_t runorder(int argc, char** argv) {
         tran = true;
       } else if (!std::strcmp(argv[i], "-tc")) {
         opts |= kc::CacheDB::TCOMPRESS;
+      } else if (!std::strcmp(argv[i], "-to")) {
+        opts |= kc::CacheDB::TOPENADDR;
       } else if (!std::strcmp(argv[i], "-bnum")) {
         if (++i >= argc) usage();
         bnum = kc::atoix(argv[i]);
@@ -756,6 +909,8 @@ static int32_t runqueue(int argc, char** argv) {
         rnd = true;
       } else if (!std::strcmp(argv[i], "-tc")) {
         opts |= kc::CacheDB::TCOMPRESS;
+      } else if (!std::strcmp(argv[i], "-to")) {
+        opts |= kc::CacheDB::TOPENADDR;
       } else if (!std::strcmp(argv[i], "-bnum")) {
         if (++i >= argc) usage();
         bnum = kc::atoix(argv[i]);
@@ -809,6 +964,8 @@ static int32_t runwicked(int argc, char** argv) {
         itnum = kc::atoix(argv[i]);
       } else if (!std::strcmp(argv[i], "-tc")) {
         opts |= kc::CacheDB::TCOMPRESS;
+      } else if (!std::strcmp(argv[i], "-to")) {
+        opts |= kc::CacheDB::TOPENADDR;
       } else if (!std::strcmp(argv[i], "-bnum")) {
         if (++i >= argc) usage();
         bnum = kc::atoix(argv[i]);
@@ -862,6 +1019,8 @@ static int32_t runtran(int argc, char** argv) {
         itnum = kc::atoix(argv[i]);
       } else if (!std::strcmp(argv[i], "-tc")) {
         opts |= kc::CacheDB::TCOMPRESS;
+      } else if (!std::strcmp(argv[i], "-to")) {
+        opts |= kc::CacheDB::TOPENADDR;
       } else if (!std::strcmp(argv[i], "-bnum")) {
         if (++i >= argc) usage();
         bnum = kc::atoix(argv[i]);
@@ -2483,7 +2642,7 @@ static int32_t procwicked(int64_t rnum, int32_t thnum, int32_t itnum,
     oprintf("rnum:%d\n", rnum);
     oprintf("turns:%d\n", k_turns);
     oprintf("threads:%d\n", thnum);
-    oprintf("slotnum:%d\n", db.SLOTNUM);
+    oprintf("slotnum:%d\n", db.slotnum());
     oprintf("time: %.3f\n", time);
     oprintf("throughput: %.3f\n", rnum*k_turns/time);
 
@@ -2569,37 +2728,46 @@ static int32_t proctran(int64_t rnum, int32_t thnum, int32_t itnum,
             vbuf = lbuf_;
             vsiz = myrand(RECBUFSIZL) / (myrand(5) + 1);
           }
+          // the visitor only records the update, which is mirrored out of the atomic section
           class VisitorImpl : public kc::DB::Visitor {
            public:
-            explicit VisitorImpl(const char* vbuf, size_t vsiz, kc::BasicDB* paradb) :
-                vbuf_(vbuf), vsiz_(vsiz), paradb_(paradb) {}
+            explicit VisitorImpl(const char* vbuf, size_t vsiz) :
+                vbuf_(vbuf), vsiz_(vsiz), rv_(NOP), ksiz_(0) {}
+            void mirror(kc::BasicDB* paradb) {
+              if (rv_ == REMOVE) {
+                paradb->remove(kbuf_, ksiz_);
+              } else if (rv_ != NOP) {
+                paradb->set(kbuf_, ksiz_, vbuf_, vsiz_);
+              }
+            }
            private:
             const char* visit_full(const char* kbuf, size_t ksiz,
                                    const char* vbuf, size_t vsiz, size_t* sp) {
               return visit_empty(kbuf, ksiz, sp);
             }
             const char* visit_empty(const char* kbuf, size_t ksiz, size_t* sp) {
-              const char* rv = NOP;
-//              switch (myrand(3)) {
-//                case 0: {
-//                  rv = vbuf_;
-//                  *sp = vsiz_;
-//                  if (paradb_) paradb_->set(kbuf, ksiz, vbuf_, vsiz_);
-//                  break;
-//                }
-//                case 1: {
-//                  rv = REMOVE;
-//                  if (paradb_) paradb_->remove(kbuf, ksiz);
-//                  break;
-//                }
-//              }
-              assert(0);
-              return rv;
+              rv_ = NOP;
+              switch (myrand(3)) {
+                case 0: {
+                  rv_ = vbuf_;
+                  *sp = vsiz_;
+                  break;
+                }
+                case 1: {
+                  rv_ = REMOVE;
+                  break;
+                }
+              }
+              ksiz_ = ksiz < sizeof(kbuf_) ? ksiz : sizeof(kbuf_);
+              std::memcpy(kbuf_, kbuf, ksiz_);
+              return rv_;
             }
             const char* vbuf_;
             size_t vsiz_;
-            kc::BasicDB* paradb_;
-          } visitor(vbuf, vsiz, !tran || commit ? paradb_ : NULL);
+            const char* rv_;
+            char kbuf_[RECBUFSIZ];
+            size_t ksiz_;
+          } visitor(vbuf, vsiz);
           if (myrand(4) == 0) {
             if (!cur->accept(&visitor, true, myrand(2) == 0) &&
                 db_->error() != kc::BasicDB::Error::NOREC) {
@@ -2612,6 +2780,7 @@ static int32_t proctran(int64_t rnum, int32_t thnum, int32_t itnum,
               err_ = true;
             }
           }
+          if (!tran || commit) visitor.mirror(paradb_);
           if (myrand(1000) == 0) {
             ksiz = std::sprintf(kbuf, "%lld", (long long)(myrand(range) + 1));
             if (!cur->jump(kbuf, ksiz)) {
@@ -2650,17 +2819,22 @@ static int32_t proctran(int64_t rnum, int32_t thnum, int32_t itnum,
             }
             class Remover : public kc::DB::Visitor {
              public:
-              explicit Remover(kc::BasicDB* paradb) : paradb_(paradb) {}
+              Remover() : ksiz_(0) {}
+              void mirror(kc::BasicDB* paradb) {
+                if (ksiz_ > 0) paradb->remove(kbuf_, ksiz_);
+                ksiz_ = 0;
+              }
              private:
               const char* visit_full(const char* kbuf, size_t ksiz,
                                      const char* vbuf, size_t vsiz, size_t* sp) {
                 if (myrand(200) == 0) return NOP;
-                assert(0); //TODO
-                //if (paradb_) paradb_->remove(kbuf, ksiz);
+                ksiz_ = ksiz < sizeof(kbuf_) ? ksiz : sizeof(kbuf_);
+                std::memcpy(kbuf_, kbuf, ksiz_);
                 return REMOVE;
               }
-              kc::BasicDB* paradb_;
-            } remover(!tran || commit ? paradb_ : NULL);
+              char kbuf_[RECBUFSIZ];
+              size_t ksiz_;
+            } remover;
             std::vector<std::string>::iterator it = keys.begin();
             std::vector<std::string>::iterator end = keys.end();
             while (it != end) {
@@ -2676,6 +2850,7 @@ static int32_t proctran(int64_t rnum, int32_t thnum, int32_t itnum,
                   err_ = true;
                 }
               }
+              if (!tran || commit) remover.mirror(paradb_);
               ++it;
             }
           }
@@ -2735,49 +2910,52 @@ static int32_t proctran(int64_t rnum, int32_t thnum, int32_t itnum,
       dberrprint(&db, __LINE__, "DB::count");
       err = true;
     }
-    class VisitorImpl : public kc::DB::Visitor {
+    std::map<std::string, std::string> status;
+    if (!db.status(&status) || kc::atoi(status["trlock_acquisitions"].c_str()) < thnum) {
+      dberrprint(&db, __LINE__, "DB::status");
+      err = true;
+    }
+    // the records are checked by cursors, as visitors must not access the other database
+    class Checker {
      public:
-      explicit VisitorImpl(int64_t rnum, kc::BasicDB* paradb) :
-          rnum_(rnum), paradb_(paradb), err_(false), cnt_(0) {}
-      bool error() {
-        return err_;
+      explicit Checker(int64_t rnum, kc::BasicDB* db, kc::BasicDB* paradb) :
+          rnum_(rnum), db_(db), paradb_(paradb) {}
+      bool check() {
+        bool err = false;
+        kc::DB::Cursor* cur = db_->cursor();
+        int64_t cnt = 0;
+        std::string key;
+        if (!cur->jump() && db_->error() != kc::BasicDB::Error::NOREC) {
+          dberrprint(db_, __LINE__, "Cursor::jump");
+          err = true;
+        }
+        while (cur->get_key(&key, true)) {
+          cnt++;
+          size_t rsiz;
+          char* rbuf = paradb_->get(key.data(), key.size(), &rsiz);
+          if (rbuf) {
+            delete[] rbuf;
+          } else {
+            dberrprint(paradb_, __LINE__, "DB::get");
+            err = true;
+          }
+          if (rnum_ > 250 && cnt % (rnum_ / 250) == 0) {
+            oputchar('.');
+            if (cnt == rnum_ || cnt % (rnum_ / 10) == 0) oprintf(" (%08lld)\n", (long long)cnt);
+          }
+        }
+        delete cur;
+        return !err;
       }
      private:
-      const char* visit_full(const char* kbuf, size_t ksiz,
-                             const char* vbuf, size_t vsiz, size_t* sp) {
-//        cnt_++;
-//        size_t rsiz;
-        //char* rbuf = paradb_->get(kbuf, ksiz, &rsiz);
-//        if (rbuf) {
-//          delete[] rbuf;
-//        } else {
-//          dberrprint(paradb_, __LINE__, "DB::get");
-//          err_ = true;
-//        }
-//        if (rnum_ > 250 && cnt_ % (rnum_ / 250) == 0) {
-//          oputchar('.');
-//          if (cnt_ == rnum_ || cnt_ % (rnum_ / 10) == 0) oprintf(" (%08lld)\n", (long long)cnt_);
-//        }
-        assert(0); // FIXME
-        return NOP;
-      }
       int64_t rnum_;
+      kc::BasicDB* db_;
       kc::BasicDB* paradb_;
-      bool err_;
-      int64_t cnt_;
-    } visitor(rnum, &paradb), paravisitor(rnum, &db);
-    if (!db.iterate(&visitor, false)) {
-      dberrprint(&db, __LINE__, "DB::iterate");
-      err = true;
-    }
+    } checker(rnum, &db, &paradb), parachecker(rnum, &paradb, &db);
+    if (!checker.check()) err = true;
     oprintf(" (end)\n");
-    if (visitor.error()) err = true;
-    if (!paradb.iterate(&paravisitor, false)) {
-      dberrprint(&db, __LINE__, "DB::iterate");
-      err = true;
-    }
+    if (!parachecker.check()) err = true;
     oprintf(" (end)\n");
-    if (paravisitor.error()) err = true;
     if (!paradb.close()) {
       dberrprint(&paradb, __LINE__, "DB::close");
       err = true;
@@ -2835,20 +3013,196 @@ static void sanity(kc::CacheDB& db, int id, int rnum) {
     assert((unsigned int)res_raw == secondval.size());
     assert(string(val0, res_raw) == secondval);
 
+    // same through the thread buffer and the string interface
+    size_t vsiz = 0;
+    const char* vview = db.get_view(key.c_str(), key.size(), &vsiz);
+    assert(vview && string(vview, vsiz) == secondval);
+    string sval;
+    assert(db.get(key, &sval) && sval == secondval);
+
     // delete
     int res_del = db.remove(key.c_str(), key.size());
     assert(res_del);
+    assert(!db.get_view(key.c_str(), key.size(), &vsiz));
+
+    // bulk operations spanning several chunks, atomic or not
+    bool atomic = i % 2 == 0;
+    map<string, string> recs;
+    vector<string> keys;
+    for (int j = 0; j < 40; j++) {
+      string bkey = key + "bulk" + to_string(j);
+      recs[bkey] = bkey + "val";
+      keys.push_back(bkey);
+    }
+    assert(db.set_bulk(recs, atomic) == (int64_t)recs.size());
+    map<string, string> got;
+    assert(db.get_bulk(keys, &got, !atomic) == (int64_t)recs.size());
+    assert(got == recs);
+
+    // interleaved lookups into a flat buffer, with a missing key in the middle
+    keys.insert(keys.begin() + keys.size() / 2, key + "nobulk");
+    vector<const char*> kbufs;
+    vector<size_t> ksizs;
+    for (const string& bkey : keys) {
+      kbufs.push_back(bkey.data());
+      ksizs.push_back(bkey.size());
+    }
+    vector<char> obuf(keys.size() * maxsz);
+    vector<int64_t> vsizs(keys.size());
+    assert(db.get_multi(kbufs.data(), ksizs.data(), keys.size(), obuf.data(), obuf.size(),
+                        vsizs.data()) == (int64_t)recs.size());
+    size_t off = 0;
+    for (size_t j = 0; j < keys.size(); j++) {
+      auto rit = recs.find(keys[j]);
+      if (rit == recs.end()) {
+        assert(vsizs[j] == -1);
+        continue;
+      }
+      assert(string(obuf.data() + off, vsizs[j]) == rit->second);
+      off += vsizs[j];
+    }
+    keys.erase(keys.begin() + keys.size() / 2);
+
+    // cursors on the records escape when they are removed
+    vector<kc::CacheDB::Cursor*> curs;
+    for (int j = 0; j < 20; j++) {
+      kc::CacheDB::Cursor* cur = db.cursor();
+      assert(cur->jump(keys[j]));
+      curs.push_back(cur);
+    }
+    assert(db.remove_bulk(keys, atomic) == (int64_t)keys.size());
+    for (int j = 0; j < 20; j++) {
+      string ckey;
+      if (curs[j]->get_key(&ckey, false)) assert(recs.find(ckey) == recs.end());
+      delete curs[j];
+    }
+    got.clear();
+    assert(db.get_bulk(keys, &got, atomic) == 0);
   }
 }
 #endif
 
 static void procsanity(int thnum, int rnum) {
 #ifndef NDEBUG
-  kc::CacheDB db;
-  uint32_t omode = kc::CacheDB::OWRITER | kc::CacheDB::OCREATE;
-  assert(db.open("*", omode));
+  // the second round compresses the values
+  for (int32_t round = 0; round < 2; round++) {
+    kc::CacheDB db;
+    uint32_t omode = kc::CacheDB::OWRITER | kc::CacheDB::OCREATE;
+    if (round > 0) assert(db.tune_options(kc::CacheDB::TCOMPRESS));
+    assert(db.open("*", omode));
+
+    class ThreadSanity : public kc::Thread {
+    public:
+      void setparams(kc::CacheDB *db, int id, int rnum){
+        db_ = db;
+        thid_ = id;
+        rnum_ = rnum;
+      }
+
+      void run() {
+        assert(db_ && rnum_);
+        sanity(*db_, thid_, rnum_);
+        // updates of a shared record are not lost
+        for (int i = 0; i < rnum_; i++) {
+          assert(db_->increment("shared", 1) != kc::INT64MIN);
+        }
+      }
+
+    private:
+      kc::CacheDB* db_ = nullptr;
+      int thid_ = 0;
+      int rnum_ = 0;
+    };
 
-  class ThreadSanity : public kc::Thread {
+    ThreadSanity threads[THREADMAX];
+
+    for (int32_t i = 0; i < thnum; i++) {
+      threads[i].setparams(&db, i, rnum);
+    }
+
+    for (int32_t i = 0; i < thnum; i++) {
+      threads[i].start();
+    }
+
+    for (int32_t i = 0; i < thnum; i++) {
+      threads[i].join();
+    }
+    assert(db.increment("shared", 0) == (int64_t)thnum * rnum);
+    assert(db.remove("shared"));
+
+    // every record is visited once by the parallel scan
+    assert(db.clear());
+    for (int32_t i = 0; i < rnum; i++) {
+      std::string key = std::to_string(i);
+      assert(db.set(key, key));
+    }
+    // each record is counted in its own element, as the visitor must be transaction safe
+    class VisitorCount : public kc::DB::Visitor {
+    public:
+      explicit VisitorCount(int32_t rnum) : cnts(new int32_t[rnum]()), rnum_(rnum) {}
+      ~VisitorCount() {
+        delete[] cnts;
+      }
+      int32_t* cnts;
+    private:
+      const char* visit_full(const char* kbuf, size_t ksiz,
+                             const char* vbuf, size_t vsiz, size_t* sp) {
+        assert(ksiz == vsiz);
+        int32_t num = 0;
+        for (size_t i = 0; i < ksiz; i++) {
+          assert(kbuf[i] == vbuf[i]);
+          num = num * 10 + kbuf[i] - '0';
+        }
+        assert(num < rnum_);
+        cnts[num]++;
+        return NOP;
+      }
+      int32_t rnum_;
+    };
+    // the worker threads are kept between the scans and added for a wider one
+    const int32_t scanthnums[] = { 4, 2, 8 };
+    for (size_t j = 0; j < sizeof(scanthnums) / sizeof(*scanthnums); j++) {
+      VisitorCount counter(rnum);
+      assert(db.scan_parallel(&counter, scanthnums[j]));
+      for (int32_t i = 0; i < rnum; i++) {
+        assert(counter.cnts[i] == 1);
+      }
+    }
+
+    assert(db.close());
+  }
+
+  // records stay reachable while the crowded slots move them to a grown index
+  const int8_t growopts[] = { kc::CacheDB::TADAPTIVE, kc::CacheDB::TOPENADDR };
+  for (size_t j = 0; j < sizeof(growopts) / sizeof(*growopts); j++) {
+    kc::CacheDB db;
+    assert(db.tune_options(growopts[j]));
+    assert(db.tune_slots(1));
+    assert(db.tune_buckets(1));
+    assert(db.open("*", kc::CacheDB::OWRITER | kc::CacheDB::OCREATE));
+    // every third key is removed as soon as the next one is stored
+    int32_t gnum = rnum < 1000 ? 1000 : rnum;
+    for (int32_t i = 0; i < gnum; i++) {
+      assert(db.set(std::to_string(i), std::to_string(i)));
+      if (i % 3 == 2) assert(db.remove(std::to_string(i - 1)));
+    }
+    for (int32_t i = 0; i < gnum; i++) {
+      std::string value;
+      if (i % 3 == 1 && i + 1 < gnum) {
+        assert(!db.get(std::to_string(i), &value));
+      } else {
+        assert(db.get(std::to_string(i), &value) && value == std::to_string(i));
+      }
+    }
+    assert(db.count() == gnum - gnum / 3);
+    assert(db.close());
+  }
+
+  // reads of a replicated hot record see every update and are never torn
+  kc::CacheDB db;
+  assert(db.tune_hotkeys(4));
+  assert(db.open("*", kc::CacheDB::OWRITER | kc::CacheDB::OCREATE));
+  class ThreadHot : public kc::Thread {
   public:
     void setparams(kc::CacheDB *db, int id, int rnum){
       db_ = db;
@@ -2857,8 +3211,22 @@ static void procsanity(int thnum, int rnum) {
     }
 
     void run() {
-      assert(db_ && rnum_);
-      sanity(*db_, thid_, rnum_);
+      char vbuf[64];
+      char rbuf[sizeof(vbuf)];
+      for (int i = 0; i < rnum_; i++) {
+        if (thid_ == 0 && i % 16 == 0) {
+          std::memset(vbuf, 'a' + i / 16 % 26, sizeof(vbuf));
+          assert(db_->set("hot", 3, vbuf, sizeof(vbuf)));
+          assert(db_->get("hot", 3, rbuf, sizeof(rbuf)) == (int32_t)sizeof(rbuf));
+          assert(rbuf[0] == vbuf[0]);
+        }
+        int32_t rsiz = db_->get("hot", 3, rbuf, sizeof(rbuf));
+        if (rsiz < 0) continue;
+        assert(rsiz == (int32_t)sizeof(rbuf));
+        for (size_t j = 1; j < sizeof(rbuf); j++) {
+          assert(rbuf[j] == rbuf[0]);
+        }
+      }
     }
 
   private:
@@ -2866,21 +3234,21 @@ static void procsanity(int thnum, int rnum) {
     int thid_ = 0;
     int rnum_ = 0;
   };
-
-  ThreadSanity threads[THREADMAX];
-
+  ThreadHot hthreads[THREADMAX];
   for (int32_t i = 0; i < thnum; i++) {
-    threads[i].setparams(&db, i, rnum);
+    hthreads[i].setparams(&db, i, rnum);
+    hthreads[i].start();
   }
-
   for (int32_t i = 0; i < thnum; i++) {
-    threads[i].start();
+    hthreads[i].join();
   }
-
-  for (int32_t i = 0; i < thnum; i++) {
-    threads[i].join();
+  // the record is only replicated after dozens of reads of a thread are sampled
+  if (rnum >= 1000) {
+    std::map<std::string, std::string> status;
+    assert(db.status(&status));
+    assert(kc::atoi(status["tx_hot_commits"].c_str()) +
+           kc::atoi(status["tx_hot_fallbacks"].c_str()) > 0);
   }
-
   assert(db.close());
 #endif
 }
@@ -41,6 +41,7 @@ extern "C" {
 #include <exception>
 #include <limits>
 #include <new>
+#include <atomic>
 #include <typeinfo>
 
 #include <utility>
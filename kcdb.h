@@ -121,21 +121,32 @@ class DB {
 
   class PureReadVisitor : public Visitor {
   public:
+    /**
+     * Destructor.
+     * @note The copies made for the pure methods are recycled here, after the operation.
+     */
+    virtual ~PureReadVisitor() {
+      _assert_(true);
+      arena_commit();
+    }
 
     const char*  visit_full(const char* kbuf, size_t ksiz,
           const char* vbuf, size_t vsiz, size_t* sp) {
-      auto buf2 = std::unique_ptr<char[]>(new char[ksiz + vsiz]);
-      auto kbuf2 = buf2.get();
-      auto vbuf2 = buf2.get() + ksiz;
+      char* kbuf2 = (char*)arena_malloc(ksiz + vsiz);
+      char* vbuf2 = kbuf2 + ksiz;
       mymemcpy(kbuf2, kbuf, ksiz);
       mymemcpy(vbuf2, vbuf, vsiz);
-      return pure_visit_full(kbuf2, ksiz, vbuf2, vsiz, sp);
+      const char* rv = pure_visit_full(kbuf2, ksiz, vbuf2, vsiz, sp);
+      arena_free(kbuf2);
+      return rv;
     }
 
     const char*  visit_empty(const char* kbuf, size_t ksiz, size_t* sp) {
-      auto kbuf2 = std::unique_ptr<char[]>(new char[ksiz]);
-      mymemcpy(kbuf2.get(), kbuf, ksiz);
-      return pure_visit_empty(kbuf2.get(), ksiz, sp);
+      char* kbuf2 = (char*)arena_malloc(ksiz);
+      mymemcpy(kbuf2, kbuf, ksiz);
+      const char* rv = pure_visit_empty(kbuf2, ksiz, sp);
+      arena_free(kbuf2);
+      return rv;
     }
 
     virtual const char* __attribute__((transaction_pure))
@@ -1971,16 +1982,37 @@ class BasicDB : public DB {
     class VisitorImpl : public Visitor {
      public:
       explicit VisitorImpl() : vbuf_(NULL), vsiz_(0) {}
+#ifdef __cpp_transactional_memory
+      ~VisitorImpl() {
+        arena_free(vbuf_);
+        arena_commit();
+      }
+      char* pop(size_t* sp) {
+        if (!vbuf_) return NULL;
+        char* vbuf = new char[vsiz_+1];
+        std::memcpy(vbuf, vbuf_, vsiz_);
+        vbuf[vsiz_] = '\0';
+        *sp = vsiz_;
+        return vbuf;
+      }
+#else
       char* pop(size_t* sp) {
         *sp = vsiz_;
         return vbuf_;
       }
+#endif
      private:
       const char* visit_full(const char* kbuf, size_t ksiz,
                              const char* vbuf, size_t vsiz, size_t* sp) {
+        // the tm build stages the value in the arena, which is transaction safe unlike new[]
+#ifdef __cpp_transactional_memory
+        vbuf_ = (char*)arena_malloc(vsiz);
+        mymemcpy(vbuf_, vbuf, vsiz);
+#else
         vbuf_ = new char[vsiz+1];
         mymemcpy(vbuf_, vbuf, vsiz);
         vbuf_[vsiz] = '\0';
+#endif
         vsiz_ = vsiz;
         return NOP;
       }
@@ -2006,34 +2038,70 @@ class BasicDB : public DB {
    * Retrieve the value of a record.
    * @note Equal to the original DB::get method except that the first parameters is the key
    * string and the second parameter is a string to contain the result and the return value is
-   * bool for success.
+   * bool for success.  The value is read through get_view, so the region returned by the
+   * last get_view call of the calling thread is invalidated.
    */
   bool get(const std::string& key, std::string* value) {
     _assert_(value);
-    class VisitorImpl : public PureReadVisitor {
+    size_t vsiz;
+    const char* vbuf = get_view(key.data(), key.size(), &vsiz);
+    if (!vbuf) return false;
+    value->assign(vbuf, vsiz);
+    return true;
+  }
+  /**
+   * Retrieve the value of a record into the buffer of the calling thread.
+   * @param kbuf the pointer to the key region.
+   * @param ksiz the size of the key region.
+   * @param sp the pointer to the variable into which the size of the region of the return
+   * value is assigned.
+   * @return the pointer to the value region in the buffer of the calling thread, or NULL on
+   * failure.
+   * @note If no record corresponds to the key, NULL is returned.  The value is copied once,
+   * within the operation, into the buffer given by arena_buffer, which is one per thread and
+   * shared by all database objects.  So, the region must not be released, and it is valid only
+   * until the same thread calls arena_buffer again, that is, calls this method or the get
+   * method with std::string on this or any other database object.  It is also invalidated when
+   * the thread exits.  Copy the value before any of them if it is used later.  Because an
+   * additional zero code is appended at the end of the region, it can be treated as a C-style
+   * string.
+   */
+  const char* get_view(const char* kbuf, size_t ksiz, size_t* sp) {
+    _assert_(kbuf && ksiz <= MEMMAXSIZ && sp);
+    class VisitorImpl : public Visitor {
      public:
-      explicit VisitorImpl(std::string* value) : value_(value), ok_(false) {}
-      bool ok() {
-        return ok_;
+      explicit VisitorImpl() : vbuf_(NULL), vsiz_(0) {}
+      ~VisitorImpl() {
+        arena_commit();
+      }
+      const char* pop(size_t* sp) {
+        *sp = vsiz_;
+        return vbuf_;
       }
      private:
-      const char* pure_visit_full(const char* kbuf, size_t ksiz,
+      const char* visit_full(const char* kbuf, size_t ksiz,
                              const char* vbuf, size_t vsiz, size_t* sp) {
-        value_->clear();
-        value_->append(vbuf, vsiz);
-        ok_ = true;
+        vbuf_ = arena_buffer(vsiz + 1);
+        mymemcpy(vbuf_, vbuf, vsiz);
+        vbuf_[vsiz] = '\0';
+        vsiz_ = vsiz;
         return NOP;
       }
-      std::string* value_;
-      bool ok_;
+      char* vbuf_;
+      size_t vsiz_;
     };
-    VisitorImpl visitor(value);
-    if (!accept(key.data(), key.size(), &visitor, false)) return false;
-    if (!visitor.ok()) {
+    VisitorImpl visitor;
+    if (!accept(kbuf, ksiz, &visitor, false)) {
+      *sp = 0;
+      return NULL;
+    }
+    const char* vbuf = visitor.pop(sp);
+    if (!vbuf) {
       set_error(_KCCODELINE_, Error::NOREC, "no record");
-      return false;
+      *sp = 0;
+      return NULL;
     }
-    return true;
+    return vbuf;
   }
   /**
    * Retrieve the value of a record.
@@ -2128,16 +2196,36 @@ class BasicDB : public DB {
     class VisitorImpl : public Visitor {
      public:
       explicit VisitorImpl() : vbuf_(NULL), vsiz_(0) {}
+#ifdef __cpp_transactional_memory
+      ~VisitorImpl() {
+        arena_free(vbuf_);
+        arena_commit();
+      }
+      char* pop(size_t* sp) {
+        if (!vbuf_) return NULL;
+        char* vbuf = new char[vsiz_+1];
+        std::memcpy(vbuf, vbuf_, vsiz_);
+        vbuf[vsiz_] = '\0';
+        *sp = vsiz_;
+        return vbuf;
+      }
+#else
       char* pop(size_t* sp) {
         *sp = vsiz_;
         return vbuf_;
       }
+#endif
      private:
       const char* visit_full(const char* kbuf, size_t ksiz,
                              const char* vbuf, size_t vsiz, size_t* sp) {
+#ifdef __cpp_transactional_memory
+        vbuf_ = (char*)arena_malloc(vsiz);
+        mymemcpy(vbuf_, vbuf, vsiz);
+#else
         vbuf_ = new char[vsiz+1];
         mymemcpy(vbuf_, vbuf, vsiz);
         vbuf_[vsiz] = '\0';
+#endif
         vsiz_ = vsiz;
         return REMOVE;
       }
@@ -2192,6 +2280,28 @@ class BasicDB : public DB {
     }
     return true;
   }
+  /**
+   * Accept a visitor to multiple records, each of which is accessed atomically.
+   * @param keys specifies a string vector of the keys.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   * @note Unlike BasicDB::accept_bulk, the records are not accessed atomically as a whole and
+   * the visitor may be called in any order.  The default implementation calls BasicDB::accept
+   * for each key.  To avoid deadlock, any explicit database operation must not be performed in
+   * this function.
+   */
+  virtual bool accept_batch(const std::vector<std::string>& keys, Visitor* visitor,
+                            bool writable = true) {
+    _assert_(visitor);
+    std::vector<std::string>::const_iterator kit = keys.begin();
+    std::vector<std::string>::const_iterator kitend = keys.end();
+    while (kit != kitend) {
+      if (!accept(kit->data(), kit->size(), visitor, writable)) return false;
+      ++kit;
+    }
+    return true;
+  }
   /**
    * Store records at once.
    * @param recs the records to store.
@@ -2200,48 +2310,42 @@ class BasicDB : public DB {
    */
   int64_t set_bulk(const std::map<std::string, std::string>& recs, bool atomic = true) {
     _assert_(true);
-    if (atomic) {
-      std::vector<std::string> keys;
-      keys.reserve(recs.size());
-      std::map<std::string, std::string>::const_iterator rit = recs.begin();
-      std::map<std::string, std::string>::const_iterator ritend = recs.end();
-      while (rit != ritend) {
-        keys.push_back(rit->first);
-        ++rit;
-      }
-      class VisitorImpl : public PureReadVisitor {
-       public:
-        explicit VisitorImpl(const std::map<std::string, std::string>& recs) : recs_(recs) {}
-       private:
-        const char* pure_visit_full(const char* kbuf, size_t ksiz,
-                               const char* vbuf, size_t vsiz, size_t* sp) {
-          std::map<std::string, std::string>::const_iterator rit =
-              recs_.find(std::string(kbuf, ksiz));
-          if (rit == recs_.end()) return NOP;
-          *sp = rit->second.size();
-          return rit->second.data();
-        }
-        const char* pure_visit_empty(const char* kbuf, size_t ksiz, size_t* sp) {
-          std::map<std::string, std::string>::const_iterator rit =
-              recs_.find(std::string(kbuf, ksiz));
-          if (rit == recs_.end()) return NOP;
-          *sp = rit->second.size();
-          return rit->second.data();
-        }
-        const std::map<std::string, std::string>& recs_;
-      };
-      VisitorImpl visitor(recs);
-      if (!accept_bulk(keys, &visitor, true)) return -1;
-      return keys.size();
-    }
+    std::vector<std::string> keys;
+    keys.reserve(recs.size());
     std::map<std::string, std::string>::const_iterator rit = recs.begin();
     std::map<std::string, std::string>::const_iterator ritend = recs.end();
     while (rit != ritend) {
-      if (!set(rit->first.data(), rit->first.size(), rit->second.data(), rit->second.size()))
-        return -1;
+      keys.push_back(rit->first);
       ++rit;
     }
-    return recs.size();
+    class VisitorImpl : public PureReadVisitor {
+     public:
+      explicit VisitorImpl(const std::map<std::string, std::string>& recs) : recs_(recs) {}
+     private:
+      const char* pure_visit_full(const char* kbuf, size_t ksiz,
+                             const char* vbuf, size_t vsiz, size_t* sp) {
+        std::map<std::string, std::string>::const_iterator rit =
+            recs_.find(std::string(kbuf, ksiz));
+        if (rit == recs_.end()) return NOP;
+        *sp = rit->second.size();
+        return rit->second.data();
+      }
+      const char* pure_visit_empty(const char* kbuf, size_t ksiz, size_t* sp) {
+        std::map<std::string, std::string>::const_iterator rit =
+            recs_.find(std::string(kbuf, ksiz));
+        if (rit == recs_.end()) return NOP;
+        *sp = rit->second.size();
+        return rit->second.data();
+      }
+      const std::map<std::string, std::string>& recs_;
+    };
+    VisitorImpl visitor(recs);
+    if (atomic) {
+      if (!accept_bulk(keys, &visitor, true)) return -1;
+    } else {
+      if (!accept_batch(keys, &visitor, true)) return -1;
+    }
+    return keys.size();
   }
   /**
    * Remove records at once.
@@ -2251,37 +2355,27 @@ class BasicDB : public DB {
    */
   int64_t remove_bulk(const std::vector<std::string>& keys, bool atomic = true) {
     _assert_(true);
+    class VisitorImpl : public Visitor {
+     public:
+      explicit VisitorImpl() : cnt_(0) {}
+      int64_t cnt() const {
+        return cnt_;
+      }
+     private:
+      const char* visit_full(const char* kbuf, size_t ksiz,
+                             const char* vbuf, size_t vsiz, size_t* sp) {
+        cnt_++;
+        return REMOVE;
+      }
+      int64_t cnt_;
+    };
+    VisitorImpl visitor;
     if (atomic) {
-      class VisitorImpl : public Visitor {
-       public:
-        explicit VisitorImpl() : cnt_(0) {}
-        int64_t cnt() const {
-          return cnt_;
-        }
-       private:
-        const char* visit_full(const char* kbuf, size_t ksiz,
-                               const char* vbuf, size_t vsiz, size_t* sp) {
-          cnt_++;
-          return REMOVE;
-        }
-        int64_t cnt_;
-      };
-      VisitorImpl visitor;
       if (!accept_bulk(keys, &visitor, true)) return -1;
-      return visitor.cnt();
-    }
-    int64_t cnt = 0;
-    std::vector<std::string>::const_iterator kit = keys.begin();
-    std::vector<std::string>::const_iterator kitend = keys.end();
-    while (kit != kitend) {
-      if (remove(kit->data(), kit->size())) {
-        cnt++;
-      } else if (error() != Error::NOREC) {
-        return -1;
-      }
-      ++kit;
+    } else {
+      if (!accept_batch(keys, &visitor, true)) return -1;
     }
-    return cnt;
+    return visitor.cnt();
   }
   /**
    * Retrieve records at once.
@@ -2293,34 +2387,22 @@ class BasicDB : public DB {
   int64_t get_bulk(const std::vector<std::string>& keys,
                    std::map<std::string, std::string>* recs, bool atomic = true) {
     _assert_(recs);
+    class VisitorImpl : public PureReadVisitor {
+     public:
+      explicit VisitorImpl(std::map<std::string, std::string>* recs) : recs_(recs) {}
+     private:
+      const char* pure_visit_full(const char* kbuf, size_t ksiz,
+                             const char* vbuf, size_t vsiz, size_t* sp) {
+        (*recs_)[std::string(kbuf, ksiz)] = std::string(vbuf, vsiz);
+        return NOP;
+      }
+      std::map<std::string, std::string>* recs_;
+    };
+    VisitorImpl visitor(recs);
     if (atomic) {
-      class VisitorImpl : public PureReadVisitor {
-       public:
-        explicit VisitorImpl(std::map<std::string, std::string>* recs) : recs_(recs) {}
-       private:
-        const char* pure_visit_full(const char* kbuf, size_t ksiz,
-                               const char* vbuf, size_t vsiz, size_t* sp) {
-          (*recs_)[std::string(kbuf, ksiz)] = std::string(vbuf, vsiz);
-          return NOP;
-        }
-        std::map<std::string, std::string>* recs_;
-      };
-      VisitorImpl visitor(recs);
       if (!accept_bulk(keys, &visitor, false)) return -1;
-      return recs->size();
-    }
-    std::vector<std::string>::const_iterator kit = keys.begin();
-    std::vector<std::string>::const_iterator kitend = keys.end();
-    while (kit != kitend) {
-      size_t vsiz;
-      const char* vbuf = get(kit->data(), kit->size(), &vsiz);
-      if (vbuf) {
-        (*recs)[*kit] = std::string(vbuf, vsiz);
-        delete[] vbuf;
-      } else if (error() != Error::NOREC) {
-        return -1;
-      }
-      ++kit;
+    } else {
+      if (!accept_batch(keys, &visitor, false)) return -1;
     }
     return recs->size();
   }
@@ -122,8 +122,6 @@ class HashDB : public BasicDB {
   static const int32_t DFRGCEF = 2;
   /** The checking width for record salvage. */
   static const int64_t SLVGWIDTH = 1LL << 20;
-  /** The threshold of busy loop and sleep for locking. */
-  static const uint32_t LOCKBUSYLOOP = 8192;
  public:
   /**
    * Cursor to indicate a record.
@@ -522,7 +520,7 @@ class HashDB : public BasicDB {
       msiz_(DEFMSIZ), dfunit_(0), embcomp_(ZLIBRAWCOMP),
       align_(0), fbpnum_(0), width_(0), linear_(false),
       comp_(NULL), rhsiz_(0), boff_(0), roff_(0), dfcur_(0), frgcnt_(0),
-      tran_(false), trhard_(false), trfbp_(), trcount_(0), trsize_(0) {
+      tran_(false), trlock_(), scanpool_(), trhard_(false), trfbp_(), trcount_(0), trsize_(0) {
     _assert_(true);
   }
   /**
@@ -939,8 +937,13 @@ class HashDB : public BasicDB {
     }
     report(_KCCODELINE_, Logger::DEBUG, "closing the database (path=%s)", path_.c_str());
     bool err = false;
-    if (tran_ && !abort_transaction()) err = true;
+    if (tran_) {
+      if (!abort_transaction()) err = true;
+      tran_ = false;
+      trlock_.unlock();
+    }
     disable_cursors();
+    scanpool_.stop();
     if (writer_) {
       if (!dump_free_blocks()) err = true;
       if (!dump_meta()) err = true;
@@ -1009,31 +1012,24 @@ class HashDB : public BasicDB {
    */
   bool begin_transaction(bool hard = false) {
     _assert_(true);
-    uint32_t wcnt = 0;
-    while (true) {
-      mlock_.lock_writer();
-      if (omode_ == 0) {
-        set_error(_KCCODELINE_, Error::INVALID, "not opened");
-        mlock_.unlock();
-        return false;
-      }
-      if (!writer_) {
-        set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
-        mlock_.unlock();
-        return false;
-      }
-      if (!tran_) break;
+    trlock_.lock();
+    mlock_.lock_writer();
+    if (omode_ == 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
       mlock_.unlock();
-      if (wcnt >= LOCKBUSYLOOP) {
-        Thread::chill();
-      } else {
-        Thread::yield();
-        wcnt++;
-      }
+      trlock_.unlock();
+      return false;
+    }
+    if (!writer_) {
+      set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+      mlock_.unlock();
+      trlock_.unlock();
+      return false;
     }
     trhard_ = hard;
     if (!begin_transaction_impl()) {
       mlock_.unlock();
+      trlock_.unlock();
       return false;
     }
     tran_ = true;
@@ -1060,7 +1056,7 @@ class HashDB : public BasicDB {
       mlock_.unlock();
       return false;
     }
-    if (tran_) {
+    if (!trlock_.lock_try()) {
       set_error(_KCCODELINE_, Error::LOGIC, "competition avoided");
       mlock_.unlock();
       return false;
@@ -1068,6 +1064,7 @@ class HashDB : public BasicDB {
     trhard_ = hard;
     if (!begin_transaction_impl()) {
       mlock_.unlock();
+      trlock_.unlock();
       return false;
     }
     tran_ = true;
@@ -1098,6 +1095,7 @@ class HashDB : public BasicDB {
       if (!abort_transaction()) err = true;
     }
     tran_ = false;
+    trlock_.unlock();
     trigger_meta(commit ? MetaTrigger::COMMITTRAN : MetaTrigger::ABORTTRAN, "end_transaction");
     return !err;
   }
@@ -1231,6 +1229,7 @@ class HashDB : public BasicDB {
     }
     (*strmap)["count"] = strprintf("%lld", (long long)count_);
     (*strmap)["size"] = strprintf("%lld", (long long)lsiz_);
+    trlock_.status(strmap, "trlock_");
     return true;
   }
   /**
@@ -2355,11 +2354,10 @@ class HashDB : public BasicDB {
         int64_t endoff = i < thnum - 1 ? offs[nidx] : (int64_t)lsiz_;
         ThreadImpl* thread = threads + i;
         thread->init(this, visitor, checker, allcnt, begoff, endoff);
-        thread->start();
       }
+      scanpool_.run(threads, thnum);
       for (size_t i = 0; i < thnum; i++) {
         ThreadImpl* thread = threads + i;
-        thread->join();
         if (thread->error() != Error::SUCCESS) {
           *error_ = thread->error();
           err = true;
@@ -3843,6 +3841,10 @@ class HashDB : public BasicDB {
   AtomicInt64 frgcnt_;
   /** The flag whether in transaction. */
   bool tran_;
+  /** The lock held while in transaction. */
+  AdaptiveMutex trlock_;
+  /** The pool of worker threads for parallel scanning. */
+  ThreadPool scanpool_;
   /** The flag whether hard transaction. */
   bool trhard_;
   /** The escaped free block pool for transaction. */
@@ -109,8 +109,6 @@ class PlantDB : public BasicDB {
   static const int32_t LEVELMAX = 16;
   /** The number of cached nodes for auto transaction. */
   static const int32_t ATRANCNUM = 256;
-  /** The threshold of busy loop and sleep for locking. */
-  static const uint32_t LOCKBUSYLOOP = 8192;
  public:
   /**
    * Cursor to indicate a record.
@@ -1008,7 +1006,7 @@ class PlantDB : public BasicDB {
       psiz_(DEFPSIZ), pccap_(DEFPCCAP),
       root_(0), first_(0), last_(0), lcnt_(0), icnt_(0), count_(0), cusage_(0),
       lslots_(), islots_(), reccomp_(), linkcomp_(),
-      tran_(false), trclock_(0), trlcnt_(0), trcount_(0) {
+      tran_(false), trlock_(), trclock_(0), trlcnt_(0), trcount_(0) {
     _assert_(true);
   }
   /**
@@ -1623,6 +1621,10 @@ class PlantDB : public BasicDB {
     delete_leaf_cache();
     if (writer_ && !dump_meta()) err = true;
     if (!db_.close()) err = true;
+    if (tran_) {
+      tran_ = false;
+      trlock_.unlock();
+    }
     omode_ = 0;
     trigger_meta(MetaTrigger::CLOSE, "close");
     return !err;
@@ -1726,30 +1728,23 @@ class PlantDB : public BasicDB {
    */
   bool begin_transaction(bool hard = false) {
     _assert_(true);
-    uint32_t wcnt = 0;
-    while (true) {
-      mlock_.lock_writer();
-      if (omode_ == 0) {
-        set_error(_KCCODELINE_, Error::INVALID, "not opened");
-        mlock_.unlock();
-        return false;
-      }
-      if (!writer_) {
-        set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
-        mlock_.unlock();
-        return false;
-      }
-      if (!tran_) break;
+    trlock_.lock();
+    mlock_.lock_writer();
+    if (omode_ == 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
       mlock_.unlock();
-      if (wcnt >= LOCKBUSYLOOP) {
-        Thread::chill();
-      } else {
-        Thread::yield();
-        wcnt++;
-      }
+      trlock_.unlock();
+      return false;
+    }
+    if (!writer_) {
+      set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+      mlock_.unlock();
+      trlock_.unlock();
+      return false;
     }
     if (!begin_transaction_impl(hard)) {
       mlock_.unlock();
+      trlock_.unlock();
       return false;
     }
     tran_ = true;
@@ -1776,13 +1771,14 @@ class PlantDB : public BasicDB {
       mlock_.unlock();
       return false;
     }
-    if (tran_) {
+    if (!trlock_.lock_try()) {
       set_error(_KCCODELINE_, Error::LOGIC, "competition avoided");
       mlock_.unlock();
       return false;
     }
     if (!begin_transaction_impl(hard)) {
       mlock_.unlock();
+      trlock_.unlock();
       return false;
     }
     tran_ = true;
@@ -1813,6 +1809,7 @@ class PlantDB : public BasicDB {
       if (!abort_transaction()) err = true;
     }
     tran_ = false;
+    trlock_.unlock();
     trigger_meta(commit ? MetaTrigger::COMMITTRAN : MetaTrigger::ABORTTRAN, "end_transaction");
     return !err;
   }
@@ -1941,6 +1938,7 @@ class PlantDB : public BasicDB {
       search_tree(&link, false, hist, &hnum);
       (*strmap)["tree_level"] = strprintf("%d", hnum + 1);
     }
+    trlock_.status(strmap, "trlock_");
     return true;
   }
   /**
@@ -3927,6 +3925,8 @@ class PlantDB : public BasicDB {
   LinkComparator linkcomp_;
   /** The flag whether in transaction. */
   bool tran_;
+  /** The lock held while in transaction. */
+  AdaptiveMutex trlock_;
   /** The logical clock for transaction. */
   int64_t trclock_;
   /** The leaf count history for transaction. */
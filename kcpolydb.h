@@ -305,6 +305,25 @@ class PolyDB : public BasicDB {
     }
     return db_->accept_bulk(keys, visitor, writable);
   }
+  /**
+   * Accept a visitor to multiple records, each of which is accessed atomically.
+   * @param keys specifies a string vector of the keys.
+   * @param visitor a visitor object.
+   * @param writable true for writable operation, or false for read-only operation.
+   * @return true on success, or false on failure.
+   * @note The records are not accessed atomically as a whole and the visitor may be called in
+   * any order.  To avoid deadlock, any explicit database operation must not be performed in
+   * this function.
+   */
+  bool accept_batch(const std::vector<std::string>& keys, Visitor* visitor,
+                    bool writable = true) {
+    _assert_(visitor);
+    if (type_ == TYPEVOID) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
+      return false;
+    }
+    return db_->accept_batch(keys, visitor, writable);
+  }
   /**
    * Iterate to accept a visitor for each record.
    * @param visitor a visitor object.
@@ -395,9 +414,9 @@ class PolyDB : public BasicDB {
    * "kcd", kcf", and "kcx".  All database types support the logging parameters of "log",
    * "logkinds", and "logpx".  The prototype hash database and the prototype tree database do
    * not support any other tuning parameter.  The stash database supports "bnum".  The cache
-   * hash database supports "opts", "bnum", "zcomp", "capcnt", "capsiz", and "zkey".  The cache
-   * tree database supports all parameters of the cache hash database except for capacity
-   * limitation, and supports "psiz", "rcomp", "pccap" in addition.  The file hash database
+   * hash database supports "opts", "bnum", "slots", "zcomp", "capcnt", "capsiz", and "zkey".
+   * The cache tree database supports all parameters of the cache hash database except for
+   * capacity limitation, and supports "psiz", "rcomp", "pccap" in addition.  The file hash database
    * supports "apow", "fpow", "opts", "bnum", "msiz", "dfunit", "zcomp", and "zkey".  The file
    * tree database supports all parameters of the file hash database and "psiz", "rcomp",
    * "pccap" in addition.  The directory hash database supports "opts", "zcomp", and "zkey".
@@ -420,20 +439,22 @@ class PolyDB : public BasicDB {
    * the path of the log file, or "-" for the standard output, or "+" for the standard error.
    * "logkinds" specifies kinds of logged messages and the value can be "debug", "info", "warn",
    * or "error".  "logpx" specifies the prefix of each log message.  "opts" is for "tune_options"
-   * and the value can contain "s" for the small option, "l" for the linear option, and "c" for
-   * the compress option.  "bnum" corresponds to "tune_bucket".  "zcomp" is for "tune_compressor"
-   * and the value can be "zlib" for the ZLIB raw compressor, "def" for the ZLIB deflate
-   * compressor, "gz" for the ZLIB gzip compressor, "lzo" for the LZO compressor, "lzma" for the
-   * LZMA compressor, or "arc" for the Arcfour cipher.  "zkey" specifies the cipher key of the
-   * compressor.  "capcnt" is for "cap_count".  "capsiz" is for "cap_size".  "psiz" is for
-   * "tune_page".  "rcomp" is for "tune_comparator" and the value can be "lex" for the lexical
-   * comparator, "dec" for the decimal comparator, "lexdesc" for the lexical descending
+   * and the value can contain "s" for the small option, "l" for the linear option, "c" for
+   * the compress option, and "k" for the CLOCK rotation option, "a" for the adaptive bucket
+   * option, and "o" for the open addressing option of the cache hash database.  "bnum"
+   * corresponds to "tune_bucket".  "slots" is for "tune_slots" of the cache hash database.
+   * "zcomp" is for "tune_compressor" and the value can be "zlib" for the ZLIB raw compressor,
+   * "def" for the ZLIB deflate compressor, "gz" for the ZLIB gzip compressor, "lzo" for the LZO
+   * compressor, "lzma" for the LZMA compressor, or "arc" for the Arcfour cipher.  "zkey" specifies
+   * the cipher key of the compressor.  "capcnt" is for "cap_count".  "capsiz" is for "cap_size".
+   * "psiz" is for "tune_page".  "rcomp" is for "tune_comparator" and the value can be "lex" for
+   * the lexical comparator, "dec" for the decimal comparator, "lexdesc" for the lexical descending
    * comparator, or "decdesc" for the decimal descending comparator.  "pccap" is for
-   * "tune_page_cache".  "apow" is for "tune_alignment".  "fpow" is for "tune_fbp".  "msiz" is
-   * for "tune_map".  "dfunit" is for "tune_defrag".  Every opened database must be closed by
-   * the PolyDB::close method when it is no longer in use.  It is not allowed for two or more
-   * database objects in the same process to keep their connections to the same database file at
-   * the same time.
+   * "tune_page_cache".  "apow" is for "tune_alignment".  "fpow" is for "tune_fbp".  "msiz" is for
+   * "tune_map".  "dfunit" is for "tune_defrag".  Every opened database must be closed by the
+   * PolyDB::close method when it is no longer in use.  It is not allowed for two or more database
+   * objects in the same process to keep their connections to the same database file at the same
+   * time.
    */
   bool open(const std::string& path = ":", uint32_t mode = OWRITER | OCREATE) {
     _assert_(true);
@@ -456,6 +477,7 @@ class PolyDB : public BasicDB {
     std::string mtrgname = "";
     std::string mtrgpx = "";
     int64_t bnum = -1;
+    int64_t slotnum = -1;
     int64_t capcnt = -1;
     int64_t capsiz = -1;
     int32_t apow = -1;
@@ -463,6 +485,9 @@ class PolyDB : public BasicDB {
     bool tsmall = false;
     bool tlinear = false;
     bool tcompress = false;
+    bool tclock = false;
+    bool tadaptive = false;
+    bool topenaddr = false;
     int64_t msiz = -1;
     int64_t dfunit = -1;
     std::string zcompname = "";
@@ -578,6 +603,8 @@ class PolyDB : public BasicDB {
           mtrgpx = value;
         } else if (!std::strcmp(key, "bnum") || !std::strcmp(key, "buckets")) {
           bnum = atoix(value);
+        } else if (!std::strcmp(key, "slots") || !std::strcmp(key, "slotnum")) {
+          slotnum = atoix(value);
         } else if (!std::strcmp(key, "capcnt") || !std::strcmp(key, "capcount") ||
                    !std::strcmp(key, "cap_count")) {
           capcnt = atoix(value);
@@ -592,6 +619,9 @@ class PolyDB : public BasicDB {
           if (std::strchr(value, 's')) tsmall = true;
           if (std::strchr(value, 'l')) tlinear = true;
           if (std::strchr(value, 'c')) tcompress = true;
+          if (std::strchr(value, 'k')) tclock = true;
+          if (std::strchr(value, 'a')) tadaptive = true;
+          if (std::strchr(value, 'o')) topenaddr = true;
         } else if (!std::strcmp(key, "msiz") || !std::strcmp(key, "map")) {
           msiz = atoix(value);
         } else if (!std::strcmp(key, "dfunit") || !std::strcmp(key, "defrag")) {
@@ -751,6 +781,9 @@ class PolyDB : public BasicDB {
       case TYPECACHE: {
         int8_t opts = 0;
         if (tcompress) opts |= CacheDB::TCOMPRESS;
+        if (tclock) opts |= CacheDB::TCLOCK;
+        if (tadaptive) opts |= CacheDB::TADAPTIVE;
+        if (topenaddr) opts |= CacheDB::TOPENADDR;
         CacheDB* cdb = new CacheDB();
         if (stdlogger_) {
           cdb->tune_logger(stdlogger_, logkinds);
@@ -764,6 +797,7 @@ class PolyDB : public BasicDB {
         }
         if (opts > 0) cdb->tune_options(opts);
         if (bnum > 0) cdb->tune_buckets(bnum);
+        if (slotnum > 0) cdb->tune_slots(slotnum);
         if (zcomp_) cdb->tune_compressor(zcomp_);
         if (capcnt > 0) cdb->cap_count(capcnt);
         if (capsiz > 0) cdb->cap_size(capsiz);
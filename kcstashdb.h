@@ -60,8 +60,6 @@ class StashDB : public BasicDB {
   static const size_t DEFBNUM = 1048583LL;
   /** The size of the opaque buffer. */
   static const size_t OPAQUESIZ = 16;
-  /** The threshold of busy loop and sleep for locking. */
-  static const uint32_t LOCKBUSYLOOP = 8192;
   /** The mininum number of buckets to use mmap. */
   static const size_t MAPZMAPBNUM = 32768;
  public:
@@ -314,7 +312,7 @@ class StashDB : public BasicDB {
       logger_(NULL), logkinds_(0), mtrigger_(NULL),
       omode_(0), curs_(), path_(""), bnum_(DEFBNUM), opaque_(),
       count_(0), size_(0), buckets_(NULL),
-      tran_(false), trlogs_(), trcount_(0), trsize_(0) {
+      tran_(false), trlock_(), scanpool_(), trlogs_(), trcount_(0), trsize_(0) {
     _assert_(true);
   }
   /**
@@ -571,11 +569,10 @@ class StashDB : public BasicDB {
       if (i >= thnum - 1) nidx = bnum_;
       ThreadImpl* thread = threads + i;
       thread->init(this, visitor, checker, allcnt, cidx, nidx);
-      thread->start();
     }
+    scanpool_.run(threads, thnum);
     for (size_t i = 0; i < thnum; i++) {
       ThreadImpl* thread = threads + i;
-      thread->join();
       if (thread->error() != Error::SUCCESS) {
         *error_ = thread->error();
         err = true;
@@ -671,7 +668,9 @@ class StashDB : public BasicDB {
       return false;
     }
     report(_KCCODELINE_, Logger::DEBUG, "closing the database (path=%s)", path_.c_str());
+    if (tran_) trlock_.unlock();
     tran_ = false;
+    scanpool_.stop();
     trlogs_.clear();
     for (size_t i = 0; i < bnum_; i++) {
       char* rbuf = buckets_[i];
@@ -758,27 +757,19 @@ class StashDB : public BasicDB {
    */
   bool begin_transaction(bool hard = false) {
     _assert_(true);
-    uint32_t wcnt = 0;
-    while (true) {
-      mlock_.lock_writer();
-      if (omode_ == 0) {
-        set_error(_KCCODELINE_, Error::INVALID, "not opened");
-        mlock_.unlock();
-        return false;
-      }
-      if (!(omode_ & OWRITER)) {
-        set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
-        mlock_.unlock();
-        return false;
-      }
-      if (!tran_) break;
+    trlock_.lock();
+    mlock_.lock_writer();
+    if (omode_ == 0) {
+      set_error(_KCCODELINE_, Error::INVALID, "not opened");
       mlock_.unlock();
-      if (wcnt >= LOCKBUSYLOOP) {
-        Thread::chill();
-      } else {
-        Thread::yield();
-        wcnt++;
-      }
+      trlock_.unlock();
+      return false;
+    }
+    if (!(omode_ & OWRITER)) {
+      set_error(_KCCODELINE_, Error::NOPERM, "permission denied");
+      mlock_.unlock();
+      trlock_.unlock();
+      return false;
     }
     tran_ = true;
     trcount_ = count_;
@@ -806,7 +797,7 @@ class StashDB : public BasicDB {
       mlock_.unlock();
       return false;
     }
-    if (tran_) {
+    if (!trlock_.lock_try()) {
       set_error(_KCCODELINE_, Error::LOGIC, "competition avoided");
       mlock_.unlock();
       return false;
@@ -842,6 +833,7 @@ class StashDB : public BasicDB {
     }
     trlogs_.clear();
     tran_ = false;
+    trlock_.unlock();
     trigger_meta(commit ? MetaTrigger::COMMITTRAN : MetaTrigger::ABORTTRAN, "end_transaction");
     return true;
   }
@@ -940,6 +932,7 @@ class StashDB : public BasicDB {
     }
     (*strmap)["count"] = strprintf("%lld", (long long)count_);
     (*strmap)["size"] = strprintf("%lld", (long long)size_impl());
+    trlock_.status(strmap, "trlock_");
     return true;
   }
   /**
@@ -1466,6 +1459,10 @@ class StashDB : public BasicDB {
   char** buckets_;
   /** The flag whether in transaction. */
   bool tran_;
+  /** The lock held while in transaction. */
+  AdaptiveMutex trlock_;
+  /** The pool of worker threads for parallel scanning. */
+  ThreadPool scanpool_;
   /** The list of transaction logs. */
   TranLogList trlogs_;
   /** The count history for transaction. */
@@ -13,7 +13,6 @@
  *************************************************************************************************/
 
 
-#include "atomics.h"
 #include "kcthread.h"
 #include "myconf.h"
 //#include "rlu-ml.h"
@@ -28,22 +27,81 @@ namespace kyotocabinet {                 // common namespace
  */
 namespace {
 const uint32_t LOCKBUSYLOOP = 81920000;      ///< threshold of busy loop and sleep for locking
-const size_t LOCKSEMNUM = 256;           ///< number of semaphores for locking
+const size_t EPOCHBATCH = 64;            ///< number of retired regions to try reclamation
+const uint32_t QUEUESPINLOOP = 64;       ///< threshold of spinning and yielding in queue locks
+const int32_t ADAPTIVESPINMIN = 16;      ///< minimum length of spinning in adaptive locks
+const int32_t ADAPTIVESPINMAX = 4096;    ///< maximum length of spinning in adaptive locks
+const size_t RWLOCKSTRIPENUM = 256;      ///< number of stripes of the visible readers
+const size_t RWLOCKSTRIPEWAY = 8;        ///< number of visible readers in a stripe
+const size_t RWLOCKHELDMAX = 16;         ///< maximum number of fast reader locks of a thread
+const int64_t RWLOCKINHIBIT = 9;         ///< ratio of the inhibition to the revocation time
 }
 
-volatile long padding0[16];
-__thread int rwlock_is_writer = 0;;
-__thread int rwlock_nesting = 0;;
+/**
+ * Tell the processor that the thread is spinning.
+ */
+static void cpurelax() {
+#if defined(_SYS_MSVC_)
+  ::YieldProcessor();
+#elif defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield" ::: "memory");
+#elif defined(__powerpc__) || defined(__PPC64__)
+  __asm__ __volatile__("or 27,27,27" ::: "memory");
+#endif
+}
+
+
+/**
+ * Get the monotonic time in nanoseconds.
+ */
+static int64_t monoclock() {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  ::LARGE_INTEGER cnt, freq;
+  ::QueryPerformanceCounter(&cnt);
+  ::QueryPerformanceFrequency(&freq);
+  return (int64_t)((double)cnt.QuadPart * 1000000000 / freq.QuadPart);
+#else
+  struct ::timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+
+/**
+ * Allocate a region aligned to a cache line.
+ * @param size the size of the region.
+ * @return the pointer to the region, which should be released with alignedfree.
+ * @note The objects aligned to a cache line are constructed in it with placement new, because
+ * the plain new operator does not honor the extended alignment before C++17.
+ */
+static void* alignedmalloc(size_t size) {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  void* ptr = ::_aligned_malloc(size, 64);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+#else
+  void* ptr;
+  if (::posix_memalign(&ptr, 64, size) != 0) throw std::bad_alloc();
+  return ptr;
+#endif
+}
+
+
+/**
+ * Release a region allocated by alignedmalloc.
+ * @param ptr the pointer to the region.
+ */
+static void alignedfree(void* ptr) {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  ::_aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
 
-volatile long padding1[16];
-volatile long g_rwlock_inside = 0;
-volatile long padding2[16];
-volatile long g_rwlock_outside = 0;
-volatile long padding3[16];
-volatile long g_rwlock_writer_lock = 0;
-volatile long padding4[16];
-volatile long g_rwlock_stop_readers = 0;
-volatile long padding5[16];
 
 /**
  * Thread internal.
@@ -636,248 +694,735 @@ void SlottedMutex::unlock_all() {
 
 
 /**
- * Default constructor.
+ * Waiting node of QueueMutex.
  */
-SpinLock::SpinLock() : opq_(NULL) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  _assert_(true);
-#elif _KC_GCCATOMIC
-  _assert_(true);
-#else
-  _assert_(true);
-  ::pthread_spinlock_t* spin = new ::pthread_spinlock_t;
-  if (::pthread_spin_init(spin, PTHREAD_PROCESS_PRIVATE) != 0)
-    throw std::runtime_error("pthread_spin_init");
-  opq_ = (void*)spin;
-#endif
+struct QueueMutexNode {
+  std::atomic<QueueMutexNode*> next;     ///< next waiter
+  std::atomic<int32_t> wait;             ///< whether to wait for the predecessor
+  QueueMutexNode* link;                  ///< next free node of the owner thread
+} __attribute__((aligned(64)));
+
+
+/**
+ * QueueMutex internal.
+ * @note The node of the holder is kept in the lock so that the interface does not take one.
+ */
+struct QueueMutexCore {
+  std::atomic<QueueMutexNode*> tail;     ///< last waiter
+  QueueMutexNode* holder;                ///< node of the holder
+};
+
+
+/**
+ * Free nodes of QueueMutex of a thread.
+ * @note A node is free again as soon as the lock is released, since only the successor refers
+ * to it while the lock is held.
+ */
+struct QueueMutexThread {
+  QueueMutexNode* free;                  ///< free nodes
+  /** destructor */
+  ~QueueMutexThread() {
+    while (free) {
+      QueueMutexNode* node = free;
+      free = node->link;
+      node->~QueueMutexNode();
+      alignedfree(node);
+    }
+  }
+};
+
+
+/**
+ * Get the free nodes of QueueMutex of the calling thread.
+ */
+static QueueMutexThread* queuemutexthread() {
+  static thread_local QueueMutexThread state = { NULL };
+  return &state;
 }
 
 
 /**
- * Destructor.
+ * Take a free node of QueueMutex.
+ * @return the node.
  */
-SpinLock::~SpinLock() {
+static QueueMutexNode* queuemutexnode() {
+  QueueMutexThread* state = queuemutexthread();
+  QueueMutexNode* node = state->free;
+  if (node) {
+    state->free = node->link;
+  } else {
+    node = new(alignedmalloc(sizeof(*node))) QueueMutexNode;
+  }
+  node->next.store(NULL, std::memory_order_relaxed);
+  node->wait.store(1, std::memory_order_relaxed);
+  return node;
+}
+
+
+/**
+ * Return a node of QueueMutex.
+ * @param node the node.
+ */
+static void queuemutexfree(QueueMutexNode* node) {
+  QueueMutexThread* state = queuemutexthread();
+  node->link = state->free;
+  state->free = node;
+}
+
+
+/**
+ * Get the lock of QueueMutex.
+ * @param core the internal fields.
+ * @note The waiter yields the processor by itself since the lock is handed over to it alone
+ * and Thread::yield does nothing on some platforms.
+ */
+static void queuemutexlock(QueueMutexCore* core) {
+  _assert_(core);
+  QueueMutexNode* node = queuemutexnode();
+  QueueMutexNode* pred = core->tail.exchange(node, std::memory_order_acq_rel);
+  if (pred) {
+    pred->next.store(node, std::memory_order_release);
+    uint32_t wcnt = 0;
+    while (node->wait.load(std::memory_order_acquire)) {
+      if (wcnt >= QUEUESPINLOOP) {
 #if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  _assert_(true);
-#elif _KC_GCCATOMIC
-  _assert_(true);
+        ::Sleep(0);
 #else
-  _assert_(true);
-  ::pthread_spinlock_t* spin = (::pthread_spinlock_t*)opq_;
-  ::pthread_spin_destroy(spin);
-  delete spin;
+        ::sched_yield();
 #endif
+      } else {
+        cpurelax();
+        wcnt++;
+      }
+    }
+  }
+  core->holder = node;
 }
 
 
 /**
- * Get the lock.
+ * Try to get the lock of QueueMutex.
+ * @param core the internal fields.
+ * @return true on success, or false on failure.
  */
-void SpinLock::lock() {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  _assert_(true);
-  uint32_t wcnt = 0;
-  while (::InterlockedCompareExchange((LONG*)&opq_, 1, 0) != 0) {
-    if (wcnt >= LOCKBUSYLOOP) {
-      Thread::chill();
-    } else {
-      Thread::yield();
-      wcnt++;
-    }
+static bool queuemutextry(QueueMutexCore* core) {
+  _assert_(core);
+  if (core->tail.load(std::memory_order_relaxed)) return false;
+  QueueMutexNode* node = queuemutexnode();
+  QueueMutexNode* empty = NULL;
+  if (!core->tail.compare_exchange_strong(empty, node,
+                                          std::memory_order_acquire, std::memory_order_relaxed)) {
+    queuemutexfree(node);
+    return false;
   }
-#elif _KC_GCCATOMIC
-  _assert_(true);
-  uint32_t wcnt = 0;
-  while (!__sync_bool_compare_and_swap(&opq_, 0, 1)) {
-    if (wcnt >= LOCKBUSYLOOP) {
-      Thread::chill();
-    } else {
-      Thread::yield();
-      wcnt++;
+  core->holder = node;
+  return true;
+}
+
+
+/**
+ * Release the lock of QueueMutex.
+ * @param core the internal fields.
+ */
+static void queuemutexunlock(QueueMutexCore* core) {
+  _assert_(core);
+  QueueMutexNode* node = core->holder;
+  QueueMutexNode* next = node->next.load(std::memory_order_acquire);
+  if (!next) {
+    QueueMutexNode* last = node;
+    if (core->tail.compare_exchange_strong(last, NULL,
+                                           std::memory_order_release, std::memory_order_relaxed)) {
+      queuemutexfree(node);
+      return;
+    }
+    while (!(next = node->next.load(std::memory_order_acquire))) {
+      cpurelax();
     }
   }
-#else
+  next->wait.store(0, std::memory_order_release);
+  queuemutexfree(node);
+}
+
+
+/**
+ * Default constructor.
+ */
+QueueMutex::QueueMutex() : opq_(NULL) {
   _assert_(true);
-  ::pthread_spinlock_t* spin = (::pthread_spinlock_t*)opq_;
-  if (::pthread_spin_lock(spin) != 0) throw std::runtime_error("pthread_spin_lock");
-#endif
+  QueueMutexCore* core = new QueueMutexCore;
+  core->tail.store(NULL, std::memory_order_relaxed);
+  core->holder = NULL;
+  opq_ = (void*)core;
 }
 
 
 /**
- * Try to get the lock.
+ * Destructor.
  */
-bool SpinLock::lock_try() {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+QueueMutex::~QueueMutex() {
   _assert_(true);
-  return ::InterlockedCompareExchange((LONG*)&opq_, 1, 0) == 0;
-#elif _KC_GCCATOMIC
+  QueueMutexCore* core = (QueueMutexCore*)opq_;
+  delete core;
+}
+
+
+/**
+ * Get the lock.
+ */
+void QueueMutex::lock() {
   _assert_(true);
-  return __sync_bool_compare_and_swap(&opq_, 0, 1);
-#else
+  queuemutexlock((QueueMutexCore*)opq_);
+}
+
+
+/**
+ * Try to get the lock.
+ */
+bool QueueMutex::lock_try() {
   _assert_(true);
-  ::pthread_spinlock_t* spin = (::pthread_spinlock_t*)opq_;
-  int32_t ecode = ::pthread_spin_trylock(spin);
-  if (ecode == 0) return true;
-  if (ecode != EBUSY) throw std::runtime_error("pthread_spin_trylock");
-  return false;
-#endif
+  return queuemutextry((QueueMutexCore*)opq_);
 }
 
 
 /**
  * Release the lock.
  */
-void SpinLock::unlock() {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  _assert_(true);
-  ::InterlockedExchange((LONG*)&opq_, 0);
-#elif _KC_GCCATOMIC
-  _assert_(true);
-  __sync_lock_release(&opq_);
-#else
+void QueueMutex::unlock() {
   _assert_(true);
-  ::pthread_spinlock_t* spin = (::pthread_spinlock_t*)opq_;
-  if (::pthread_spin_unlock(spin) != 0) throw std::runtime_error("pthread_spin_unlock");
-#endif
+  queuemutexunlock((QueueMutexCore*)opq_);
 }
 
 
 /**
- * SlottedSpinLock internal.
+ * SlottedQueueMutex internal.
  */
-struct SlottedSpinLockCore {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_) || _KC_GCCATOMIC
-  uint32_t* locks;                       ///< primitives
-  size_t slotnum;                        ///< number of slots
-#else
-  ::pthread_spinlock_t* spins;           ///< primitives
+struct SlottedQueueMutexCore {
+  QueueMutexCore* cores;                 ///< primitives
   size_t slotnum;                        ///< number of slots
-#endif
 };
 
 
 /**
  * Constructor.
  */
-SlottedSpinLock::SlottedSpinLock(size_t slotnum) : opq_(NULL) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_) || _KC_GCCATOMIC
+SlottedQueueMutex::SlottedQueueMutex(size_t slotnum) : opq_(NULL) {
   _assert_(true);
-  SlottedSpinLockCore* core = new SlottedSpinLockCore;
-  uint32_t* locks = new uint32_t[slotnum];
-  for (size_t i = 0; i < slotnum; i++) {
-    locks[i] = 0;
-  }
-  core->locks = locks;
-  core->slotnum = slotnum;
-  opq_ = (void*)core;
-#else
-  _assert_(true);
-  SlottedSpinLockCore* core = new SlottedSpinLockCore;
-  ::pthread_spinlock_t* spins = new ::pthread_spinlock_t[slotnum];
+  SlottedQueueMutexCore* core = new SlottedQueueMutexCore;
+  QueueMutexCore* cores = new QueueMutexCore[slotnum];
   for (size_t i = 0; i < slotnum; i++) {
-    if (::pthread_spin_init(spins + i, PTHREAD_PROCESS_PRIVATE) != 0)
-      throw std::runtime_error("pthread_spin_init");
+    cores[i].tail.store(NULL, std::memory_order_relaxed);
+    cores[i].holder = NULL;
   }
-  core->spins = spins;
+  core->cores = cores;
   core->slotnum = slotnum;
   opq_ = (void*)core;
-#endif
 }
 
 
 /**
  * Destructor.
  */
-SlottedSpinLock::~SlottedSpinLock() {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_) || _KC_GCCATOMIC
-  _assert_(true);
-  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
-  delete[] core->locks;
-  delete core;
-#else
+SlottedQueueMutex::~SlottedQueueMutex() {
   _assert_(true);
-  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
-  ::pthread_spinlock_t* spins = core->spins;
-  size_t slotnum = core->slotnum;
-  for (size_t i = 0; i < slotnum; i++) {
-    ::pthread_spin_destroy(spins + i);
-  }
-  delete[] spins;
+  SlottedQueueMutexCore* core = (SlottedQueueMutexCore*)opq_;
+  delete[] core->cores;
   delete core;
-#endif
 }
 
 
 /**
  * Get the lock of a slot.
  */
-void SlottedSpinLock::lock(size_t idx) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  _assert_(true);
-  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
-  uint32_t* lock = core->locks + idx;
-  uint32_t wcnt = 0;
-  while (::InterlockedCompareExchange((LONG*)lock, 1, 0) != 0) {
-    if (wcnt >= LOCKBUSYLOOP) {
-      Thread::chill();
-    } else {
-      Thread::yield();
-      wcnt++;
-    }
-  }
-#elif _KC_GCCATOMIC
-  _assert_(true);
-  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
-  uint32_t* lock = core->locks + idx;
-  uint32_t wcnt = 0;
-  while (!__sync_bool_compare_and_swap(lock, 0, 1)) {
-    if (wcnt >= LOCKBUSYLOOP) {
-      Thread::chill();
-    } else {
-      Thread::yield();
-      wcnt++;
-    }
-  }
-#else
+void SlottedQueueMutex::lock(size_t idx) {
   _assert_(true);
-  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
-  if (::pthread_spin_lock(core->spins + idx) != 0)
-    throw std::runtime_error("pthread_spin_lock");
-#endif
+  SlottedQueueMutexCore* core = (SlottedQueueMutexCore*)opq_;
+  queuemutexlock(core->cores + idx);
 }
 
 
 /**
  * Release the lock of a slot.
  */
-void SlottedSpinLock::unlock(size_t idx) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+void SlottedQueueMutex::unlock(size_t idx) {
   _assert_(true);
-  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
-  uint32_t* lock = core->locks + idx;
-  ::InterlockedExchange((LONG*)lock, 0);
-#elif _KC_GCCATOMIC
-  _assert_(true);
-  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
-  uint32_t* lock = core->locks + idx;
-  __sync_lock_release(lock);
-#else
-  _assert_(true);
-  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
-  if (::pthread_spin_unlock(core->spins + idx) != 0)
-    throw std::runtime_error("pthread_spin_unlock");
-#endif
+  SlottedQueueMutexCore* core = (SlottedQueueMutexCore*)opq_;
+  queuemutexunlock(core->cores + idx);
 }
 
 
 /**
  * Get the locks of all slots.
  */
-void SlottedSpinLock::lock_all() {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+void SlottedQueueMutex::lock_all() {
   _assert_(true);
-  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
+  SlottedQueueMutexCore* core = (SlottedQueueMutexCore*)opq_;
+  size_t slotnum = core->slotnum;
+  for (size_t i = 0; i < slotnum; i++) {
+    queuemutexlock(core->cores + i);
+  }
+}
+
+
+/**
+ * Release the locks of all slots.
+ */
+void SlottedQueueMutex::unlock_all() {
+  _assert_(true);
+  SlottedQueueMutexCore* core = (SlottedQueueMutexCore*)opq_;
+  size_t slotnum = core->slotnum;
+  for (size_t i = 0; i < slotnum; i++) {
+    queuemutexunlock(core->cores + i);
+  }
+}
+
+
+/**
+ * AdaptiveMutex internal.
+ * @note The state is 0 if free, 1 if locked, or 2 if locked and some waiters may sleep.
+ */
+struct AdaptiveMutexCore {
+  std::atomic<int32_t> state;            ///< state of the lock
+  std::atomic<int32_t> spinlim;          ///< learned length of spinning
+  std::atomic<int64_t> acqcnt;           ///< number of acquisitions
+  std::atomic<int64_t> spincnt;          ///< number of acquisitions after spinning
+  std::atomic<int64_t> parkcnt;          ///< number of acquisitions after sleeping
+  std::atomic<int64_t> waitns;           ///< total waiting time in nanoseconds
+} __attribute__((aligned(64)));
+
+
+/**
+ * Sleep until the state of AdaptiveMutex may change.
+ * @param state the state.
+ * @param val the expected value of the state.
+ * @note The waiter just yields the processor on platforms without futex.
+ */
+static void adaptivemutexpark(std::atomic<int32_t>* state, int32_t val) {
+#if defined(_SYS_LINUX_)
+  ::syscall(SYS_futex, (int32_t*)state, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#elif defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  ::Sleep(0);
+#else
+  ::sched_yield();
+#endif
+}
+
+
+/**
+ * Wake a waiter of AdaptiveMutex.
+ * @param state the state.
+ */
+static void adaptivemutexwake(std::atomic<int32_t>* state) {
+#if defined(_SYS_LINUX_)
+  ::syscall(SYS_futex, (int32_t*)state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+}
+
+
+/**
+ * Add a value to a profile counter of AdaptiveMutex.
+ * @param cnt the counter.
+ * @param num the value.
+ * @note Only the holder updates the counters.
+ */
+static void adaptivemutexcount(std::atomic<int64_t>* cnt, int64_t num) {
+  cnt->store(cnt->load(std::memory_order_relaxed) + num, std::memory_order_relaxed);
+}
+
+
+/**
+ * Get the lock of AdaptiveMutex after a failure of the fast path.
+ * @param core the internal fields.
+ * @note The spinning is allowed twice as long as the learned length, which then moves toward
+ * the length actually spun on success or is halved on failure.
+ */
+static void adaptivemutexlock(AdaptiveMutexCore* core) {
+  _assert_(core);
+  int64_t stime = monoclock();
+  int32_t limit = core->spinlim.load(std::memory_order_relaxed);
+  int32_t max = std::min<int32_t>(limit * 2 + ADAPTIVESPINMIN, ADAPTIVESPINMAX);
+  for (int32_t cnt = 1; cnt <= max; cnt++) {
+    cpurelax();
+    int32_t free = 0;
+    if (core->state.load(std::memory_order_relaxed) == 0 &&
+        core->state.compare_exchange_weak(free, 1, std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+      core->spinlim.store(limit + (cnt - limit) / 8, std::memory_order_relaxed);
+      adaptivemutexcount(&core->acqcnt, 1);
+      adaptivemutexcount(&core->spincnt, 1);
+      adaptivemutexcount(&core->waitns, monoclock() - stime);
+      return;
+    }
+  }
+  core->spinlim.store(limit / 2, std::memory_order_relaxed);
+  while (core->state.exchange(2, std::memory_order_acquire) != 0) {
+    adaptivemutexpark(&core->state, 2);
+  }
+  adaptivemutexcount(&core->acqcnt, 1);
+  adaptivemutexcount(&core->parkcnt, 1);
+  adaptivemutexcount(&core->waitns, monoclock() - stime);
+}
+
+
+/**
+ * Default constructor.
+ */
+AdaptiveMutex::AdaptiveMutex() : opq_(NULL) {
+  _assert_(true);
+  AdaptiveMutexCore* core = new(alignedmalloc(sizeof(AdaptiveMutexCore))) AdaptiveMutexCore;
+  core->state.store(0, std::memory_order_relaxed);
+  core->spinlim.store(ADAPTIVESPINMIN, std::memory_order_relaxed);
+  core->acqcnt.store(0, std::memory_order_relaxed);
+  core->spincnt.store(0, std::memory_order_relaxed);
+  core->parkcnt.store(0, std::memory_order_relaxed);
+  core->waitns.store(0, std::memory_order_relaxed);
+  opq_ = (void*)core;
+}
+
+
+/**
+ * Destructor.
+ */
+AdaptiveMutex::~AdaptiveMutex() {
+  _assert_(true);
+  AdaptiveMutexCore* core = (AdaptiveMutexCore*)opq_;
+  core->~AdaptiveMutexCore();
+  alignedfree(core);
+}
+
+
+/**
+ * Get the lock.
+ */
+void AdaptiveMutex::lock() {
+  _assert_(true);
+  AdaptiveMutexCore* core = (AdaptiveMutexCore*)opq_;
+  int32_t free = 0;
+  if (core->state.compare_exchange_strong(free, 1, std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+    adaptivemutexcount(&core->acqcnt, 1);
+    return;
+  }
+  adaptivemutexlock(core);
+}
+
+
+/**
+ * Try to get the lock.
+ */
+bool AdaptiveMutex::lock_try() {
+  _assert_(true);
+  AdaptiveMutexCore* core = (AdaptiveMutexCore*)opq_;
+  int32_t free = 0;
+  if (!core->state.compare_exchange_strong(free, 1, std::memory_order_acquire,
+                                           std::memory_order_relaxed)) return false;
+  adaptivemutexcount(&core->acqcnt, 1);
+  return true;
+}
+
+
+/**
+ * Release the lock.
+ */
+void AdaptiveMutex::unlock() {
+  _assert_(true);
+  AdaptiveMutexCore* core = (AdaptiveMutexCore*)opq_;
+  if (core->state.exchange(0, std::memory_order_release) == 2) adaptivemutexwake(&core->state);
+}
+
+
+/**
+ * Get the contention profile.
+ */
+AdaptiveMutex::Profile AdaptiveMutex::profile() {
+  _assert_(true);
+  AdaptiveMutexCore* core = (AdaptiveMutexCore*)opq_;
+  Profile prof;
+  prof.acquisitions = core->acqcnt.load(std::memory_order_relaxed);
+  prof.spins = core->spincnt.load(std::memory_order_relaxed);
+  prof.parks = core->parkcnt.load(std::memory_order_relaxed);
+  prof.waitns = core->waitns.load(std::memory_order_relaxed);
+  return prof;
+}
+
+
+/**
+ * Store the contention profile into a status map.
+ */
+void AdaptiveMutex::status(std::map<std::string, std::string>* strmap,
+                           const std::string& prefix) {
+  _assert_(strmap);
+  Profile prof = profile();
+  (*strmap)[prefix + "acquisitions"] = strprintf("%lld", (long long)prof.acquisitions);
+  (*strmap)[prefix + "spins"] = strprintf("%lld", (long long)prof.spins);
+  (*strmap)[prefix + "parks"] = strprintf("%lld", (long long)prof.parks);
+  (*strmap)[prefix + "wait_ns"] = strprintf("%lld", (long long)prof.waitns);
+}
+
+
+/**
+ * Default constructor.
+ */
+SpinLock::SpinLock() : opq_(NULL) {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  _assert_(true);
+#elif _KC_GCCATOMIC
+  _assert_(true);
+#else
+  _assert_(true);
+  ::pthread_spinlock_t* spin = new ::pthread_spinlock_t;
+  if (::pthread_spin_init(spin, PTHREAD_PROCESS_PRIVATE) != 0)
+    throw std::runtime_error("pthread_spin_init");
+  opq_ = (void*)spin;
+#endif
+}
+
+
+/**
+ * Destructor.
+ */
+SpinLock::~SpinLock() {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  _assert_(true);
+#elif _KC_GCCATOMIC
+  _assert_(true);
+#else
+  _assert_(true);
+  ::pthread_spinlock_t* spin = (::pthread_spinlock_t*)opq_;
+  ::pthread_spin_destroy(spin);
+  delete spin;
+#endif
+}
+
+
+/**
+ * Get the lock.
+ */
+void SpinLock::lock() {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  _assert_(true);
+  uint32_t wcnt = 0;
+  while (::InterlockedCompareExchange((LONG*)&opq_, 1, 0) != 0) {
+    if (wcnt >= LOCKBUSYLOOP) {
+      Thread::chill();
+    } else {
+      Thread::yield();
+      wcnt++;
+    }
+  }
+#elif _KC_GCCATOMIC
+  _assert_(true);
+  uint32_t wcnt = 0;
+  void* free = NULL;
+  while (!__atomic_compare_exchange_n(&opq_, &free, (void*)1, false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    free = NULL;
+    if (wcnt >= LOCKBUSYLOOP) {
+      Thread::chill();
+    } else {
+      Thread::yield();
+      wcnt++;
+    }
+  }
+#else
+  _assert_(true);
+  ::pthread_spinlock_t* spin = (::pthread_spinlock_t*)opq_;
+  if (::pthread_spin_lock(spin) != 0) throw std::runtime_error("pthread_spin_lock");
+#endif
+}
+
+
+/**
+ * Try to get the lock.
+ */
+bool SpinLock::lock_try() {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  _assert_(true);
+  return ::InterlockedCompareExchange((LONG*)&opq_, 1, 0) == 0;
+#elif _KC_GCCATOMIC
+  _assert_(true);
+  void* free = NULL;
+  return __atomic_compare_exchange_n(&opq_, &free, (void*)1, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+#else
+  _assert_(true);
+  ::pthread_spinlock_t* spin = (::pthread_spinlock_t*)opq_;
+  int32_t ecode = ::pthread_spin_trylock(spin);
+  if (ecode == 0) return true;
+  if (ecode != EBUSY) throw std::runtime_error("pthread_spin_trylock");
+  return false;
+#endif
+}
+
+
+/**
+ * Release the lock.
+ */
+void SpinLock::unlock() {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  _assert_(true);
+  ::InterlockedExchange((LONG*)&opq_, 0);
+#elif _KC_GCCATOMIC
+  _assert_(true);
+  __atomic_store_n(&opq_, NULL, __ATOMIC_RELEASE);
+#else
+  _assert_(true);
+  ::pthread_spinlock_t* spin = (::pthread_spinlock_t*)opq_;
+  if (::pthread_spin_unlock(spin) != 0) throw std::runtime_error("pthread_spin_unlock");
+#endif
+}
+
+
+/**
+ * SlottedSpinLock internal.
+ */
+struct SlottedSpinLockCore {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_) || _KC_GCCATOMIC
+  uint32_t* locks;                       ///< primitives
+  size_t slotnum;                        ///< number of slots
+#else
+  ::pthread_spinlock_t* spins;           ///< primitives
+  size_t slotnum;                        ///< number of slots
+#endif
+};
+
+
+#if _KC_GCCATOMIC && !defined(_SYS_MSVC_) && !defined(_SYS_MINGW_)
+/**
+ * Try to get a lock of SlottedSpinLock.
+ * @param lock the lock.
+ * @return true on success, or false on failure.
+ * @note The lock is read before the exchange so that waiting threads share the cache line.
+ */
+static bool slottedspinlocktry(uint32_t* lock) {
+  _assert_(lock);
+  uint32_t free = 0;
+  return __atomic_load_n(lock, __ATOMIC_RELAXED) == 0 &&
+      __atomic_compare_exchange_n(lock, &free, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+#endif
+
+
+/**
+ * Constructor.
+ */
+SlottedSpinLock::SlottedSpinLock(size_t slotnum) : opq_(NULL) {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_) || _KC_GCCATOMIC
+  _assert_(true);
+  SlottedSpinLockCore* core = new SlottedSpinLockCore;
+  uint32_t* locks = new uint32_t[slotnum];
+  for (size_t i = 0; i < slotnum; i++) {
+    locks[i] = 0;
+  }
+  core->locks = locks;
+  core->slotnum = slotnum;
+  opq_ = (void*)core;
+#else
+  _assert_(true);
+  SlottedSpinLockCore* core = new SlottedSpinLockCore;
+  ::pthread_spinlock_t* spins = new ::pthread_spinlock_t[slotnum];
+  for (size_t i = 0; i < slotnum; i++) {
+    if (::pthread_spin_init(spins + i, PTHREAD_PROCESS_PRIVATE) != 0)
+      throw std::runtime_error("pthread_spin_init");
+  }
+  core->spins = spins;
+  core->slotnum = slotnum;
+  opq_ = (void*)core;
+#endif
+}
+
+
+/**
+ * Destructor.
+ */
+SlottedSpinLock::~SlottedSpinLock() {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_) || _KC_GCCATOMIC
+  _assert_(true);
+  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
+  delete[] core->locks;
+  delete core;
+#else
+  _assert_(true);
+  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
+  ::pthread_spinlock_t* spins = core->spins;
+  size_t slotnum = core->slotnum;
+  for (size_t i = 0; i < slotnum; i++) {
+    ::pthread_spin_destroy(spins + i);
+  }
+  delete[] spins;
+  delete core;
+#endif
+}
+
+
+/**
+ * Get the lock of a slot.
+ */
+void SlottedSpinLock::lock(size_t idx) {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  _assert_(true);
+  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
+  uint32_t* lock = core->locks + idx;
+  uint32_t wcnt = 0;
+  while (::InterlockedCompareExchange((LONG*)lock, 1, 0) != 0) {
+    if (wcnt >= LOCKBUSYLOOP) {
+      Thread::chill();
+    } else {
+      Thread::yield();
+      wcnt++;
+    }
+  }
+#elif _KC_GCCATOMIC
+  _assert_(true);
+  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
+  uint32_t* lock = core->locks + idx;
+  uint32_t wcnt = 0;
+  while (!slottedspinlocktry(lock)) {
+    if (wcnt >= LOCKBUSYLOOP) {
+      Thread::chill();
+    } else {
+      Thread::yield();
+      wcnt++;
+    }
+  }
+#else
+  _assert_(true);
+  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
+  if (::pthread_spin_lock(core->spins + idx) != 0)
+    throw std::runtime_error("pthread_spin_lock");
+#endif
+}
+
+
+/**
+ * Release the lock of a slot.
+ */
+void SlottedSpinLock::unlock(size_t idx) {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  _assert_(true);
+  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
+  uint32_t* lock = core->locks + idx;
+  ::InterlockedExchange((LONG*)lock, 0);
+#elif _KC_GCCATOMIC
+  _assert_(true);
+  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
+  uint32_t* lock = core->locks + idx;
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+#else
+  _assert_(true);
+  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
+  if (::pthread_spin_unlock(core->spins + idx) != 0)
+    throw std::runtime_error("pthread_spin_unlock");
+#endif
+}
+
+
+/**
+ * Get the locks of all slots.
+ */
+void SlottedSpinLock::lock_all() {
+#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
+  _assert_(true);
+  SlottedSpinLockCore* core = (SlottedSpinLockCore*)opq_;
   uint32_t* locks = core->locks;
   size_t slotnum = core->slotnum;
   for (size_t i = 0; i < slotnum; i++) {
@@ -900,7 +1445,7 @@ void SlottedSpinLock::lock_all() {
   for (size_t i = 0; i < slotnum; i++) {
     uint32_t* lock = locks + i;
     uint32_t wcnt = 0;
-    while (!__sync_bool_compare_and_swap(lock, 0, 1)) {
+    while (!slottedspinlocktry(lock)) {
       if (wcnt >= LOCKBUSYLOOP) {
         Thread::chill();
       } else {
@@ -942,7 +1487,7 @@ void SlottedSpinLock::unlock_all() {
   size_t slotnum = core->slotnum;
   for (size_t i = 0; i < slotnum; i++) {
     uint32_t* lock = locks + i;
-    __sync_lock_release(lock);
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
   }
 #else
   _assert_(true);
@@ -957,6 +1502,191 @@ void SlottedSpinLock::unlock_all() {
 }
 
 
+#if !defined(_SYS_MSVC_) && !defined(_SYS_MINGW_) && defined(MY_RWLOCK)
+
+
+/**
+ * RWLock internal.
+ * @note While the bias is set, readers do not touch the underlying lock but publish the lock
+ * in the visible readers of their own stripe.  A writer takes the underlying lock, clears the
+ * bias and waits until the lock disappears from every stripe.  The bias is restored by a
+ * slow reader after a period proportional to the time the revocation took, so that frequent
+ * writers fall back to the underlying lock.
+ */
+struct RWLockCore {
+  ::pthread_rwlock_t rwlock;             ///< underlying lock
+  std::atomic<int32_t> rbias;            ///< whether readers take the fast path
+  std::atomic<int64_t> inhibit;          ///< time before which the bias is not restored
+};
+
+
+/**
+ * Stripe of the visible readers, shared by every RWLock object.
+ */
+struct RWLockStripe {
+  std::atomic<RWLockCore*> readers[RWLOCKSTRIPEWAY];  ///< locks held by fast readers
+} __attribute__((aligned(64)));
+
+
+/**
+ * Fast reader lock held by a thread.
+ */
+struct RWLockHeld {
+  RWLockCore* core;                      ///< lock
+  std::atomic<RWLockCore*>* slot;        ///< visible reader
+  uint32_t depth;                        ///< depth of nested locks
+};
+
+
+/**
+ * State of a thread for RWLock.
+ */
+struct RWLockThread {
+  RWLockStripe* stripe;                  ///< own stripe
+  RWLockHeld held[RWLOCKHELDMAX];        ///< fast reader locks held
+  size_t heldnum;                        ///< number of fast reader locks held
+};
+
+
+/** The visible readers. */
+static RWLockStripe g_rwlock_stripes[RWLOCKSTRIPENUM];
+
+
+/**
+ * Get the state of the calling thread for RWLock.
+ * @note The stripe is chosen by the processor which the thread runs on first, so that threads
+ * on different cores usually write different cache lines.
+ */
+static RWLockThread* rwlock_thread() {
+  static thread_local RWLockThread state = {};
+  if (!state.stripe) {
+#if defined(_SYS_LINUX_)
+    int32_t cpu = ::sched_getcpu();
+#else
+    int32_t cpu = -1;
+#endif
+    if (cpu < 0) {
+      static uint32_t seq = 0;
+      cpu = __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED);
+    }
+    state.stripe = g_rwlock_stripes + (uint32_t)cpu % RWLOCKSTRIPENUM;
+  }
+  return &state;
+}
+
+
+/**
+ * Try to get a reader lock without the underlying lock.
+ * @param core the lock.
+ * @return true on success, or false if the underlying lock should be used.
+ */
+static bool rwlock_lock_fast(RWLockCore* core) {
+  RWLockThread* state = rwlock_thread();
+  for (size_t i = 0; i < state->heldnum; i++) {
+    if (state->held[i].core == core) {
+      state->held[i].depth++;
+      return true;
+    }
+  }
+  if (!core->rbias.load(std::memory_order_acquire) || state->heldnum >= RWLOCKHELDMAX)
+    return false;
+  std::atomic<RWLockCore*>* slot =
+      state->stripe->readers + ((uintptr_t)core >> 6) % RWLOCKSTRIPEWAY;
+  RWLockCore* empty = NULL;
+  if (!slot->compare_exchange_strong(empty, core,
+                                     std::memory_order_seq_cst, std::memory_order_relaxed))
+    return false;
+  if (!core->rbias.load(std::memory_order_seq_cst)) {
+    slot->store(NULL, std::memory_order_release);
+    return false;
+  }
+  RWLockHeld* held = state->held + state->heldnum++;
+  held->core = core;
+  held->slot = slot;
+  held->depth = 1;
+  return true;
+}
+
+
+/**
+ * Release a reader lock got without the underlying lock.
+ * @param core the lock.
+ * @return true on success, or false if the underlying lock should be released.
+ */
+static bool rwlock_unlock_fast(RWLockCore* core) {
+  RWLockThread* state = rwlock_thread();
+  for (size_t i = 0; i < state->heldnum; i++) {
+    RWLockHeld* held = state->held + i;
+    if (held->core != core) continue;
+    if (--held->depth > 0) return true;
+    held->slot->store(NULL, std::memory_order_release);
+    *held = state->held[--state->heldnum];
+    return true;
+  }
+  return false;
+}
+
+
+/**
+ * Restore the bias of a lock after the inhibition, holding the underlying reader lock.
+ * @param core the lock.
+ * @note Concurrent slow readers may restore the bias at once, so the inhibition is atomic.  The
+ * bias is released so that the fast readers acquiring it see what the last writer released.
+ */
+static void rwlock_restore(RWLockCore* core) {
+  if (!core->rbias.load(std::memory_order_relaxed) &&
+      monoclock() >= core->inhibit.load(std::memory_order_relaxed))
+    core->rbias.store(1, std::memory_order_release);
+}
+
+
+/**
+ * Revoke the bias of a lock and wait for the fast readers, holding the underlying writer lock.
+ * @param core the lock.
+ */
+static void rwlock_revoke(RWLockCore* core) {
+  if (!core->rbias.load(std::memory_order_relaxed)) return;
+  core->rbias.store(0, std::memory_order_seq_cst);
+  int64_t stime = monoclock();
+  for (size_t i = 0; i < RWLOCKSTRIPENUM; i++) {
+    std::atomic<RWLockCore*>* readers = g_rwlock_stripes[i].readers;
+    for (size_t j = 0; j < RWLOCKSTRIPEWAY; j++) {
+      while (readers[j].load(std::memory_order_seq_cst) == core) {
+        cpurelax();
+      }
+    }
+  }
+  int64_t etime = monoclock();
+  core->inhibit.store(etime + (etime - stime) * RWLOCKINHIBIT, std::memory_order_relaxed);
+}
+
+
+/**
+ * Try to revoke the bias of a lock without waiting, holding the underlying writer lock.
+ * @param core the lock.
+ * @return true on success, or false if a fast reader holds the lock.
+ * @note If a fast reader is visible, the bias is restored so that the state is the same as
+ * before the call.
+ */
+static bool rwlock_revoke_try(RWLockCore* core) {
+  if (!core->rbias.load(std::memory_order_relaxed)) return true;
+  core->rbias.store(0, std::memory_order_seq_cst);
+  for (size_t i = 0; i < RWLOCKSTRIPENUM; i++) {
+    std::atomic<RWLockCore*>* readers = g_rwlock_stripes[i].readers;
+    for (size_t j = 0; j < RWLOCKSTRIPEWAY; j++) {
+      if (readers[j].load(std::memory_order_seq_cst) == core) {
+        core->rbias.store(1, std::memory_order_release);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+#endif
+
+
 /**
  * Default constructor.
  */
@@ -965,6 +1695,14 @@ RWLock::RWLock() : opq_(NULL) {
   _assert_(true);
   SpinRWLock* rwlock = new SpinRWLock;
   opq_ = (void*)rwlock;
+#elif defined(MY_RWLOCK)
+  _assert_(true);
+  RWLockCore* core = new RWLockCore;
+  if (::pthread_rwlock_init(&core->rwlock, NULL) != 0)
+    throw std::runtime_error("pthread_rwlock_init");
+  core->rbias.store(1, std::memory_order_relaxed);
+  core->inhibit.store(0, std::memory_order_relaxed);
+  opq_ = (void*)core;
 #else
   _assert_(true);
   ::pthread_rwlock_t* rwlock = new ::pthread_rwlock_t;
@@ -982,6 +1720,11 @@ RWLock::~RWLock() {
   _assert_(true);
   SpinRWLock* rwlock = (SpinRWLock*)opq_;
   delete rwlock;
+#elif defined(MY_RWLOCK)
+  _assert_(true);
+  RWLockCore* core = (RWLockCore*)opq_;
+  ::pthread_rwlock_destroy(&core->rwlock);
+  delete core;
 #else
   _assert_(true);
   ::pthread_rwlock_t* rwlock = (::pthread_rwlock_t*)opq_;
@@ -990,71 +1733,6 @@ RWLock::~RWLock() {
 #endif
 }
 
-void my_rwlock_lock_reader() {
-	if (rwlock_nesting > 0) {
-		rwlock_nesting++;
-		return;
-	}
-	
-retry:
-	atomic_add(&g_rwlock_inside, 1);
-	
-	if (g_rwlock_stop_readers > 0) {
-		atomic_add(&g_rwlock_outside, 1);
-		while (g_rwlock_stop_readers > 0) { CPU_RELAX; }
-		goto retry;
-	}
-	
-	rwlock_is_writer = 0;
-	rwlock_nesting++;
-	return;
-}
-
-void my_rwlock_unlock_reader() {
-	if (rwlock_nesting > 1) {
-		rwlock_nesting--;
-		return;
-	}
-	
-	rwlock_nesting--;
-	
-	atomic_add(&g_rwlock_outside, 1);
-}
-
-void my_rwlock_lock_writer() {
-	if (rwlock_nesting > 0) {
-		rwlock_nesting++;
-		return;
-	}
-	
-	atomic_add(&g_rwlock_stop_readers, 1);
-	
-	while ((g_rwlock_inside - g_rwlock_outside) > 0) { CPU_RELAX; }
-	
-retry:
-	if (CAS(&g_rwlock_writer_lock, 0 , 1) == 0) {
-		rwlock_is_writer = 1;
-		rwlock_nesting++;
-		return;
-	}
-		
-	while (g_rwlock_writer_lock != 0) { CPU_RELAX; }
-	goto retry;
-
-}
-
-void my_rwlock_unlock_writer() {
-	if (rwlock_nesting > 1) {
-		rwlock_nesting--;
-		return;
-	}
-	
-	rwlock_nesting--;
-	
-	g_rwlock_writer_lock = 0;
-	atomic_add(&g_rwlock_stop_readers, -1);	
-}
-
 /**
  * Get the writer lock.
  */
@@ -1063,15 +1741,16 @@ void RWLock::lock_writer() {
   _assert_(true);
   SpinRWLock* rwlock = (SpinRWLock*)opq_;
   rwlock->lock_writer();
-#else
-#ifdef MY_RWLOCK
-  my_rwlock_lock_writer();
+#elif defined(MY_RWLOCK)
+  _assert_(true);
+  RWLockCore* core = (RWLockCore*)opq_;
+  if (::pthread_rwlock_wrlock(&core->rwlock) != 0) throw std::runtime_error("pthread_rwlock_lock");
+  rwlock_revoke(core);
 #else
   _assert_(true);
   ::pthread_rwlock_t* rwlock = (::pthread_rwlock_t*)opq_;
   if (::pthread_rwlock_wrlock(rwlock) != 0) throw std::runtime_error("pthread_rwlock_lock");
 #endif
-#endif
 }
 
 
@@ -1083,6 +1762,18 @@ bool RWLock::lock_writer_try() {
   _assert_(true);
   SpinRWLock* rwlock = (SpinRWLock*)opq_;
   return rwlock->lock_writer_try();
+#elif defined(MY_RWLOCK)
+  _assert_(true);
+  RWLockCore* core = (RWLockCore*)opq_;
+  int32_t ecode = ::pthread_rwlock_trywrlock(&core->rwlock);
+  if (ecode == 0) {
+    if (rwlock_revoke_try(core)) return true;
+    if (::pthread_rwlock_unlock(&core->rwlock) != 0)
+      throw std::runtime_error("pthread_rwlock_unlock");
+    return false;
+  }
+  if (ecode != EBUSY) throw std::runtime_error("pthread_rwlock_trylock");
+  return false;
 #else
   _assert_(true);
   ::pthread_rwlock_t* rwlock = (::pthread_rwlock_t*)opq_;
@@ -1102,15 +1793,17 @@ void RWLock::lock_reader() {
   _assert_(true);
   SpinRWLock* rwlock = (SpinRWLock*)opq_;
   rwlock->lock_reader();
-#else
-#ifdef MY_RWLOCK
-  my_rwlock_lock_reader();
+#elif defined(MY_RWLOCK)
+  _assert_(true);
+  RWLockCore* core = (RWLockCore*)opq_;
+  if (rwlock_lock_fast(core)) return;
+  if (::pthread_rwlock_rdlock(&core->rwlock) != 0) throw std::runtime_error("pthread_rwlock_lock");
+  rwlock_restore(core);
 #else
   _assert_(true);
   ::pthread_rwlock_t* rwlock = (::pthread_rwlock_t*)opq_;
   if (::pthread_rwlock_rdlock(rwlock) != 0) throw std::runtime_error("pthread_rwlock_lock");
 #endif
-#endif
 }
 
 
@@ -1122,6 +1815,17 @@ bool RWLock::lock_reader_try() {
   _assert_(true);
   SpinRWLock* rwlock = (SpinRWLock*)opq_;
   return rwlock->lock_reader_try();
+#elif defined(MY_RWLOCK)
+  _assert_(true);
+  RWLockCore* core = (RWLockCore*)opq_;
+  if (rwlock_lock_fast(core)) return true;
+  int32_t ecode = ::pthread_rwlock_tryrdlock(&core->rwlock);
+  if (ecode == 0) {
+    rwlock_restore(core);
+    return true;
+  }
+  if (ecode != EBUSY) throw std::runtime_error("pthread_rwlock_trylock");
+  return false;
 #else
   _assert_(true);
   ::pthread_rwlock_t* rwlock = (::pthread_rwlock_t*)opq_;
@@ -1141,19 +1845,17 @@ void RWLock::unlock() {
   _assert_(true);
   SpinRWLock* rwlock = (SpinRWLock*)opq_;
   rwlock->unlock();
-#else
-#ifdef MY_RWLOCK
-  if (rwlock_is_writer) {
-    my_rwlock_unlock_writer();
-  } else {
-	my_rwlock_unlock_reader();
-  }
+#elif defined(MY_RWLOCK)
+  _assert_(true);
+  RWLockCore* core = (RWLockCore*)opq_;
+  if (rwlock_unlock_fast(core)) return;
+  if (::pthread_rwlock_unlock(&core->rwlock) != 0)
+    throw std::runtime_error("pthread_rwlock_unlock");
 #else
   _assert_(true);
   ::pthread_rwlock_t* rwlock = (::pthread_rwlock_t*)opq_;
   if (::pthread_rwlock_unlock(rwlock) != 0) throw std::runtime_error("pthread_rwlock_unlock");
 #endif
-#endif
 }
 
 
@@ -1346,53 +2048,101 @@ void SlottedRWLock::unlock_all() {
 
 /**
  * SpinRWLock internal.
+ * @note The count is the number of the readers, or INT32MAX while the writer holds the lock.
  */
 struct SpinRWLockCore {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  LONG sem;                              ///< semaphore
-  uint32_t cnt;                          ///< count of threads
-#elif _KC_GCCATOMIC
-  int32_t sem;                           ///< semaphore
-  uint32_t cnt;                          ///< count of threads
-#else
-  ::pthread_spinlock_t sem;              ///< semaphore
-  uint32_t cnt;                          ///< count of threads
-#endif
+  std::atomic<uint32_t> cnt;             ///< count of threads
 };
 
 
 /**
- * Lock the semephore of SpinRWLock.
- * @param core the internal fields.
+ * Try to get the writer lock of a count of SpinRWLock.
+ * @param cnt the count.
+ * @return true on success, or false on failure.
  */
-static void spinrwlocklock(SpinRWLockCore* core);
+static bool spinrwlocktrywriter(std::atomic<uint32_t>* cnt) {
+  _assert_(cnt);
+  uint32_t free = 0;
+  return cnt->compare_exchange_strong(free, INT32MAX,
+                                      std::memory_order_acquire, std::memory_order_relaxed);
+}
 
 
 /**
- * Unlock the semephore of SpinRWLock.
- * @param core the internal fields.
+ * Try to get a reader lock of a count of SpinRWLock.
+ * @param cnt the count.
+ * @return true on success, or false if the writer holds the lock.
+ */
+static bool spinrwlocktryreader(std::atomic<uint32_t>* cnt) {
+  _assert_(cnt);
+  uint32_t cur = cnt->load(std::memory_order_relaxed);
+  while (cur < (uint32_t)INT32MAX) {
+    if (cnt->compare_exchange_weak(cur, cur + 1,
+                                   std::memory_order_acquire, std::memory_order_relaxed))
+      return true;
+  }
+  return false;
+}
+
+
+/**
+ * Get the writer lock of a count of SpinRWLock.
+ * @param cnt the count.
+ */
+static void spinrwlockwriter(std::atomic<uint32_t>* cnt) {
+  _assert_(cnt);
+  uint32_t wcnt = 0;
+  while (!spinrwlocktrywriter(cnt)) {
+    if (wcnt >= LOCKBUSYLOOP) {
+      Thread::chill();
+    } else {
+      Thread::yield();
+      wcnt++;
+    }
+  }
+}
+
+
+/**
+ * Get a reader lock of a count of SpinRWLock.
+ * @param cnt the count.
+ */
+static void spinrwlockreader(std::atomic<uint32_t>* cnt) {
+  _assert_(cnt);
+  uint32_t wcnt = 0;
+  while (!spinrwlocktryreader(cnt)) {
+    if (wcnt >= LOCKBUSYLOOP) {
+      Thread::chill();
+    } else {
+      Thread::yield();
+      wcnt++;
+    }
+  }
+}
+
+
+/**
+ * Release a lock of a count of SpinRWLock.
+ * @param cnt the count.
  */
-static void spinrwlockunlock(SpinRWLockCore* core);
+static void spinrwlockrelease(std::atomic<uint32_t>* cnt) {
+  _assert_(cnt);
+  if (cnt->load(std::memory_order_relaxed) >= (uint32_t)INT32MAX) {
+    cnt->store(0, std::memory_order_release);
+  } else {
+    cnt->fetch_sub(1, std::memory_order_release);
+  }
+}
 
 
 /**
  * Default constructor.
  */
 SpinRWLock::SpinRWLock() : opq_(NULL) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_) || _KC_GCCATOMIC
-  _assert_(true);
-  SpinRWLockCore* core = new SpinRWLockCore;
-  core->sem = 0;
-  core->cnt = 0;
-  opq_ = (void*)core;
-#else
   _assert_(true);
   SpinRWLockCore* core = new SpinRWLockCore;
-  if (::pthread_spin_init(&core->sem, PTHREAD_PROCESS_PRIVATE) != 0)
-    throw std::runtime_error("pthread_spin_init");
-  core->cnt = 0;
+  core->cnt.store(0, std::memory_order_relaxed);
   opq_ = (void*)core;
-#endif
 }
 
 
@@ -1400,39 +2150,19 @@ SpinRWLock::SpinRWLock() : opq_(NULL) {
  * Destructor.
  */
 SpinRWLock::~SpinRWLock() {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_) || _KC_GCCATOMIC
   _assert_(true);
   SpinRWLockCore* core = (SpinRWLockCore*)opq_;
   delete core;
-#else
-  _assert_(true);
-  SpinRWLockCore* core = (SpinRWLockCore*)opq_;
-  ::pthread_spin_destroy(&core->sem);
-  delete core;
-#endif
 }
 
 
 /**
  * Get the writer lock.
  */
-void SpinRWLock::lock_writer() {
-  _assert_(true);
-  SpinRWLockCore* core = (SpinRWLockCore*)opq_;
-  spinrwlocklock(core);
-  uint32_t wcnt = 0;
-  while (core->cnt > 0) {
-    spinrwlockunlock(core);
-    if (wcnt >= LOCKBUSYLOOP) {
-      Thread::chill();
-    } else {
-      Thread::yield();
-      wcnt++;
-    }
-    spinrwlocklock(core);
-  }
-  core->cnt = INT32MAX;
-  spinrwlockunlock(core);
+void SpinRWLock::lock_writer() {
+  _assert_(true);
+  SpinRWLockCore* core = (SpinRWLockCore*)opq_;
+  spinrwlockwriter(&core->cnt);
 }
 
 
@@ -1442,14 +2172,7 @@ void SpinRWLock::lock_writer() {
 bool SpinRWLock::lock_writer_try() {
   _assert_(true);
   SpinRWLockCore* core = (SpinRWLockCore*)opq_;
-  spinrwlocklock(core);
-  if (core->cnt > 0) {
-    spinrwlockunlock(core);
-    return false;
-  }
-  core->cnt = INT32MAX;
-  spinrwlockunlock(core);
-  return true;
+  return spinrwlocktrywriter(&core->cnt);
 }
 
 
@@ -1459,20 +2182,7 @@ bool SpinRWLock::lock_writer_try() {
 void SpinRWLock::lock_reader() {
   _assert_(true);
   SpinRWLockCore* core = (SpinRWLockCore*)opq_;
-  spinrwlocklock(core);
-  uint32_t wcnt = 0;
-  while (core->cnt >= (uint32_t)INT32MAX) {
-    spinrwlockunlock(core);
-    if (wcnt >= LOCKBUSYLOOP) {
-      Thread::chill();
-    } else {
-      Thread::yield();
-      wcnt++;
-    }
-    spinrwlocklock(core);
-  }
-  core->cnt++;
-  spinrwlockunlock(core);
+  spinrwlockreader(&core->cnt);
 }
 
 
@@ -1482,14 +2192,7 @@ void SpinRWLock::lock_reader() {
 bool SpinRWLock::lock_reader_try() {
   _assert_(true);
   SpinRWLockCore* core = (SpinRWLockCore*)opq_;
-  spinrwlocklock(core);
-  if (core->cnt >= (uint32_t)INT32MAX) {
-    spinrwlockunlock(core);
-    return false;
-  }
-  core->cnt++;
-  spinrwlockunlock(core);
-  return true;
+  return spinrwlocktryreader(&core->cnt);
 }
 
 
@@ -1499,13 +2202,7 @@ bool SpinRWLock::lock_reader_try() {
 void SpinRWLock::unlock() {
   _assert_(true);
   SpinRWLockCore* core = (SpinRWLockCore*)opq_;
-  spinrwlocklock(core);
-  if (core->cnt >= (uint32_t)INT32MAX) {
-    core->cnt = 0;
-  } else {
-    core->cnt--;
-  }
-  spinrwlockunlock(core);
+  spinrwlockrelease(&core->cnt);
 }
 
 
@@ -1515,14 +2212,9 @@ void SpinRWLock::unlock() {
 bool SpinRWLock::promote() {
   _assert_(true);
   SpinRWLockCore* core = (SpinRWLockCore*)opq_;
-  spinrwlocklock(core);
-  if (core->cnt > 1) {
-    spinrwlockunlock(core);
-    return false;
-  }
-  core->cnt = INT32MAX;
-  spinrwlockunlock(core);
-  return true;
+  uint32_t sole = 1;
+  return core->cnt.compare_exchange_strong(sole, INT32MAX,
+                                           std::memory_order_acquire, std::memory_order_relaxed);
 }
 
 
@@ -1532,47 +2224,7 @@ bool SpinRWLock::promote() {
 void SpinRWLock::demote() {
   _assert_(true);
   SpinRWLockCore* core = (SpinRWLockCore*)opq_;
-  spinrwlocklock(core);
-  core->cnt = 1;
-  spinrwlockunlock(core);
-}
-
-
-/**
- * Lock the semephore of SpinRWLock.
- */
-static void spinrwlocklock(SpinRWLockCore* core) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  _assert_(core);
-  while (::InterlockedCompareExchange(&core->sem, 1, 0) != 0) {
-    ::Sleep(0);
-  }
-#elif _KC_GCCATOMIC
-  _assert_(core);
-  while (!__sync_bool_compare_and_swap(&core->sem, 0, 1)) {
-    //::sched_yield(); // TODO: fix
-  }
-#else
-  _assert_(core);
-  if (::pthread_spin_lock(&core->sem) != 0) throw std::runtime_error("pthread_spin_lock");
-#endif
-}
-
-
-/**
- * Unlock the semephore of SpinRWLock.
- */
-static void spinrwlockunlock(SpinRWLockCore* core) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  _assert_(core);
-  ::InterlockedExchange(&core->sem, 0);
-#elif _KC_GCCATOMIC
-  _assert_(core);
-  __sync_lock_release(&core->sem);
-#else
-  _assert_(core);
-  if (::pthread_spin_unlock(&core->sem) != 0) throw std::runtime_error("pthread_spin_unlock");
-#endif
+  core->cnt.store(1, std::memory_order_release);
 }
 
 
@@ -1580,80 +2232,24 @@ static void spinrwlockunlock(SpinRWLockCore* core) {
  * SlottedRWLock internal.
  */
 struct SlottedSpinRWLockCore {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  LONG sems[LOCKSEMNUM];                 ///< semaphores
-#elif _KC_GCCATOMIC
-  int32_t sems[LOCKSEMNUM];              ///< semaphores
-#else
-  ::pthread_spinlock_t sems[LOCKSEMNUM]; ///< semaphores
-#endif
-  uint32_t* cnts;                        ///< counts of threads
+  std::atomic<uint32_t>* cnts;           ///< counts of threads
   size_t slotnum;                        ///< number of slots
 };
 
 
-/**
- * Lock the semephore of SlottedSpinRWLock.
- * @param core the internal fields.
- * @param idx the index of the semaphoe.
- */
-static void slottedspinrwlocklock(SlottedSpinRWLockCore* core, size_t idx);
-
-
-/**
- * Unlock the semephore of SlottedSpinRWLock.
- * @param core the internal fields.
- * @param idx the index of the semaphoe.
- */
-static void slottedspinrwlockunlock(SlottedSpinRWLockCore* core, size_t idx);
-
-
 /**
  * Constructor.
  */
 SlottedSpinRWLock::SlottedSpinRWLock(size_t slotnum) : opq_(NULL) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  SlottedSpinRWLockCore* core = new SlottedSpinRWLockCore;
-  LONG* sems = core->sems;
-  uint32_t* cnts = new uint32_t[slotnum];
-  for (size_t i = 0; i < LOCKSEMNUM; i++) {
-    sems[i] = 0;
-  }
-  for (size_t i = 0; i < slotnum; i++) {
-    cnts[i] = 0;
-  }
-  core->cnts = cnts;
-  core->slotnum = slotnum;
-  opq_ = (void*)core;
-#elif _KC_GCCATOMIC
-  SlottedSpinRWLockCore* core = new SlottedSpinRWLockCore;
-  int32_t* sems = core->sems;
-  uint32_t* cnts = new uint32_t[slotnum];
-  for (size_t i = 0; i < LOCKSEMNUM; i++) {
-    sems[i] = 0;
-  }
-  for (size_t i = 0; i < slotnum; i++) {
-    cnts[i] = 0;
-  }
-  core->cnts = cnts;
-  core->slotnum = slotnum;
-  opq_ = (void*)core;
-#else
   _assert_(true);
   SlottedSpinRWLockCore* core = new SlottedSpinRWLockCore;
-  ::pthread_spinlock_t* sems = core->sems;
-  uint32_t* cnts = new uint32_t[slotnum];
-  for (size_t i = 0; i < LOCKSEMNUM; i++) {
-    if (::pthread_spin_init(sems + i, PTHREAD_PROCESS_PRIVATE) != 0)
-      throw std::runtime_error("pthread_spin_init");
-  }
+  std::atomic<uint32_t>* cnts = new std::atomic<uint32_t>[slotnum];
   for (size_t i = 0; i < slotnum; i++) {
-    cnts[i] = 0;
+    cnts[i].store(0, std::memory_order_relaxed);
   }
   core->cnts = cnts;
   core->slotnum = slotnum;
   opq_ = (void*)core;
-#endif
 }
 
 
@@ -1661,21 +2257,10 @@ SlottedSpinRWLock::SlottedSpinRWLock(size_t slotnum) : opq_(NULL) {
  * Destructor.
  */
 SlottedSpinRWLock::~SlottedSpinRWLock() {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_) || _KC_GCCATOMIC
-  _assert_(true);
-  SlottedSpinRWLockCore* core = (SlottedSpinRWLockCore*)opq_;
-  delete[] core->cnts;
-  delete core;
-#else
   _assert_(true);
   SlottedSpinRWLockCore* core = (SlottedSpinRWLockCore*)opq_;
-  ::pthread_spinlock_t* sems = core->sems;
-  for (size_t i = 0; i < LOCKSEMNUM; i++) {
-    ::pthread_spin_destroy(sems + i);
-  }
   delete[] core->cnts;
   delete core;
-#endif
 }
 
 
@@ -1685,21 +2270,7 @@ SlottedSpinRWLock::~SlottedSpinRWLock() {
 void SlottedSpinRWLock::lock_writer(size_t idx) {
   _assert_(true);
   SlottedSpinRWLockCore* core = (SlottedSpinRWLockCore*)opq_;
-  size_t semidx = idx % LOCKSEMNUM;
-  slottedspinrwlocklock(core, semidx);
-  uint32_t wcnt = 0;
-  while (core->cnts[idx] > 0) {
-    slottedspinrwlockunlock(core, semidx);
-    if (wcnt >= LOCKBUSYLOOP) {
-      Thread::chill();
-    } else {
-      Thread::yield();
-      wcnt++;
-    }
-    slottedspinrwlocklock(core, semidx);
-  }
-  core->cnts[idx] = INT32MAX;
-  slottedspinrwlockunlock(core, semidx);
+  spinrwlockwriter(core->cnts + idx);
 }
 
 
@@ -1709,21 +2280,7 @@ void SlottedSpinRWLock::lock_writer(size_t idx) {
 void SlottedSpinRWLock::lock_reader(size_t idx) {
   _assert_(true);
   SlottedSpinRWLockCore* core = (SlottedSpinRWLockCore*)opq_;
-  size_t semidx = idx % LOCKSEMNUM;
-  slottedspinrwlocklock(core, semidx);
-  uint32_t wcnt = 0;
-  while (core->cnts[idx] >= (uint32_t)INT32MAX) {
-    slottedspinrwlockunlock(core, semidx);
-    if (wcnt >= LOCKBUSYLOOP) {
-      Thread::chill();
-    } else {
-      Thread::yield();
-      wcnt++;
-    }
-    slottedspinrwlocklock(core, semidx);
-  }
-  core->cnts[idx]++;
-  slottedspinrwlockunlock(core, semidx);
+  spinrwlockreader(core->cnts + idx);
 }
 
 
@@ -1733,14 +2290,7 @@ void SlottedSpinRWLock::lock_reader(size_t idx) {
 void SlottedSpinRWLock::unlock(size_t idx) {
   _assert_(true);
   SlottedSpinRWLockCore* core = (SlottedSpinRWLockCore*)opq_;
-  size_t semidx = idx % LOCKSEMNUM;
-  slottedspinrwlocklock(core, semidx);
-  if (core->cnts[idx] >= (uint32_t)INT32MAX) {
-    core->cnts[idx] = 0;
-  } else {
-    core->cnts[idx]--;
-  }
-  slottedspinrwlockunlock(core, semidx);
+  spinrwlockrelease(core->cnts + idx);
 }
 
 
@@ -1750,24 +2300,9 @@ void SlottedSpinRWLock::unlock(size_t idx) {
 void SlottedSpinRWLock::lock_writer_all() {
   _assert_(true);
   SlottedSpinRWLockCore* core = (SlottedSpinRWLockCore*)opq_;
-  uint32_t* cnts = core->cnts;
   size_t slotnum = core->slotnum;
   for (size_t i = 0; i < slotnum; i++) {
-    size_t semidx = i % LOCKSEMNUM;
-    slottedspinrwlocklock(core, semidx);
-    uint32_t wcnt = 0;
-    while (cnts[i] > 0) {
-      slottedspinrwlockunlock(core, semidx);
-      if (wcnt >= LOCKBUSYLOOP) {
-        Thread::chill();
-      } else {
-        Thread::yield();
-        wcnt++;
-      }
-      slottedspinrwlocklock(core, semidx);
-    }
-    cnts[i] = INT32MAX;
-    slottedspinrwlockunlock(core, semidx);
+    spinrwlockwriter(core->cnts + i);
   }
 }
 
@@ -1778,24 +2313,9 @@ void SlottedSpinRWLock::lock_writer_all() {
 void SlottedSpinRWLock::lock_reader_all() {
   _assert_(true);
   SlottedSpinRWLockCore* core = (SlottedSpinRWLockCore*)opq_;
-  uint32_t* cnts = core->cnts;
   size_t slotnum = core->slotnum;
   for (size_t i = 0; i < slotnum; i++) {
-    size_t semidx = i % LOCKSEMNUM;
-    slottedspinrwlocklock(core, semidx);
-    uint32_t wcnt = 0;
-    while (cnts[i] >= (uint32_t)INT32MAX) {
-      slottedspinrwlockunlock(core, semidx);
-      if (wcnt >= LOCKBUSYLOOP) {
-        Thread::chill();
-      } else {
-        Thread::yield();
-        wcnt++;
-      }
-      slottedspinrwlocklock(core, semidx);
-    }
-    cnts[i]++;
-    slottedspinrwlockunlock(core, semidx);
+    spinrwlockreader(core->cnts + i);
   }
 }
 
@@ -1806,57 +2326,10 @@ void SlottedSpinRWLock::lock_reader_all() {
 void SlottedSpinRWLock::unlock_all() {
   _assert_(true);
   SlottedSpinRWLockCore* core = (SlottedSpinRWLockCore*)opq_;
-  uint32_t* cnts = core->cnts;
   size_t slotnum = core->slotnum;
   for (size_t i = 0; i < slotnum; i++) {
-    size_t semidx = i % LOCKSEMNUM;
-    slottedspinrwlocklock(core, semidx);
-    if (cnts[i] >= (uint32_t)INT32MAX) {
-      cnts[i] = 0;
-    } else {
-      cnts[i]--;
-    }
-    slottedspinrwlockunlock(core, semidx);
-  }
-}
-
-
-/**
- * Lock the semephore of SlottedSpinRWLock.
- */
-static void slottedspinrwlocklock(SlottedSpinRWLockCore* core, size_t idx) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  _assert_(core);
-  while (::InterlockedCompareExchange(core->sems + idx, 1, 0) != 0) {
-    ::Sleep(0);
-  }
-#elif _KC_GCCATOMIC
-  _assert_(core);
-  while (!__sync_bool_compare_and_swap(core->sems + idx, 0, 1)) {
-    //::sched_yield(); TODO: fix
+    spinrwlockrelease(core->cnts + i);
   }
-#else
-  _assert_(core);
-  if (::pthread_spin_lock(core->sems + idx) != 0) throw std::runtime_error("pthread_spin_lock");
-#endif
-}
-
-
-/**
- * Unlock the semephore of SlottedSpinRWLock.
- */
-static void slottedspinrwlockunlock(SlottedSpinRWLockCore* core, size_t idx) {
-#if defined(_SYS_MSVC_) || defined(_SYS_MINGW_)
-  _assert_(core);
-  ::InterlockedExchange(core->sems + idx, 0);
-#elif _KC_GCCATOMIC
-  _assert_(core);
-  __sync_lock_release(core->sems + idx);
-#else
-  _assert_(core);
-  if (::pthread_spin_unlock(core->sems + idx) != 0)
-    throw std::runtime_error("pthread_spin_unlock");
-#endif
 }
 
 
@@ -2155,22 +2628,8 @@ void* TSDKey::get() const {
  * Set the new value.
  */
 int64_t AtomicInt64::set(int64_t val) {
-#if (defined(_SYS_MSVC_) || defined(_SYS_MINGW_)) && defined(_SYS_WIN64_)
-  _assert_(true);
-  return ::InterlockedExchange((uint64_t*)&value_, val);
-#elif _KC_GCCATOMIC
-  _assert_(true);
-  int64_t oval = __sync_lock_test_and_set(&value_, val);
-  __sync_synchronize();
-  return oval;
-#else
   _assert_(true);
-  lock_.lock();
-  int64_t oval = value_;
-  value_ = val;
-  lock_.unlock();
-  return oval;
-#endif
+  return value_.exchange(val, std::memory_order_acq_rel);
 }
 
 
@@ -2178,22 +2637,8 @@ int64_t AtomicInt64::set(int64_t val) {
  * Add a value.
  */
 int64_t AtomicInt64::add(int64_t val) {
-#if (defined(_SYS_MSVC_) || defined(_SYS_MINGW_)) && defined(_SYS_WIN64_)
-  _assert_(true);
-  return ::InterlockedExchangeAdd((uint64_t*)&value_, val);
-#elif _KC_GCCATOMIC
   _assert_(true);
-  int64_t oval = __sync_fetch_and_add(&value_, val);
-  __sync_synchronize();
-  return oval;
-#else
-  _assert_(true);
-  lock_.lock();
-  int64_t oval = value_;
-  value_ += val;
-  lock_.unlock();
-  return oval;
-#endif
+  return value_.fetch_add(val, std::memory_order_acq_rel);
 }
 
 
@@ -2201,25 +2646,9 @@ int64_t AtomicInt64::add(int64_t val) {
  * Perform compare-and-swap.
  */
 bool AtomicInt64::cas(int64_t oval, int64_t nval) {
-#if (defined(_SYS_MSVC_) || defined(_SYS_MINGW_)) && defined(_SYS_WIN64_)
-  _assert_(true);
-  return ::InterlockedCompareExchange((uint64_t*)&value_, nval, oval) == oval;
-#elif _KC_GCCATOMIC
-  _assert_(true);
-  bool rv = __sync_bool_compare_and_swap(&value_, oval, nval);
-  __sync_synchronize();
-  return rv;
-#else
   _assert_(true);
-  bool rv = false;
-  lock_.lock();
-  if (value_ == oval) {
-    value_ = nval;
-    rv = true;
-  }
-  lock_.unlock();
-  return rv;
-#endif
+  return value_.compare_exchange_strong(oval, nval,
+                                        std::memory_order_acq_rel, std::memory_order_acquire);
 }
 
 
@@ -2227,22 +2656,227 @@ bool AtomicInt64::cas(int64_t oval, int64_t nval) {
  * Get the current value.
  */
 int64_t AtomicInt64::get() const {
-#if (defined(_SYS_MSVC_) || defined(_SYS_MINGW_)) && defined(_SYS_WIN64_)
   _assert_(true);
-  return ::InterlockedExchangeAdd((uint64_t*)&value_, 0);
-#elif _KC_GCCATOMIC
+  return value_.load(std::memory_order_acquire);
+}
+
+
+
+/**
+ * Announcement of a thread in the epoch-based reclamation.
+ */
+struct EpochRecord {
+  uint64_t local;                        ///< pinned epoch, or 0 if not pinned
+  int32_t used;                          ///< whether owned by a living thread
+  EpochRecord* next;                     ///< next record
+};
+
+
+/**
+ * Retired region of the epoch-based reclamation.
+ */
+struct EpochRetired {
+  void* ptr;                             ///< pointer to the region
+  Epoch::Deleter del;                    ///< function to free the region
+  uint64_t epoch;                        ///< global epoch at the retirement
+};
+
+
+/**
+ * Global state of the epoch-based reclamation.
+ */
+struct EpochGlobal {
+  uint64_t epoch;                        ///< global epoch, which is not 0
+  EpochRecord* recs;                     ///< records of all threads, never released
+  SpinLock lock;                         ///< lock of the orphans
+  std::vector<EpochRetired> orphans;     ///< regions retired by exited threads
+  std::atomic<size_t> orphannum;         ///< number of the orphans, readable without the lock
+  /** constructor */
+  EpochGlobal() : epoch(1), recs(NULL), lock(), orphans(), orphannum(0) {}
+};
+
+
+/**
+ * Get the global state of the epoch-based reclamation.
+ * @note The state is never destroyed so that threads exiting after the main function can
+ * still hand their regions over.
+ */
+static EpochGlobal* epoch_global() {
+  static EpochGlobal* global = new EpochGlobal;
+  return global;
+}
+
+
+/**
+ * State of a thread in the epoch-based reclamation.
+ */
+struct EpochThread {
+  EpochRecord* rec;                      ///< announcement record
+  uint32_t depth;                        ///< depth of nested pins
+  std::vector<EpochRetired> retired;     ///< retired regions
+  /** destructor */
+  ~EpochThread() {
+    if (!retired.empty()) {
+      EpochGlobal* global = epoch_global();
+      global->lock.lock();
+      global->orphans.insert(global->orphans.end(), retired.begin(), retired.end());
+      global->orphannum.store(global->orphans.size(), std::memory_order_relaxed);
+      global->lock.unlock();
+    }
+    if (rec) {
+      __atomic_store_n(&rec->local, 0, __ATOMIC_RELEASE);
+      __atomic_store_n(&rec->used, 0, __ATOMIC_RELEASE);
+    }
+  }
+};
+
+
+/**
+ * Get the state of the calling thread in the epoch-based reclamation.
+ */
+static EpochThread* epoch_thread() {
+  static thread_local EpochThread state = { NULL, 0, std::vector<EpochRetired>() };
+  if (!state.rec) {
+    EpochGlobal* global = epoch_global();
+    EpochRecord* rec = __atomic_load_n(&global->recs, __ATOMIC_ACQUIRE);
+    while (rec) {
+      int32_t free = 0;
+      if (__atomic_load_n(&rec->used, __ATOMIC_RELAXED) == 0 &&
+          __atomic_compare_exchange_n(&rec->used, &free, 1, false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+      rec = rec->next;
+    }
+    if (!rec) {
+      rec = new EpochRecord;
+      rec->local = 0;
+      rec->used = 1;
+      rec->next = __atomic_load_n(&global->recs, __ATOMIC_RELAXED);
+      while (!__atomic_compare_exchange_n(&global->recs, &rec->next, rec, false,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+    }
+    state.rec = rec;
+  }
+  return &state;
+}
+
+
+/**
+ * Advance the global epoch if every pinned thread has seen it.
+ * @return the global epoch after the attempt.
+ */
+static uint64_t epoch_advance() {
+  EpochGlobal* global = epoch_global();
+  uint64_t epoch = __atomic_load_n(&global->epoch, __ATOMIC_SEQ_CST);
+  for (EpochRecord* rec = __atomic_load_n(&global->recs, __ATOMIC_ACQUIRE); rec;
+       rec = rec->next) {
+    uint64_t local = __atomic_load_n(&rec->local, __ATOMIC_SEQ_CST);
+    if (local != 0 && local != epoch) return epoch;
+  }
+  if (__atomic_compare_exchange_n(&global->epoch, &epoch, epoch + 1, false,
+                                  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) epoch++;
+  return epoch;
+}
+
+
+/**
+ * Free the retired regions which are no longer visible.
+ * @param retired the list of the retired regions.
+ * @param epoch the global epoch.
+ * @return the number of freed regions.
+ */
+static size_t epoch_free(std::vector<EpochRetired>* retired, uint64_t epoch) {
+  size_t num = 0;
+  std::vector<EpochRetired>::iterator it = retired->begin();
+  std::vector<EpochRetired>::iterator itend = retired->end();
+  std::vector<EpochRetired>::iterator wit = it;
+  while (it != itend) {
+    if (it->epoch + 2 <= epoch) {
+      it->del(it->ptr);
+      num++;
+    } else {
+      *wit = *it;
+      ++wit;
+    }
+    ++it;
+  }
+  retired->erase(wit, itend);
+  return num;
+}
+
+
+/**
+ * Pin the current epoch for the calling thread.
+ */
+void Epoch::enter() {
   _assert_(true);
-  return __sync_fetch_and_add((int64_t*)&value_, 0);
-#else
+  EpochThread* state = epoch_thread();
+  if (state->depth++ > 0) return;
+  uint64_t epoch = __atomic_load_n(&epoch_global()->epoch, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&state->rec->local, epoch, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+
+/**
+ * Unpin the epoch pinned by the enter method.
+ */
+void Epoch::leave() {
   _assert_(true);
-  lock_.lock();
-  int64_t oval = value_;
-  lock_.unlock();
-  return oval;
-#endif
+  EpochThread* state = epoch_thread();
+  _assert_(state->depth > 0);
+  if (--state->depth > 0) return;
+  __atomic_store_n(&state->rec->local, 0, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Retire a region which no longer appears in shared structures.
+ */
+void Epoch::retire(void* ptr, Deleter del) {
+  _assert_(ptr && del);
+  EpochThread* state = epoch_thread();
+  EpochRetired entry = { ptr, del, __atomic_load_n(&epoch_global()->epoch, __ATOMIC_SEQ_CST) };
+  state->retired.push_back(entry);
+  if (state->retired.size() >= EPOCHBATCH && state->retired.size() % EPOCHBATCH == 0)
+    reclaim();
+}
+
+
+/**
+ * Try to advance the global epoch and free the regions which are no longer visible.
+ */
+size_t Epoch::reclaim() {
+  _assert_(true);
+  EpochThread* state = epoch_thread();
+  uint64_t epoch = epoch_advance();
+  size_t num = epoch_free(&state->retired, epoch);
+  EpochGlobal* global = epoch_global();
+  if (global->orphannum.load(std::memory_order_relaxed) > 0 && global->lock.lock_try()) {
+    num += epoch_free(&global->orphans, epoch);
+    global->orphannum.store(global->orphans.size(), std::memory_order_relaxed);
+    global->lock.unlock();
+  }
+  return num;
+}
+
+
+/**
+ * Get the global epoch.
+ */
+uint64_t Epoch::current() {
+  _assert_(true);
+  return __atomic_load_n(&epoch_global()->epoch, __ATOMIC_SEQ_CST);
 }
 
 
+/**
+ * Get the number of regions retired but not freed yet by the calling thread.
+ */
+size_t Epoch::pending() {
+  _assert_(true);
+  return epoch_thread()->retired.size();
+}
+
 }                                        // common namespace
 
 // END OF FILE
@@ -19,6 +19,11 @@
 #include <kccommon.h>
 #include <kcutil.h>
 
+#if defined(__RTM__)
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
 extern __attribute__((transaction_pure)) void *pthread_getspecific (pthread_key_t __key) __THROW;
 extern __attribute__((transaction_pure)) int pthread_setspecific (pthread_key_t __key, const void *__pointer) __THROW;
 extern __attribute__((transaction_pure)) void __assert_fail (const char *__assertion, const char *__file,
@@ -213,6 +218,148 @@ class SlottedMutex {
 };
 
 
+/**
+ * Queue-based mutual exclusion device.
+ * @note Waiting threads line up in a queue and each spins on its own node, so the lock is
+ * handed over in the order of arrival and the waiters do not share a cache line.  A waiter
+ * yields the processor after spinning for a while instead of sleeping in the kernel.
+ */
+class QueueMutex {
+ public:
+  /**
+   * Default constructor.
+   */
+  explicit QueueMutex();
+  /**
+   * Destructor.
+   */
+  ~QueueMutex();
+  /**
+   * Get the lock.
+   */
+  void lock();
+  /**
+   * Try to get the lock.
+   * @return true on success, or false on failure.
+   */
+  bool lock_try();
+  /**
+   * Release the lock.
+   */
+  void unlock();
+ private:
+  /** Dummy constructor to forbid the use. */
+  QueueMutex(const QueueMutex&);
+  /** Dummy Operator to forbid the use. */
+  QueueMutex& operator =(const QueueMutex&);
+  /** Opaque pointer. */
+  void* opq_;
+};
+
+
+/**
+ * Slotted queue-based mutual exclusion device.
+ */
+class SlottedQueueMutex {
+ public:
+  /**
+   * Constructor.
+   * @param slotnum the number of slots.
+   */
+  explicit SlottedQueueMutex(size_t slotnum);
+  /**
+   * Destructor.
+   */
+  ~SlottedQueueMutex();
+  /**
+   * Get the lock of a slot.
+   * @param idx the index of a slot.
+   */
+  void lock(size_t idx);
+  /**
+   * Release the lock of a slot.
+   * @param idx the index of a slot.
+   */
+  void unlock(size_t idx);
+  /**
+   * Get the locks of all slots.
+   */
+  void lock_all();
+  /**
+   * Release the locks of all slots.
+   */
+  void unlock_all();
+ private:
+  /** Dummy constructor to forbid the use. */
+  SlottedQueueMutex(const SlottedQueueMutex&);
+  /** Dummy Operator to forbid the use. */
+  SlottedQueueMutex& operator =(const SlottedQueueMutex&);
+  /** Opaque pointer. */
+  void* opq_;
+};
+
+
+/**
+ * Adaptive mutual exclusion device.
+ * @note A waiter spins for a while and then sleeps in the kernel.  The length of the spinning
+ * is learned from the waits which ended while spinning, so that a lock held for a short time is
+ * taken without sleeping and a waiter of a lock held for a long time sleeps early.  The lock
+ * can be released by a thread other than the holder.  The profile counters are updated by the
+ * holder and are not exact while other threads read them.
+ */
+class AdaptiveMutex {
+ public:
+  /**
+   * Contention profile.
+   */
+  struct Profile {
+    int64_t acquisitions;                ///< number of acquisitions
+    int64_t spins;                       ///< number of acquisitions after spinning
+    int64_t parks;                       ///< number of acquisitions after sleeping
+    int64_t waitns;                      ///< total waiting time in nanoseconds
+  };
+  /**
+   * Default constructor.
+   */
+  explicit AdaptiveMutex();
+  /**
+   * Destructor.
+   */
+  ~AdaptiveMutex();
+  /**
+   * Get the lock.
+   */
+  void lock();
+  /**
+   * Try to get the lock.
+   * @return true on success, or false on failure.
+   */
+  bool lock_try();
+  /**
+   * Release the lock.
+   */
+  void unlock();
+  /**
+   * Get the contention profile.
+   * @return the profile.
+   */
+  Profile profile();
+  /**
+   * Store the contention profile into a status map.
+   * @param strmap a string map to contain the result.
+   * @param prefix the prefix of the keys.
+   */
+  void status(std::map<std::string, std::string>* strmap, const std::string& prefix);
+ private:
+  /** Dummy constructor to forbid the use. */
+  AdaptiveMutex(const AdaptiveMutex&);
+  /** Dummy Operator to forbid the use. */
+  AdaptiveMutex& operator =(const AdaptiveMutex&);
+  /** Opaque pointer. */
+  void* opq_;
+};
+
+
 /**
  * Lightweight mutual exclusion device.
  */
@@ -317,6 +464,208 @@ class SlottedSpinLock {
 };
 
 
+/**
+ * Statistics of atomic sections.
+ */
+struct TxStats {
+  int64_t starts;                        ///< number of started transactions
+  int64_t commits;                       ///< number of committed transactions
+  int64_t conflicts;                     ///< number of aborts by memory conflicts
+  int64_t capacities;                    ///< number of aborts by buffer overflow
+  int64_t explicits;                     ///< number of explicit aborts
+  int64_t others;                        ///< number of aborts by other causes
+  int64_t fallbacks;                     ///< number of sections run with a lock acquired
+};
+
+
+#if defined(__RTM__)
+/**
+ * Mutual exclusion device elided by restricted transactional memory.
+ * @note A critical section is run as a hardware transaction which only reads the lock word,
+ * and the lock is acquired for real only after the retry budget is spent, after an abort which
+ * is not worth retrying, or if the processor does not support RTM.  A section nested in
+ * another section of the same thread is merged into the outer one.
+ */
+class ElidedLock {
+ public:
+  /**
+   * Modes of a locked section.
+   */
+  enum Mode {
+    MNESTED = 0,                         ///< merged into an outer section
+    MELIDED = 1,                         ///< run as a hardware transaction
+    MLOCKED = 2                          ///< run with the lock acquired
+  };
+  /** The default number of attempts of a transaction before acquiring the lock. */
+  static const int32_t DEFRETRY = 8;
+  /** The abort code meaning that the lock was held. */
+  static const uint8_t XLOCKED = 0xff;
+  /** The threshold of busy loop and yielding for waiting for the lock. */
+  static const uint32_t LOCKBUSYLOOP = 1024;
+  /**
+   * Default constructor.
+   */
+  explicit ElidedLock() : word_(0), retry_(DEFRETRY) {
+    _assert_(true);
+  }
+  /**
+   * Set the number of attempts of a transaction before acquiring the lock.
+   * @param retry the number of attempts.  If it is not more than 0, the lock is always acquired.
+   */
+  void set_retry(int32_t retry) {
+    _assert_(true);
+    retry_ = retry;
+  }
+  /**
+   * Enter a critical section.
+   * @param stats the statistics to which the outcomes of the attempts are added.  If it is
+   * NULL, they are not counted.
+   * @param elide false to acquire the lock without trying a transaction, for a section known
+   * to overflow the transactional buffer.
+   * @return the mode of the section, which must be given to the ElidedLock::unlock method.
+   * @note The statistics are only written outside the transaction, so they survive aborts.
+   */
+  Mode lock(TxStats* stats = NULL, bool elide = true) {
+    _assert_(true);
+    uintptr_t self = thread_tag();
+    // XTEST raises #UD on a processor without RTM, so it is guarded by the CPUID check.
+    if (supported() && _xtest()) {
+      if (__atomic_load_n(&word_, __ATOMIC_RELAXED) != 0) _xabort(XLOCKED);
+      return MNESTED;
+    }
+    if (__atomic_load_n(&word_, __ATOMIC_RELAXED) == self) return MNESTED;
+    TxStats dummy = TxStats();
+    if (!stats) stats = &dummy;
+    if (elide && supported()) {
+      for (int32_t i = 0; i < retry_; i++) {
+        wait_free();
+        stats->starts++;
+        uint32_t status = _xbegin();
+        if (status == _XBEGIN_STARTED) {
+          if (__atomic_load_n(&word_, __ATOMIC_RELAXED) != 0) _xabort(XLOCKED);
+          return MELIDED;
+        }
+        if (status & _XABORT_CONFLICT) {
+          stats->conflicts++;
+        } else if (status & _XABORT_CAPACITY) {
+          stats->capacities++;
+        } else if (status & _XABORT_EXPLICIT) {
+          stats->explicits++;
+        } else {
+          stats->others++;
+        }
+        bool locked = (status & _XABORT_EXPLICIT) && _XABORT_CODE(status) == XLOCKED;
+        if (!locked && !(status & _XABORT_RETRY)) break;
+      }
+    }
+    stats->fallbacks++;
+    while (true) {
+      uintptr_t free = 0;
+      if (__atomic_compare_exchange_n(&word_, &free, self, false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+      wait_free();
+    }
+    return MLOCKED;
+  }
+  /**
+   * Leave a critical section.
+   * @param mode the mode given by the ElidedLock::lock method.
+   * @param stats the statistics to which the commit is added.  If it is NULL, it is not counted.
+   */
+  void unlock(Mode mode, TxStats* stats = NULL) {
+    _assert_(true);
+    if (mode == MELIDED) {
+      _xend();
+      if (stats) stats->commits++;
+    } else if (mode == MLOCKED) {
+      __atomic_store_n(&word_, 0, __ATOMIC_RELEASE);
+    }
+  }
+  /**
+   * Check whether the processor supports RTM.
+   * @return true if it does, or false if not.
+   */
+  static bool supported() {
+    _assert_(true);
+    static int32_t state = -1;
+    if (state < 0) {
+      uint32_t eax, ebx, ecx, edx;
+      state = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_RTM) ? 1 : 0;
+    }
+    return state > 0;
+  }
+ private:
+  /**
+   * Get the tag of the calling thread stored in the lock word.
+   * @return the tag, which is not 0.
+   */
+  static uintptr_t thread_tag() {
+    static __thread char tag;
+    return (uintptr_t)&tag;
+  }
+  /**
+   * Wait until the lock is released.
+   */
+  void wait_free() const {
+    uint32_t wcnt = 0;
+    while (__atomic_load_n(&word_, __ATOMIC_ACQUIRE) != 0) {
+      if (wcnt >= LOCKBUSYLOOP) {
+        Thread::yield();
+      } else {
+        _mm_pause();
+        wcnt++;
+      }
+    }
+  }
+  /** Dummy constructor to forbid the use. */
+  ElidedLock(const ElidedLock&);
+  /** Dummy Operator to forbid the use. */
+  ElidedLock& operator =(const ElidedLock&);
+  /** The lock word, which is the tag of the owner or 0. */
+  alignas(64) uintptr_t word_;
+  /** The number of attempts of a transaction. */
+  int32_t retry_;
+};
+
+
+/**
+ * Scoped elided lock device.
+ */
+class ScopedElision {
+ public:
+  /**
+   * Constructor.
+   * @param elock an elided lock to lock the block.
+   * @param stats the statistics to which the outcomes are added.  If it is NULL, they are not
+   * counted.
+   * @param elide false to acquire the lock without trying a transaction.
+   */
+  explicit ScopedElision(ElidedLock* elock, TxStats* stats = NULL, bool elide = true) :
+      elock_(elock), stats_(stats), mode_(elock->lock(stats, elide)) {
+    _assert_(elock);
+  }
+  /**
+   * Destructor.
+   */
+  ~ScopedElision() {
+    _assert_(true);
+    elock_->unlock(mode_, stats_);
+  }
+ private:
+  /** Dummy constructor to forbid the use. */
+  ScopedElision(const ScopedElision&);
+  /** Dummy Operator to forbid the use. */
+  ScopedElision& operator =(const ScopedElision&);
+  /** The inner device. */
+  ElidedLock* elock_;
+  /** The statistics. */
+  TxStats* stats_;
+  /** The mode of the section. */
+  ElidedLock::Mode mode_;
+};
+#endif
+
+
 /**
  * Reader-writer locking device.
  */
@@ -580,6 +929,83 @@ class SlottedSpinRWLock {
 };
 
 
+/**
+ * Epoch-based reclamation of memory shared among threads.
+ * @note A thread reading shared regions without a lock pins the global epoch by the enter
+ * method, and a thread unlinking a region hands it to the retire method instead of freeing it.
+ * Retired regions are kept in a list of the calling thread and freed in batches once every
+ * thread pinned at the time of the retirement has left, which is known when the global epoch
+ * has advanced twice since then.  Regions retired by an exiting thread are passed to the
+ * other threads.
+ */
+class Epoch {
+ public:
+  /**
+   * Type of the functions to free retired regions.
+   */
+  typedef void (*Deleter)(void* ptr);
+  /**
+   * Pin the current epoch for the calling thread.
+   * @note Calls can be nested, and only the outermost one pins the epoch.
+   */
+  static void enter();
+  /**
+   * Unpin the epoch pinned by the enter method.
+   */
+  static void leave();
+  /**
+   * Retire a region which no longer appears in shared structures.
+   * @param ptr the pointer to the region.
+   * @param del the function to free the region, which is called by an arbitrary thread.
+   * @note If enough regions have been retired by the calling thread, the safe ones are freed.
+   */
+  static void retire(void* ptr, Deleter del);
+  /**
+   * Try to advance the global epoch and free the regions retired by the calling thread which
+   * are no longer visible.
+   * @return the number of freed regions.
+   */
+  static size_t reclaim();
+  /**
+   * Get the global epoch.
+   * @return the global epoch.
+   */
+  static uint64_t current();
+  /**
+   * Get the number of regions retired but not freed yet by the calling thread.
+   * @return the number of the regions.
+   */
+  static size_t pending();
+};
+
+
+/**
+ * Scoped pin of the epoch.
+ */
+class ScopedEpoch {
+ public:
+  /**
+   * Constructor.
+   */
+  explicit ScopedEpoch() {
+    _assert_(true);
+    Epoch::enter();
+  }
+  /**
+   * Destructor.
+   */
+  ~ScopedEpoch() {
+    _assert_(true);
+    Epoch::leave();
+  }
+ private:
+  /** Dummy constructor to forbid the use. */
+  ScopedEpoch(const ScopedEpoch&);
+  /** Dummy Operator to forbid the use. */
+  ScopedEpoch& operator =(const ScopedEpoch&);
+};
+
+
 /**
  * Condition variable.
  */
@@ -933,27 +1359,29 @@ class TSD {
 
 /**
  * Integer with atomic operations.
+ * @note The updating operations have acquire-release semantics and reading has acquire
+ * semantics, not sequential consistency.
  */
 class AtomicInt64 {
  public:
   /**
    * Default constructor.
    */
-  explicit AtomicInt64() : value_(0), lock_() {
+  explicit AtomicInt64() : value_(0) {
     _assert_(true);
   }
   /**
    * Copy constructor.
    * @param src the source object.
    */
-  AtomicInt64(const AtomicInt64& src) : value_(src.get()), lock_() {
+  AtomicInt64(const AtomicInt64& src) : value_(src.get()) {
     _assert_(true);
   };
   /**
    * Constructor.
    * @param num the initial value.
    */
-  AtomicInt64(int64_t num) : value_(num), lock_() {
+  AtomicInt64(int64_t num) : value_(num) {
     _assert_(true);
   }
   /**
@@ -1051,14 +1479,17 @@ class AtomicInt64 {
   }
  private:
   /** The value. */
-  volatile int64_t value_;
-  /** The alternative lock. */
-  mutable SpinLock lock_;
+  std::atomic<int64_t> value_;
 };
 
 
 /**
  * Task queue device.
+ * @note Each worker thread has its own deque of tasks.  A task added by a worker thread is
+ * pushed to the deque of the worker, and a task added by another thread is put into the inbox
+ * of one of the workers in turn.  A worker takes the latest task of its own deque first, and
+ * steals the oldest task of the others when its deque and inbox are empty, so the tasks are not
+ * processed in the order of addition.  Idle workers sleep on a condition variable.
  */
 class TaskQueue {
  public:
@@ -1067,6 +1498,8 @@ class TaskQueue {
   class WorkerThread;
   /** An alias of list of tasks. */
   typedef std::list<Task*> TaskList;
+  /** The initial capacity of the deque of a worker thread. */
+  static const int64_t DEQUEINIT = 256;
  public:
   /**
    * Interface of a task.
@@ -1122,7 +1555,9 @@ class TaskQueue {
   /**
    * Default Constructor.
    */
-  TaskQueue() : thary_(NULL), thnum_(0), tasks_(), count_(0), mutex_(), cond_(), seed_(0) {
+  TaskQueue() :
+      thary_(NULL), thnum_(0), tasks_(), count_(0), idle_(0), rotor_(0), aborting_(false),
+      mutex_(), cond_(), seed_(0) {
     _assert_(true);
   }
   /**
@@ -1155,54 +1590,57 @@ class TaskQueue {
   /**
    * Start the task queue.
    * @param thnum the number of worker threads.
+   * @note The task queue can be started again after it is finished.
    */
   void start(size_t thnum) {
     _assert_(thnum > 0 && thnum <= MEMMAXSIZ);
     thary_ = new WorkerThread[thnum];
+    thnum_ = thnum;
     for (size_t i = 0; i < thnum; i++) {
       thary_[i].id_ = i;
       thary_[i].queue_ = this;
+    }
+    mutex_.lock();
+    size_t idx = 0;
+    while (!tasks_.empty()) {
+      thary_[idx++ % thnum].inbox_.push_back(tasks_.front());
+      tasks_.pop_front();
+    }
+    mutex_.unlock();
+    for (size_t i = 0; i < thnum; i++) {
       thary_[i].start();
     }
-    thnum_ = thnum;
   }
   /**
    * Finish the task queue.
-   * @note This function blocks until all tasks in the queue are popped.
+   * @note This function blocks until all tasks in the queue are popped.  The tasks popped in
+   * the meantime are marked to be aborted.
    */
   void finish() {
     _assert_(true);
+    aborting_.store(true, std::memory_order_relaxed);
     mutex_.lock();
-    TaskList::iterator it = tasks_.begin();
-    TaskList::iterator itend = tasks_.end();
-    while (it != itend) {
-      Task* task = *it;
-      task->aborted_ = true;
-      ++it;
-    }
     cond_.broadcast();
     mutex_.unlock();
     Thread::yield();
     for (double wsec = 1.0 / CLOCKTICK; true; wsec *= 2) {
-      mutex_.lock();
-      if (tasks_.empty()) {
-        mutex_.unlock();
-        break;
-      }
-      mutex_.unlock();
+      if (count_.load() < 1) break;
       if (wsec > 1.0) wsec = 1.0;
       Thread::sleep(wsec);
     }
-    mutex_.lock();
     for (size_t i = 0; i < thnum_; i++) {
-      thary_[i].aborted_ = true;
+      thary_[i].aborted_.store(true, std::memory_order_relaxed);
     }
+    mutex_.lock();
     cond_.broadcast();
     mutex_.unlock();
     for (size_t i = 0; i < thnum_; i++) {
       thary_[i].join();
     }
     delete[] thary_;
+    thary_ = NULL;
+    thnum_ = 0;
+    aborting_.store(false, std::memory_order_relaxed);
   }
   /**
    * Add a task.
@@ -1211,12 +1649,26 @@ class TaskQueue {
    */
   int64_t add_task(Task* task) {
     _assert_(task);
-    mutex_.lock();
-    task->id_ = ++seed_;
-    tasks_.push_back(task);
-    int64_t count = ++count_;
-    cond_.signal();
-    mutex_.unlock();
+    task->id_ = seed_.fetch_add(1, std::memory_order_relaxed) + 1;
+    WorkerThread* worker = running_worker();
+    if (worker && worker->queue_ == this) {
+      worker->push(task);
+    } else if (thnum_ > 0) {
+      worker = thary_ + rotor_.fetch_add(1, std::memory_order_relaxed) % thnum_;
+      worker->inlock_.lock();
+      worker->inbox_.push_back(task);
+      worker->inlock_.unlock();
+    } else {
+      mutex_.lock();
+      tasks_.push_back(task);
+      mutex_.unlock();
+    }
+    int64_t count = count_.fetch_add(1) + 1;
+    if (idle_.load() > 0) {
+      mutex_.lock();
+      cond_.signal();
+      mutex_.unlock();
+    }
     return count;
   }
   /**
@@ -1225,21 +1677,57 @@ class TaskQueue {
    */
   int64_t count() {
     _assert_(true);
-    mutex_.lock();
-    int64_t count = count_;
-    mutex_.unlock();
-    return count;
+    int64_t count = count_.load();
+    return count > 0 ? count : 0;
   }
  private:
+  /**
+   * Circular array of the deque of a worker thread.
+   */
+  struct TaskArray {
+    /** constructor */
+    explicit TaskArray(int64_t cap) : cap(cap), slots(new std::atomic<Task*>[cap]) {}
+    /** destructor */
+    ~TaskArray() {
+      delete[] slots;
+    }
+    /** get a task */
+    Task* get(int64_t idx) {
+      return slots[idx & (cap - 1)].load(std::memory_order_relaxed);
+    }
+    /** put a task */
+    void put(int64_t idx, Task* task) {
+      slots[idx & (cap - 1)].store(task, std::memory_order_relaxed);
+    }
+    int64_t cap;                         ///< capacity, which is a power of two
+    std::atomic<Task*>* slots;           ///< slots of the tasks
+   private:
+    /** Dummy constructor to forbid the use. */
+    TaskArray(const TaskArray&);
+    /** Dummy Operator to forbid the use. */
+    TaskArray& operator =(const TaskArray&);
+  };
   /**
    * Implementation of the worker thread.
+   * @note The deque is the one by Chase and Lev.  Only the owner pushes and pops at the bottom,
+   * and the others steal at the top.  Replaced arrays are kept until the thread is deleted,
+   * since a thief may still read them.
    */
   class WorkerThread : public Thread {
     friend class TaskQueue;
    public:
-    explicit WorkerThread() : id_(0), queue_(NULL), aborted_(false) {
+    explicit WorkerThread() :
+        id_(0), queue_(NULL), aborted_(false), top_(0), bottom_(0),
+        array_(new TaskArray(DEQUEINIT)), retired_(), inlock_(), inbox_() {
       _assert_(true);
     }
+    ~WorkerThread() {
+      _assert_(true);
+      for (size_t i = 0; i < retired_.size(); i++) {
+        delete retired_[i];
+      }
+      delete array_.load(std::memory_order_relaxed);
+    }
    private:
     void run() {
       _assert_(true);
@@ -1247,38 +1735,144 @@ class TaskQueue {
       stask->thid_ = id_;
       queue_->do_start(stask);
       delete stask;
-      bool empty = false;
+      running_worker() = this;
       while (true) {
-        queue_->mutex_.lock();
-        if (aborted_) {
-          queue_->mutex_.unlock();
-          break;
-        }
-        if (empty) queue_->cond_.wait(&queue_->mutex_, 1.0);
-        Task * task = NULL;
-        if (queue_->tasks_.empty()) {
-          empty = true;
-        } else {
-          task = queue_->tasks_.front();
+        Task* task = queue_->take_task(this);
+        if (task) {
           task->thid_ = id_;
-          queue_->tasks_.pop_front();
-          queue_->count_--;
-          empty = false;
+          if (queue_->aborting_.load(std::memory_order_relaxed)) task->aborted_ = true;
+          queue_->count_.fetch_sub(1);
+          queue_->do_task(task);
+          continue;
         }
-        queue_->mutex_.unlock();
-        if (task) queue_->do_task(task);
+        if (aborted_.load(std::memory_order_relaxed)) break;
+        queue_->park(this);
       }
+      running_worker() = NULL;
       Task* ftask = new Task;
       ftask->thid_ = id_;
       ftask->aborted_ = true;
       queue_->do_finish(ftask);
       delete ftask;
     }
+    void push(Task* task) {
+      int64_t bottom = bottom_.load(std::memory_order_relaxed);
+      int64_t top = top_.load(std::memory_order_acquire);
+      TaskArray* array = array_.load(std::memory_order_relaxed);
+      if (bottom - top > array->cap - 1) {
+        TaskArray* narray = new TaskArray(array->cap * 2);
+        for (int64_t i = top; i < bottom; i++) {
+          narray->put(i, array->get(i));
+        }
+        retired_.push_back(array);
+        array_.store(narray, std::memory_order_release);
+        array = narray;
+      }
+      array->put(bottom, task);
+      std::atomic_thread_fence(std::memory_order_release);
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    Task* pop() {
+      int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+      TaskArray* array = array_.load(std::memory_order_relaxed);
+      bottom_.store(bottom, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t top = top_.load(std::memory_order_relaxed);
+      if (top > bottom) {
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return NULL;
+      }
+      Task* task = array->get(bottom);
+      if (top == bottom) {
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) task = NULL;
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+      }
+      return task;
+    }
+    Task* steal() {
+      int64_t top = top_.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t bottom = bottom_.load(std::memory_order_acquire);
+      if (top >= bottom) return NULL;
+      TaskArray* array = array_.load(std::memory_order_acquire);
+      Task* task = array->get(top);
+      if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) return NULL;
+      return task;
+    }
+    bool drain() {
+      TaskList tasks;
+      inlock_.lock();
+      tasks.swap(inbox_);
+      inlock_.unlock();
+      if (tasks.empty()) return false;
+      for (TaskList::iterator it = tasks.begin(); it != tasks.end(); ++it) {
+        push(*it);
+      }
+      return true;
+    }
+    Task* steal_inbox() {
+      Task* task = NULL;
+      inlock_.lock();
+      if (!inbox_.empty()) {
+        task = inbox_.front();
+        inbox_.pop_front();
+      }
+      inlock_.unlock();
+      return task;
+    }
     uint32_t id_;
     TaskQueue* queue_;
-    Task* task_;
-    bool aborted_;
+    std::atomic<bool> aborted_;
+    std::atomic<int64_t> top_;
+    std::atomic<int64_t> bottom_;
+    std::atomic<TaskArray*> array_;
+    std::vector<TaskArray*> retired_;
+    AdaptiveMutex inlock_;
+    TaskList inbox_;
   };
+  /**
+   * Get the slot of the worker thread running on the calling thread.
+   * @return the slot, whose value is NULL if the calling thread is not a worker thread.
+   */
+  static WorkerThread*& running_worker() {
+    static thread_local WorkerThread* worker = NULL;
+    return worker;
+  }
+  /**
+   * Take a task for a worker thread.
+   * @param worker the worker thread.
+   * @return the task, or NULL if no task is found.
+   */
+  Task* take_task(WorkerThread* worker) {
+    _assert_(worker);
+    Task* task = worker->pop();
+    if (task) return task;
+    if (worker->drain() && (task = worker->pop()) != NULL) return task;
+    for (size_t i = 1; i < thnum_; i++) {
+      WorkerThread* victim = thary_ + (worker->id_ + i) % thnum_;
+      if ((task = victim->steal()) != NULL) return task;
+      if ((task = victim->steal_inbox()) != NULL) return task;
+    }
+    return NULL;
+  }
+  /**
+   * Sleep until a task is added.
+   * @param worker the worker thread.
+   * @note The number of idle workers is raised before the number of tasks is checked, and the
+   * adder checks the former after raising the latter, so a wakeup is never missed and an idle
+   * worker can sleep without timeout.
+   */
+  void park(WorkerThread* worker) {
+    _assert_(worker);
+    mutex_.lock();
+    idle_.fetch_add(1);
+    if (count_.load() < 1 && !worker->aborted_.load(std::memory_order_relaxed))
+      cond_.wait(&mutex_);
+    idle_.fetch_sub(1);
+    mutex_.unlock();
+  }
   /** Dummy constructor to forbid the use. */
   TaskQueue(const TaskQueue&);
   /** Dummy Operator to forbid the use. */
@@ -1287,16 +1881,242 @@ class TaskQueue {
   WorkerThread* thary_;
   /** The number of worker threads. */
   size_t thnum_;
-  /** The list of tasks. */
+  /** The list of tasks added before starting. */
   TaskList tasks_;
   /** The number of the tasks. */
-  int64_t count_;
-  /** The mutex for the task list. */
+  std::atomic<int64_t> count_;
+  /** The number of the idle worker threads. */
+  std::atomic<int64_t> idle_;
+  /** The counter to choose the inbox of a task. */
+  std::atomic<uint64_t> rotor_;
+  /** The flag whether finishing. */
+  std::atomic<bool> aborting_;
+  /** The mutex for sleeping. */
   Mutex mutex_;
-  /** The condition variable for the task list. */
+  /** The condition variable for sleeping. */
   CondVar cond_;
   /** The seed of ID numbers. */
-  uint64_t seed_;
+  std::atomic<uint64_t> seed_;
+};
+
+
+/**
+ * Pool of worker threads to run thread objects repeatedly.
+ * @note Thread objects are run as tasks of a task queue instead of spawning a native thread for
+ * each, and the worker threads are kept for later calls and added when a call needs more.  The
+ * calling thread runs the first object by itself and then the objects which no worker has taken
+ * yet, so a call from a worker thread of the same pool does not deadlock.
+ */
+class ThreadPool : public TaskQueue {
+ public:
+  /**
+   * Default constructor.
+   */
+  explicit ThreadPool() : rlock_(), wnum_(0) {
+    _assert_(true);
+  }
+  /**
+   * Destructor.
+   */
+  ~ThreadPool() {
+    _assert_(true);
+    if (wnum_ > 0) finish();
+  }
+  /**
+   * Run thread objects and wait for them to end.
+   * @param threads the array of thread objects, which must not be started.
+   * @param num the number of the thread objects.
+   */
+  template <class THREAD>
+  void run(THREAD* threads, size_t num) {
+    _assert_(threads && num > 0 && num <= MEMMAXSIZ);
+    std::vector<Thread*> thptrs;
+    thptrs.reserve(num);
+    for (size_t i = 0; i < num; i++) {
+      thptrs.push_back(threads + i);
+    }
+    run_impl(&thptrs[0], num);
+  }
+  /**
+   * Stop the worker threads.
+   * @note This function blocks until the running calls end.  The workers are started again by
+   * the next call which asks for them.
+   */
+  void stop() {
+    _assert_(true);
+    rlock_.lock_writer();
+    if (wnum_ > 0) finish();
+    wnum_ = 0;
+    rlock_.unlock();
+  }
+ private:
+  /**
+   * Group of the tasks of a call.
+   */
+  struct RunBatch {
+    Mutex mutex;                         ///< mutex for the rest
+    CondVar cond;                        ///< condition variable for the rest
+    size_t rest;                         ///< number of the tasks not ended
+  };
+  /**
+   * Task to run a thread object.
+   * @note The task is released by the worker which pops it and by the caller.
+   */
+  class RunTask : public Task {
+   public:
+    explicit RunTask(Thread* thread, RunBatch* batch) :
+        thread(thread), batch(batch), claimed(0), refs(2) {}
+    Thread* thread;
+    RunBatch* batch;
+    std::atomic<int32_t> claimed;
+    std::atomic<int32_t> refs;
+  };
+  /**
+   * Run thread objects and wait for them to end.
+   * @param threads the array of the pointers to the thread objects.
+   * @param num the number of the thread objects.
+   * @note The pool is restarted with more workers only if no other call is running, since
+   * finishing it waits for the tasks of the others.  A nested call, made by a thread object
+   * run by a call of the same pool, never restarts the pool and uses the existing workers,
+   * since the outer call keeps the pool locked.  If the pool has never been started, the thread
+   * objects are run one by one by the caller.
+   */
+  void run_impl(Thread** threads, size_t num) {
+    _assert_(threads && num > 0);
+    if (num < 2) {
+      threads[0]->run();
+      return;
+    }
+    size_t wnum = num - 1;
+    bool nested = depth() > 0;
+    if (!nested) rlock_.lock_reader();
+    enter();
+    if (nested) {
+      if (wnum_ < 1) {
+        for (size_t i = 0; i < num; i++) {
+          threads[i]->run();
+        }
+        leave();
+        return;
+      }
+    } else if (wnum_ < wnum) {
+      rlock_.unlock();
+      if (rlock_.lock_writer_try()) {
+        if (wnum_ < wnum) {
+          if (wnum_ > 0) finish();
+          start(wnum);
+          wnum_ = wnum;
+        }
+        rlock_.unlock();
+      }
+      rlock_.lock_reader();
+      if (wnum_ < 1) {
+        for (size_t i = 0; i < num; i++) {
+          threads[i]->run();
+        }
+        leave();
+        rlock_.unlock();
+        return;
+      }
+    }
+    RunBatch batch;
+    batch.rest = wnum;
+    std::vector<RunTask*> tasks;
+    tasks.reserve(wnum);
+    for (size_t i = 1; i < num; i++) {
+      RunTask* task = new RunTask(threads[i], &batch);
+      tasks.push_back(task);
+      add_task(task);
+    }
+    threads[0]->run();
+    for (size_t i = 0; i < tasks.size(); i++) {
+      RunTask* task = tasks[i];
+      if (task->claimed.exchange(1) == 0) run_task(task);
+      release_task(task);
+    }
+    batch.mutex.lock();
+    while (batch.rest > 0) {
+      batch.cond.wait(&batch.mutex);
+    }
+    batch.mutex.unlock();
+    leave();
+    if (!nested) rlock_.unlock();
+  }
+  /**
+   * Get the depth of the calls of the pool running on the calling thread.
+   * @return the depth.
+   * @note A worker thread running a task counts as inside a call, since the caller of the task
+   * keeps the pool locked.
+   */
+  size_t depth() {
+    std::map<ThreadPool*, size_t>& depths = running_depths();
+    std::map<ThreadPool*, size_t>::iterator it = depths.find(this);
+    return it == depths.end() ? 0 : it->second;
+  }
+  /**
+   * Enter a call of the pool on the calling thread.
+   */
+  void enter() {
+    running_depths()[this]++;
+  }
+  /**
+   * Leave a call of the pool on the calling thread.
+   */
+  void leave() {
+    std::map<ThreadPool*, size_t>& depths = running_depths();
+    std::map<ThreadPool*, size_t>::iterator it = depths.find(this);
+    if (--it->second < 1) depths.erase(it);
+  }
+  /**
+   * Get the depths of the pools running on the calling thread.
+   * @return the map of the depths, whose entries are removed when they become zero.
+   */
+  static std::map<ThreadPool*, size_t>& running_depths() {
+    static thread_local std::map<ThreadPool*, size_t> depths;
+    return depths;
+  }
+  /**
+   * Process a task.
+   * @param task a task object.
+   */
+  void do_task(Task* task) {
+    _assert_(task);
+    RunTask* rtask = (RunTask*)task;
+    if (rtask->claimed.exchange(1) == 0) {
+      enter();
+      run_task(rtask);
+      leave();
+    }
+    release_task(rtask);
+  }
+  /**
+   * Run the thread object of a task and count it down.
+   * @param task the task.
+   */
+  static void run_task(RunTask* task) {
+    _assert_(task);
+    task->thread->run();
+    RunBatch* batch = task->batch;
+    batch->mutex.lock();
+    if (--batch->rest < 1) batch->cond.broadcast();
+    batch->mutex.unlock();
+  }
+  /**
+   * Release a task.
+   * @param task the task.
+   */
+  static void release_task(RunTask* task) {
+    _assert_(task);
+    if (task->refs.fetch_sub(1) == 1) delete task;
+  }
+  /** Dummy constructor to forbid the use. */
+  ThreadPool(const ThreadPool&);
+  /** Dummy Operator to forbid the use. */
+  ThreadPool& operator =(const ThreadPool&);
+  /** The lock to restart the pool. */
+  RWLock rlock_;
+  /** The number of worker threads. */
+  size_t wnum_;
 };
 
 
@@ -143,6 +143,22 @@ const size_t NUMBUFSIZ = 32;
 const size_t MEMMAXSIZ = INT32MAX / 2;
 
 
+/** The unit size of the size classes of the arena allocator. */
+const size_t ARENAUNIT = 16;
+
+
+/** The maximum size of regions kept in the free lists of the arena allocator. */
+const size_t ARENAMAX = 1024;
+
+
+/** The number of the size classes of the arena allocator. */
+const size_t ARENACLASSNUM = ARENAMAX / ARENAUNIT;
+
+
+/** The size of each chunk of the arena allocator. */
+const size_t ARENACHUNKSIZ = 65536;
+
+
 /**
  * Convert a decimal string to an integer.
  * @param str the decimal string.
@@ -860,6 +876,74 @@ void* xrealloc(void* ptr, size_t size);
 void xfree(void* ptr);
 
 
+/**
+ * Allocate a region from the arena of the calling thread.
+ * @param size the size of the region.
+ * @return the pointer to the allocated region.  It should be released with the arena_free call.
+ * @note This function is transaction safe.  A small region is taken from the free list of its
+ * size class or carved out of the current chunk of the calling thread, so the heap is only
+ * called once per chunk.  Larger regions are allocated by the heap.  Chunks are kept for reuse
+ * while the thread lives, and returned to the heap once the thread has exited and every region
+ * carved from them has been freed.
+ */
+void* __attribute__((transaction_safe)) arena_malloc(size_t size);
+
+
+/**
+ * Free a region of the arena allocator.
+ * @param ptr the pointer to the region.  If it is NULL, nothing is done.
+ * @note This function is transaction safe.  The region is only put on the pending list of the
+ * calling thread, and it is not reused nor returned to the heap until the arena_commit call.
+ * A region carved by another thread is given back to that thread then.
+ */
+void __attribute__((transaction_safe)) arena_free(void* ptr);
+
+
+/**
+ * Recycle the regions freed by the calling thread.
+ * @note This function must be called outside transactions, after the transactions freeing
+ * the regions have committed.  The regions given back by other threads are also recycled.
+ */
+void arena_commit();
+
+
+/**
+ * Get the reusable buffer of the calling thread.
+ * @param size the minimum size of the buffer.
+ * @return the pointer to the buffer.  It is valid until the next call by the same thread, on
+ * behalf of whichever caller, or the exit of the thread, and must not be released.
+ * @note This function is transaction safe.  The buffer is grown by the arena allocator, so the
+ * content of the previous buffer is not kept.
+ */
+char* __attribute__((transaction_safe)) arena_buffer(size_t size);
+
+
+/**
+ * Scoped committer of the arena allocator.
+ */
+class ScopedArenaCommit {
+ public:
+  /**
+   * Constructor.
+   */
+  explicit ScopedArenaCommit() {
+    _assert_(true);
+  }
+  /**
+   * Destructor.
+   */
+  ~ScopedArenaCommit() {
+    _assert_(true);
+    arena_commit();
+  }
+ private:
+  /** Dummy constructor to forbid the use. */
+  ScopedArenaCommit(const ScopedArenaCommit&);
+  /** Dummy Operator to forbid the use. */
+  ScopedArenaCommit& operator =(const ScopedArenaCommit&);
+};
+
+
 /**
  * Allocate a nullified region on mapped memory.
  * @param size the size of the region.
@@ -2910,6 +2994,230 @@ inline void xfree(void* ptr) {
 }
 
 
+struct ArenaOwner;
+
+
+/**
+ * Header of a region of the arena allocator.
+ * @note While a region is free or pending, the link to the next one is kept at the head of its
+ * body, see arena_next.
+ */
+struct ArenaBlock {
+  ArenaOwner* owner;                     ///< arena which carved it, or NULL for the heap
+  size_t cls;                            ///< size class, or ARENACLASSNUM for the heap
+};
+
+
+/**
+ * Part of the arena allocator of a thread shared with the other threads.
+ * @note It outlives the thread until every region carved from its chunks has been freed.
+ */
+struct ArenaOwner {
+  std::atomic<ArenaBlock*> remotes;      ///< regions freed by the other threads
+  std::atomic<int64_t> live;             ///< regions left at the exit minus the remote frees
+  char* chunks;                          ///< chain of the chunks
+};
+
+
+/**
+ * State of the arena allocator of a thread.
+ */
+struct ArenaState {
+  ArenaBlock* frees[ARENACLASSNUM];      ///< free regions of each size class
+  ArenaBlock* pends;                     ///< regions freed since the last commit
+  ArenaOwner* owner;                     ///< shared part, or NULL before the first chunk
+  int64_t live;                          ///< regions carved and not freed by the thread itself
+  char* cur;                             ///< unused region of the current chunk
+  size_t rem;                            ///< size of the unused region
+  char* buf;                             ///< reusable buffer
+  size_t bsiz;                           ///< size of the reusable buffer
+};
+
+
+/**
+ * Get the arena state of the calling thread.
+ */
+inline ArenaState* __attribute__((transaction_safe)) arena_state() {
+  static __thread ArenaState state;
+  return &state;
+}
+
+
+/**
+ * Get the link to the next region of a free or pending region.
+ */
+inline ArenaBlock*& __attribute__((transaction_safe)) arena_next(ArenaBlock* blk) {
+  return *(ArenaBlock**)(blk + 1);
+}
+
+
+/**
+ * Allocate a region from the arena of the calling thread.
+ */
+inline void* __attribute__((transaction_safe)) arena_malloc(size_t size) {
+  _assert_(size <= MEMMAXSIZ);
+  ArenaState* state = arena_state();
+  ArenaBlock* blk;
+  if (size > ARENAMAX) {
+    blk = (ArenaBlock*)xmalloc(sizeof(*blk) + size);
+    blk->owner = NULL;
+    blk->cls = ARENACLASSNUM;
+    return blk + 1;
+  }
+  size_t cls = size > 0 ? (size - 1) / ARENAUNIT : 0;
+  blk = state->frees[cls];
+  if (blk) {
+    state->frees[cls] = arena_next(blk);
+    state->live++;
+    return blk + 1;
+  }
+  size_t bsiz = sizeof(*blk) + (cls + 1) * ARENAUNIT;
+  if (state->rem < bsiz) {
+    // the atomic members are zero-initialized as the owner must be created in a transaction.
+    if (!state->owner) state->owner = (ArenaOwner*)xcalloc(1, sizeof(ArenaOwner));
+    char* chunk = (char*)xmalloc(ARENACHUNKSIZ);
+    *(char**)chunk = state->owner->chunks;
+    state->owner->chunks = chunk;
+    state->cur = chunk + ARENAUNIT;
+    state->rem = ARENACHUNKSIZ - ARENAUNIT;
+  }
+  blk = (ArenaBlock*)state->cur;
+  state->cur += bsiz;
+  state->rem -= bsiz;
+  blk->owner = state->owner;
+  blk->cls = cls;
+  state->live++;
+  return blk + 1;
+}
+
+
+/**
+ * Free a region of the arena allocator.
+ */
+inline void __attribute__((transaction_safe)) arena_free(void* ptr) {
+  _assert_(true);
+  if (!ptr) return;
+  ArenaState* state = arena_state();
+  ArenaBlock* blk = (ArenaBlock*)ptr - 1;
+  arena_next(blk) = state->pends;
+  state->pends = blk;
+}
+
+
+/**
+ * Get the reusable buffer of the calling thread.
+ */
+inline char* __attribute__((transaction_safe)) arena_buffer(size_t size) {
+  _assert_(size <= MEMMAXSIZ);
+  ArenaState* state = arena_state();
+  if (size > state->bsiz) {
+    size_t bsiz = state->bsiz > 0 ? state->bsiz * 2 : ARENAUNIT * 4;
+    if (bsiz < size) bsiz = size;
+    arena_free(state->buf);
+    state->buf = (char*)arena_malloc(bsiz);
+    state->bsiz = bsiz;
+  }
+  return state->buf;
+}
+
+
+/**
+ * Return the chunks of an arena whose regions have all been freed to the heap.
+ */
+inline void arena_release(ArenaOwner* owner) {
+  _assert_(owner);
+  char* chunk = owner->chunks;
+  while (chunk) {
+    char* next = *(char**)chunk;
+    xfree(chunk);
+    chunk = next;
+  }
+  xfree(owner);
+}
+
+
+/**
+ * Give a region freed by the calling thread back to the arena which carved it.
+ */
+inline void arena_give(ArenaBlock* blk) {
+  _assert_(blk && blk->owner);
+  ArenaOwner* owner = blk->owner;
+  ArenaBlock* head = owner->remotes.load(std::memory_order_relaxed);
+  do {
+    arena_next(blk) = head;
+  } while (!owner->remotes.compare_exchange_weak(head, blk, std::memory_order_release,
+                                                 std::memory_order_relaxed));
+  if (owner->live.fetch_sub(1, std::memory_order_acq_rel) == 1) arena_release(owner);
+}
+
+
+/**
+ * Recycle the pending regions of an arena state and the regions given back to it.
+ */
+inline void arena_recycle(ArenaState* state) {
+  _assert_(state);
+  ArenaBlock* blk = state->pends;
+  state->pends = NULL;
+  while (blk) {
+    ArenaBlock* next = arena_next(blk);
+    if (blk->cls >= ARENACLASSNUM) {
+      xfree(blk);
+    } else if (blk->owner == state->owner) {
+      arena_next(blk) = state->frees[blk->cls];
+      state->frees[blk->cls] = blk;
+      state->live--;
+    } else {
+      arena_give(blk);
+    }
+    blk = next;
+  }
+  ArenaOwner* owner = state->owner;
+  if (!owner || !owner->remotes.load(std::memory_order_relaxed)) return;
+  blk = owner->remotes.exchange(NULL, std::memory_order_acquire);
+  while (blk) {
+    ArenaBlock* next = arena_next(blk);
+    arena_next(blk) = state->frees[blk->cls];
+    state->frees[blk->cls] = blk;
+    blk = next;
+  }
+}
+
+
+/**
+ * Detach the arena of the calling thread when the thread exits.
+ * @note The chunks are returned to the heap at once if no region carved from them is left, or
+ * else by the thread freeing the last one.
+ */
+inline void arena_exit() {
+  _assert_(true);
+  ArenaState* state = arena_state();
+  arena_free(state->buf);
+  arena_recycle(state);
+  ArenaOwner* owner = state->owner;
+  int64_t live = state->live;
+  std::memset(state, 0, sizeof(*state));
+  if (owner && owner->live.fetch_add(live, std::memory_order_acq_rel) + live == 0)
+    arena_release(owner);
+}
+
+
+/**
+ * Recycle the regions freed by the calling thread.
+ */
+inline void arena_commit() {
+  _assert_(true);
+  /** Trigger of arena_exit at the exit of the thread. */
+  struct ArenaReaper {
+    ~ArenaReaper() {
+      arena_exit();
+    }
+  };
+  static thread_local ArenaReaper reaper;
+  (void)reaper;
+  arena_recycle(arena_state());
+}
+
+
 /**
  * Dummy test driver.
  */
@@ -505,6 +505,197 @@ static int32_t procmutex(int64_t rnum, int32_t thnum, double iv) {
   }
   etime = kc::time();
   oprintf("time: %.3f\n", etime - stime);
+  kc::QueueMutex qmutex;
+  oprintf("queue mutex:\n");
+  stime = kc::time();
+  int64_t qcnt = 0;
+  class ThreadQueueMutex : public kc::Thread {
+   public:
+    void setparams(int32_t id, kc::QueueMutex* qmutex, int64_t* cnt,
+                   int64_t rnum, int32_t thnum, double iv) {
+      id_ = id;
+      qmutex_ = qmutex;
+      cnt_ = cnt;
+      rnum_ = rnum;
+      thnum_ = thnum;
+      iv_ = iv;
+    }
+    void run() {
+      for (int64_t i = 1; i <= rnum_; i++) {
+        if (i % 2 == 0) {
+          while (!qmutex_->lock_try()) {
+            yield();
+          }
+        } else {
+          qmutex_->lock();
+        }
+        int64_t cnt = *cnt_;
+        if (iv_ > 0) {
+          sleep(iv_);
+        } else if (iv_ < 0) {
+          yield();
+        }
+        *cnt_ = cnt + 1;
+        qmutex_->unlock();
+        if (id_ < 1 && rnum_ > 250 && i % (rnum_ / 250) == 0) {
+          oputchar('.');
+          if (i == rnum_ || i % (rnum_ / 10) == 0) oprintf(" (%08lld)\n", (long long)i);
+        }
+      }
+    }
+   private:
+    int32_t id_;
+    kc::QueueMutex* qmutex_;
+    int64_t* cnt_;
+    int64_t rnum_;
+    int32_t thnum_;
+    double iv_;
+  };
+  ThreadQueueMutex threadqmutexs[THREADMAX];
+  if (thnum < 2) {
+    threadqmutexs[0].setparams(0, &qmutex, &qcnt, rnum, thnum, iv);
+    threadqmutexs[0].run();
+  } else {
+    for (int32_t i = 0; i < thnum; i++) {
+      threadqmutexs[i].setparams(i, &qmutex, &qcnt, rnum, thnum, iv);
+      threadqmutexs[i].start();
+    }
+    for (int32_t i = 0; i < thnum; i++) {
+      threadqmutexs[i].join();
+    }
+  }
+  if (qcnt != rnum * (thnum < 2 ? 1 : thnum)) {
+    errprint(__LINE__, "QueueMutex::lock: %lld", (long long)qcnt);
+    err = true;
+  }
+  etime = kc::time();
+  oprintf("time: %.3f\n", etime - stime);
+  kc::SlottedQueueMutex sqmutex(LOCKSLOTNUM);
+  oprintf("slotted queue mutex:\n");
+  stime = kc::time();
+  class ThreadSlottedQueueMutex : public kc::Thread {
+   public:
+    void setparams(int32_t id, kc::SlottedQueueMutex* sqmutex,
+                   int64_t rnum, int32_t thnum, double iv) {
+      id_ = id;
+      sqmutex_ = sqmutex;
+      rnum_ = rnum;
+      thnum_ = thnum;
+      iv_ = iv;
+    }
+    void run() {
+      for (int64_t i = 1; i <= rnum_; i++) {
+        if (i % 100 == 0) {
+          sqmutex_->lock_all();
+          sqmutex_->unlock_all();
+        }
+        size_t idx = i % LOCKSLOTNUM;
+        sqmutex_->lock(idx);
+        if (iv_ > 0) {
+          sleep(iv_);
+        } else if (iv_ < 0) {
+          yield();
+        }
+        sqmutex_->unlock(idx);
+        if (id_ < 1 && rnum_ > 250 && i % (rnum_ / 250) == 0) {
+          oputchar('.');
+          if (i == rnum_ || i % (rnum_ / 10) == 0) oprintf(" (%08lld)\n", (long long)i);
+        }
+      }
+    }
+   private:
+    int32_t id_;
+    kc::SlottedQueueMutex* sqmutex_;
+    int64_t rnum_;
+    int32_t thnum_;
+    double iv_;
+  };
+  ThreadSlottedQueueMutex threadsqmutexs[THREADMAX];
+  if (thnum < 2) {
+    threadsqmutexs[0].setparams(0, &sqmutex, rnum, thnum, iv);
+    threadsqmutexs[0].run();
+  } else {
+    for (int32_t i = 0; i < thnum; i++) {
+      threadsqmutexs[i].setparams(i, &sqmutex, rnum, thnum, iv);
+      threadsqmutexs[i].start();
+    }
+    for (int32_t i = 0; i < thnum; i++) {
+      threadsqmutexs[i].join();
+    }
+  }
+  etime = kc::time();
+  oprintf("time: %.3f\n", etime - stime);
+  kc::AdaptiveMutex amutex;
+  oprintf("adaptive mutex:\n");
+  stime = kc::time();
+  int64_t acnt = 0;
+  class ThreadAdaptiveMutex : public kc::Thread {
+   public:
+    void setparams(int32_t id, kc::AdaptiveMutex* amutex, int64_t* cnt,
+                   int64_t rnum, int32_t thnum, double iv) {
+      id_ = id;
+      amutex_ = amutex;
+      cnt_ = cnt;
+      rnum_ = rnum;
+      thnum_ = thnum;
+      iv_ = iv;
+    }
+    void run() {
+      for (int64_t i = 1; i <= rnum_; i++) {
+        if (i % 2 == 0) {
+          while (!amutex_->lock_try()) {
+            yield();
+          }
+        } else {
+          amutex_->lock();
+        }
+        int64_t cnt = *cnt_;
+        if (iv_ > 0) {
+          sleep(iv_);
+        } else if (iv_ < 0) {
+          yield();
+        }
+        *cnt_ = cnt + 1;
+        amutex_->unlock();
+        if (id_ < 1 && rnum_ > 250 && i % (rnum_ / 250) == 0) {
+          oputchar('.');
+          if (i == rnum_ || i % (rnum_ / 10) == 0) oprintf(" (%08lld)\n", (long long)i);
+        }
+      }
+    }
+   private:
+    int32_t id_;
+    kc::AdaptiveMutex* amutex_;
+    int64_t* cnt_;
+    int64_t rnum_;
+    int32_t thnum_;
+    double iv_;
+  };
+  ThreadAdaptiveMutex threadamutexs[THREADMAX];
+  if (thnum < 2) {
+    threadamutexs[0].setparams(0, &amutex, &acnt, rnum, thnum, iv);
+    threadamutexs[0].run();
+  } else {
+    for (int32_t i = 0; i < thnum; i++) {
+      threadamutexs[i].setparams(i, &amutex, &acnt, rnum, thnum, iv);
+      threadamutexs[i].start();
+    }
+    for (int32_t i = 0; i < thnum; i++) {
+      threadamutexs[i].join();
+    }
+  }
+  kc::AdaptiveMutex::Profile aprof = amutex.profile();
+  if (acnt != rnum * (thnum < 2 ? 1 : thnum) || aprof.acquisitions != acnt ||
+      aprof.spins + aprof.parks > aprof.acquisitions) {
+    errprint(__LINE__, "AdaptiveMutex::lock: %lld %lld %lld %lld", (long long)acnt,
+             (long long)aprof.acquisitions, (long long)aprof.spins, (long long)aprof.parks);
+    err = true;
+  }
+  oprintf("spins: %lld\n", (long long)aprof.spins);
+  oprintf("parks: %lld\n", (long long)aprof.parks);
+  oprintf("wait: %.3f\n", aprof.waitns / 1000000000.0);
+  etime = kc::time();
+  oprintf("time: %.3f\n", etime - stime);
   kc::SpinLock spinlock;
   oprintf("spin lock:\n");
   stime = kc::time();
@@ -702,6 +893,130 @@ static int32_t procmutex(int64_t rnum, int32_t thnum, double iv) {
   }
   etime = kc::time();
   oprintf("time: %.3f\n", etime - stime);
+  oprintf("reader-writer lock mixed:\n");
+  stime = kc::time();
+  int64_t rwcell[2] = { 0, 0 };
+  class ThreadRWLockMixed : public kc::Thread {
+   public:
+    void setparams(int32_t id, kc::RWLock* rwlock, int64_t* cell,
+                   int64_t rnum, int32_t thnum, double iv) {
+      id_ = id;
+      rwlock_ = rwlock;
+      cell_ = cell;
+      rnum_ = rnum;
+      thnum_ = thnum;
+      iv_ = iv;
+      err_ = false;
+    }
+    bool error() {
+      return err_;
+    }
+    void run() {
+      for (int64_t i = 1; i <= rnum_; i++) {
+        if ((i + id_) % 8 == 0) {
+          rwlock_->lock_writer();
+          cell_[0]++;
+          if (iv_ > 0) {
+            sleep(iv_);
+          } else if (iv_ < 0) {
+            yield();
+          }
+          cell_[1]++;
+        } else {
+          rwlock_->lock_reader();
+          int64_t first = cell_[0];
+          if (iv_ > 0) {
+            sleep(iv_);
+          } else if (iv_ < 0) {
+            yield();
+          }
+          if (cell_[1] != first) {
+            errprint(__LINE__, "RWLock::lock_reader: writer not excluded");
+            err_ = true;
+          }
+        }
+        rwlock_->unlock();
+        if (id_ < 1 && rnum_ > 250 && i % (rnum_ / 250) == 0) {
+          oputchar('.');
+          if (i == rnum_ || i % (rnum_ / 10) == 0) oprintf(" (%08lld)\n", (long long)i);
+        }
+      }
+    }
+   private:
+    int32_t id_;
+    kc::RWLock* rwlock_;
+    int64_t* cell_;
+    int64_t rnum_;
+    int32_t thnum_;
+    double iv_;
+    bool err_;
+  };
+  ThreadRWLockMixed threadrwlockmixeds[THREADMAX];
+  if (thnum < 2) {
+    threadrwlockmixeds[0].setparams(0, &rwlock, rwcell, rnum, thnum, iv);
+    threadrwlockmixeds[0].run();
+    if (threadrwlockmixeds[0].error()) err = true;
+  } else {
+    for (int32_t i = 0; i < thnum; i++) {
+      threadrwlockmixeds[i].setparams(i, &rwlock, rwcell, rnum, thnum, iv);
+      threadrwlockmixeds[i].start();
+    }
+    for (int32_t i = 0; i < thnum; i++) {
+      threadrwlockmixeds[i].join();
+      if (threadrwlockmixeds[i].error()) err = true;
+    }
+  }
+  if (rwcell[0] != rwcell[1]) {
+    errprint(__LINE__, "RWLock::lock_writer: %lld", (long long)rwcell[1]);
+    err = true;
+  }
+  etime = kc::time();
+  oprintf("time: %.3f\n", etime - stime);
+  oprintf("reader-writer lock try:\n");
+  stime = kc::time();
+  class ThreadRWLockTry : public kc::Thread {
+   public:
+    void setparams(kc::RWLock* rwlock) {
+      rwlock_ = rwlock;
+      err_ = false;
+    }
+    bool error() {
+      return err_;
+    }
+    void run() {
+      if (rwlock_->lock_writer_try()) {
+        errprint(__LINE__, "RWLock::lock_writer_try: reader not excluded");
+        rwlock_->unlock();
+        err_ = true;
+      }
+    }
+   private:
+    kc::RWLock* rwlock_;
+    bool err_;
+  };
+  for (int64_t i = 1; i <= rnum && i <= 100; i++) {
+    kc::RWLock trylock;
+    trylock.lock_reader();
+    if (trylock.lock_writer_try()) {
+      errprint(__LINE__, "RWLock::lock_writer_try: reader not excluded");
+      trylock.unlock();
+      err = true;
+    }
+    ThreadRWLockTry threadrwlocktry;
+    threadrwlocktry.setparams(&trylock);
+    threadrwlocktry.start();
+    threadrwlocktry.join();
+    if (threadrwlocktry.error()) err = true;
+    trylock.unlock();
+    if (trylock.lock_writer_try()) {
+      trylock.unlock();
+    } else {
+      errprint(__LINE__, "RWLock::lock_writer_try: not acquired");
+      err = true;
+    }
+  }
+  etime = kc::time();
+  oprintf("time: %.3f\n", etime - stime);
   kc::SlottedRWLock srwlock(LOCKSLOTNUM);
   oprintf("slotted reader-writer lock writer:\n");
   stime = kc::time();
@@ -1131,6 +1446,79 @@ static int32_t procmutex(int64_t rnum, int32_t thnum, double iv) {
   }
   etime = kc::time();
   oprintf("time: %.3f\n", etime - stime);
+  int64_t* ecell = new int64_t(0);
+  oprintf("epoch:\n");
+  stime = kc::time();
+  class ThreadEpoch : public kc::Thread {
+   public:
+    void setparams(int32_t id, int64_t** cellp, int64_t rnum, int32_t thnum, double iv) {
+      id_ = id;
+      cellp_ = cellp;
+      rnum_ = rnum;
+      thnum_ = thnum;
+      iv_ = iv;
+      err_ = false;
+    }
+    bool error() {
+      return err_;
+    }
+    void run() {
+      for (int64_t i = 1; i <= rnum_; i++) {
+        {
+          kc::ScopedEpoch epoch;
+          int64_t* cell = __atomic_load_n(cellp_, __ATOMIC_ACQUIRE);
+          if (iv_ > 0) {
+            sleep(iv_);
+          } else if (iv_ < 0) {
+            yield();
+          }
+          if (*cell < 0) {
+            errprint(__LINE__, "Epoch::retire: freed too early");
+            err_ = true;
+          }
+        }
+        if (i % 4 == 0) {
+          int64_t* ocell = __atomic_exchange_n(cellp_, new int64_t(i), __ATOMIC_ACQ_REL);
+          kc::Epoch::retire(ocell, delete_cell);
+        }
+        if (id_ < 1 && rnum_ > 250 && i % (rnum_ / 250) == 0) {
+          oputchar('.');
+          if (i == rnum_ || i % (rnum_ / 10) == 0) oprintf(" (%08lld)\n", (long long)i);
+        }
+      }
+    }
+   private:
+    static void delete_cell(void* ptr) {
+      int64_t* cell = (int64_t*)ptr;
+      *cell = -1;
+      delete cell;
+    }
+    int32_t id_;
+    int64_t** cellp_;
+    int64_t rnum_;
+    int32_t thnum_;
+    double iv_;
+    bool err_;
+  };
+  ThreadEpoch threadepochs[THREADMAX];
+  if (thnum < 2) {
+    threadepochs[0].setparams(0, &ecell, rnum, thnum, iv);
+    threadepochs[0].run();
+    if (threadepochs[0].error()) err = true;
+  } else {
+    for (int32_t i = 0; i < thnum; i++) {
+      threadepochs[i].setparams(i, &ecell, rnum, thnum, iv);
+      threadepochs[i].start();
+    }
+    for (int32_t i = 0; i < thnum; i++) {
+      threadepochs[i].join();
+      if (threadepochs[i].error()) err = true;
+    }
+  }
+  delete ecell;
+  kc::Epoch::reclaim();
+  etime = kc::time();
+  oprintf("time: %.3f\n", etime - stime);
   oprintf("%s\n\n", err ? "error" : "ok");
   return err ? 1 : 0;
 }
@@ -1375,6 +1763,75 @@ static int32_t procpara(int64_t rnum, int32_t thnum, double iv) {
   }
   double etime = kc::time();
   oprintf("time: %.3f\n", etime - stime);
+  oprintf("thread pool:\n");
+  stime = kc::time();
+  kc::ThreadPool pool;
+  kc::AtomicInt64 pcnt;
+  class ThreadPoolImpl : public kc::Thread {
+   public:
+    void setparams(kc::ThreadPool* pool, kc::AtomicInt64* cnt, int64_t rnum, int32_t depth,
+                   int32_t width, double iv) {
+      pool_ = pool;
+      cnt_ = cnt;
+      rnum_ = rnum;
+      depth_ = depth;
+      width_ = width;
+      iv_ = iv;
+    }
+    void run() {
+      for (int64_t i = 1; i <= rnum_; i++) {
+        cnt_->add(1);
+        if (iv_ > 0) {
+          sleep(iv_);
+        } else if (iv_ < 0) {
+          yield();
+        }
+      }
+      if (depth_ > 0) {
+        ThreadPoolImpl subs[4];
+        for (int32_t i = 0; i < width_; i++) {
+          subs[i].setparams(pool_, cnt_, rnum_, depth_ - 1, width_, iv_);
+        }
+        pool_->run(subs, width_);
+      }
+    }
+   private:
+    kc::ThreadPool* pool_;
+    kc::AtomicInt64* cnt_;
+    int64_t rnum_;
+    int32_t depth_;
+    int32_t width_;
+    double iv_;
+  };
+  int64_t prnum = rnum / 10 / thnum + 1;
+  for (int32_t i = 1; i <= 10; i++) {
+    ThreadPoolImpl threadpools[THREADMAX];
+    for (int32_t j = 0; j < thnum; j++) {
+      threadpools[j].setparams(&pool, &pcnt, prnum, 1, 2, iv);
+    }
+    pool.run(threadpools, thnum);
+    oputchar('.');
+  }
+  oprintf(" (end)\n");
+  if (pcnt.get() != prnum * thnum * 3 * 10) {
+    errprint(__LINE__, "ThreadPool::run: %lld", (long long)pcnt.get());
+    err = true;
+  }
+  kc::ThreadPool gpool;
+  kc::AtomicInt64 gcnt;
+  for (int32_t i = 1; i <= 4; i++) {
+    ThreadPoolImpl threadpools[2];
+    for (int32_t j = 0; j < 2; j++) {
+      threadpools[j].setparams(&gpool, &gcnt, prnum, i / 4, 4, iv);
+    }
+    gpool.run(threadpools, 2);
+  }
+  if (gcnt.get() != prnum * 2 * 4 + prnum * 2 * 4) {
+    errprint(__LINE__, "ThreadPool::run: %lld", (long long)gcnt.get());
+    err = true;
+  }
+  etime = kc::time();
+  oprintf("time: %.3f\n", etime - stime);
   int64_t musage = memusage();
   if (musage > 0) oprintf("memory: %lld\n", (long long)(musage - g_memusage));
   oprintf("%s\n\n", err ? "error" : "ok");
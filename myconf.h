@@ -218,6 +218,13 @@ extern "C" {
 #include <sched.h>
 }
 
+#if defined(_SYS_LINUX_)
+extern "C" {
+#include <sys/syscall.h>
+#include <linux/futex.h>
+}
+#endif
+
 #endif
 
 #if defined(_SYS_FREEBSD_) || defined(_SYS_OPENBSD_) || defined(_SYS_NETBSD_) || \